@@ -0,0 +1,86 @@
+#include "benchmark_common.hpp"
+#include "async_file_reader.hpp"
+
+#include <QCoreApplication>
+#include <QElapsedTimer>
+
+#include <cmath>
+
+
+namespace
+{
+// Stand-in for per-packet decoding work done by a consumer.
+quint64 process(const QVector<device::WaveformPacket> &batch)
+{
+    quint64 checksum = 0;
+    for (const auto &waveform : batch)
+    {
+        double energy = 0.;
+        for (auto value : waveform.values)
+        {
+            energy += std::sqrt(static_cast<double>(value > waveform.baseline ? value - waveform.baseline : 0));
+        }
+        checksum += static_cast<quint64>(energy);
+    }
+    return checksum;
+}
+
+AsyncFileReader::Task consume(AsyncFileReader &reader, quint64 &packets, quint64 &checksum)
+{
+    while (auto batch = co_await reader.nextBatch())
+    {
+        packets += batch->size();
+        checksum += process(*batch);
+    }
+}
+
+} // namespace
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+
+    QString filename = (argc > 1) ? QString::fromLocal8Bit(argv[1])
+                                  : benchmark::generateFile("async_reader_benchmark.dgs", 200000);
+
+    quint64 blocking_packets = 0;
+    quint64 blocking_checksum = 0;
+    QElapsedTimer timer;
+
+    benchmark::dropPageCache(filename);
+    timer.start();
+    {
+        FileReader reader(filename);
+        QVector<device::DevicePSDSettings> settings;
+        reader.readSettings(settings);
+
+        QVector<device::WaveformPacket> batch;
+        while (!reader.atEnd() && reader.readWaveforms(batch, AsyncFileReader::default_batch_size))
+        {
+            blocking_packets += batch.size();
+            blocking_checksum += process(batch);
+            batch.clear();
+        }
+    }
+    benchmark::report("blocking (cold)", timer.nsecsElapsed(), blocking_packets);
+
+    quint64 async_packets = 0;
+    quint64 async_checksum = 0;
+
+    benchmark::dropPageCache(filename);
+    timer.restart();
+    {
+        ThreadReaderExecutor executor;
+        AsyncFileReader reader(filename, executor);
+        consume(reader, async_packets, async_checksum).wait();
+    }
+    benchmark::report("coroutine (cold)", timer.nsecsElapsed(), async_packets);
+
+    if (async_packets != blocking_packets || async_checksum != blocking_checksum)
+    {
+        std::cout << "Result mismatch between blocking and coroutine reads" << std::endl;
+        return 1;
+    }
+
+    return 0;
+}
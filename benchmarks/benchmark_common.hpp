@@ -0,0 +1,105 @@
+#ifndef BENCHMARK_COMMON_HPP
+#define BENCHMARK_COMMON_HPP
+
+#include "file_writer.hpp"
+
+#include <QFile>
+#include <QString>
+#include <QRandomGenerator>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+
+
+namespace benchmark
+{
+inline QVector<device::DevicePSDSettings> generateSettings(uint16_t channels, uint32_t wave_length)
+{
+    QVector<device::DevicePSDSettings> settings;
+    settings.reserve(channels);
+
+    for (uint16_t channel = 0; channel < channels; ++channel)
+    {
+        device::DevicePSDSettings settings_temp{};
+        settings_temp.channelId = channel;
+        settings_temp.psdWaveLength = wave_length;
+        settings_temp.psdPreTriggerLength = wave_length / 8;
+        settings_temp.triggerHoldOff = wave_length;
+        settings_temp.psdPreGateLength = wave_length / 16;
+        settings_temp.psdShortGateLength = wave_length / 8;
+        settings_temp.psdLongGateLength = wave_length / 2;
+        settings_temp.filterType = device::TTFilterType::CFD;
+        settings_temp.cfdSettings.cfdDelay = 4;
+        settings_temp.cfdSettings.cfdThreshold = 100;
+        settings_temp.cfdSettings.cfdFraction = 0.25;
+        settings.append(settings_temp);
+    }
+
+    return settings;
+}
+
+// Writes a file of pulse-like waveforms: flat baseline, fast rise, slow decay.
+inline QString generateFile(const QString &filename, uint32_t packets, uint16_t channels = 8, uint32_t wave_length = 256)
+{
+    FileWriter writer(filename);
+    writer.write(generateSettings(channels, wave_length));
+
+    QRandomGenerator generator(42);
+    QVector<device::WaveformPacket> waveforms;
+    const uint32_t chunk = 4096;
+
+    for (uint32_t written = 0; written < packets; written += chunk)
+    {
+        waveforms.clear();
+        for (uint32_t index = written; index < std::min(packets, written + chunk); ++index)
+        {
+            device::WaveformPacket waveform_temp;
+            waveform_temp.nubmerOfValues = wave_length;
+            waveform_temp.baseline = 1000 + generator.bounded(16);
+            waveform_temp.chanelId = index % channels;
+            waveform_temp.values.resize(wave_length);
+
+            uint32_t amplitude = 500 + generator.bounded(8000);
+            uint32_t trigger = wave_length / 8;
+            for (uint32_t sample = 0; sample < wave_length; ++sample)
+            {
+                double pulse = (sample < trigger) ? 0. : amplitude * std::exp(-double(sample - trigger) / (wave_length / 8));
+                waveform_temp.values[sample] = waveform_temp.baseline + static_cast<uint16_t>(pulse) + generator.bounded(8);
+            }
+            waveforms.append(waveform_temp);
+        }
+        writer.write(waveforms);
+    }
+
+    writer.close();
+    return filename;
+}
+
+// Evicts the file from the page cache so the next read hits the disk.
+inline void dropPageCache(const QString &filename)
+{
+    int descriptor = ::open(filename.toLocal8Bit().constData(), O_RDONLY);
+    if (descriptor < 0)
+    {
+        return;
+    }
+
+    ::fdatasync(descriptor);
+    ::posix_fadvise(descriptor, 0, 0, POSIX_FADV_DONTNEED);
+    ::close(descriptor);
+}
+
+inline void report(const char *name, qint64 nanoseconds, quint64 packets)
+{
+    double seconds = nanoseconds / 1e9;
+    std::cout << name << ": " << seconds * 1e3 << " ms, "
+              << (seconds > 0 ? packets / seconds : 0.) << " packets/s" << std::endl;
+}
+
+} // namespace benchmark
+
+#endif // BENCHMARK_COMMON_HPP
@@ -0,0 +1,51 @@
+#include "benchmark_common.hpp"
+#include "channel_demuxer.hpp"
+#include "file_reader.hpp"
+
+#include <QCoreApplication>
+#include <QElapsedTimer>
+#include <QDir>
+
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+
+    QString filename = (argc > 1) ? QString::fromLocal8Bit(argv[1])
+                                  : benchmark::generateFile("demux_benchmark.dgs", 1000000, 16);
+    QString copy_name = "demux_benchmark_copy.dgs";
+    QString output = "demux_benchmark_channels";
+
+    uint32_t packets = FileReader(filename).validPacketNumber();
+    QElapsedTimer timer;
+
+    // A plain copy is the bar: demux moves the same bytes, just to more files.
+    QFile::remove(copy_name);
+    benchmark::dropPageCache(filename);
+    timer.start();
+    QFile::copy(filename, copy_name);
+    benchmark::report("file copy", timer.nsecsElapsed(), packets);
+    QFile::remove(copy_name);
+
+    benchmark::dropPageCache(filename);
+    ChannelDemuxer demuxer(output);
+    timer.restart();
+    bool demuxed = demuxer.demux(filename);
+    benchmark::report("demux", timer.nsecsElapsed(), demuxer.demuxedPackets());
+
+    quint64 total = 0;
+    for (const auto &channel_file : demuxer.outputFilenames())
+    {
+        total += FileReader(channel_file).validPacketNumber();
+    }
+
+    QDir(output).removeRecursively();
+
+    if (!demuxed || total != packets)
+    {
+        std::cout << "Channel files hold " << total << " of " << packets << " packets" << std::endl;
+        return 1;
+    }
+
+    return 0;
+}
@@ -0,0 +1,93 @@
+#include "benchmark_common.hpp"
+#include "checkpoint_log.hpp"
+#include "file_validator.hpp"
+#include "file_reader.hpp"
+
+#include <QCoreApplication>
+#include <QElapsedTimer>
+#include <QFileInfo>
+
+
+namespace
+{
+// Writes packets copies of batch with the given policy, or plainly without one.
+void writeFile(const QString &filename, const QVector<device::WaveformPacket> &batch, quint64 packets,
+               const FileWriter::CommitPolicy *policy)
+{
+    FileWriter writer(filename);
+    writer.write(benchmark::generateSettings(8, 256));
+    if (policy)
+    {
+        writer.setCommitPolicy(*policy);
+    }
+
+    for (quint64 index = 0; index < packets; ++index)
+    {
+        writer.write(batch[index % batch.size()]);
+    }
+}
+}
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+
+    const quint64 packets = (argc > 1) ? QString::fromLocal8Bit(argv[1]).toULongLong() : 200000;
+    const quint64 synced_packets = std::min<quint64>(packets, 2000);
+
+    QString source = benchmark::generateFile("durable_writer_benchmark_source.dgs", 1024);
+    QVector<device::WaveformPacket> batch;
+    {
+        FileReader reader(source);
+        reader.readWaveforms(batch);
+    }
+    QFile::remove(source);
+
+    const QString filename = "durable_writer_benchmark.dgs";
+    QElapsedTimer timer;
+
+    timer.start();
+    writeFile(filename, batch, packets, nullptr);
+    benchmark::report("FileWriter", timer.nsecsElapsed(), packets);
+
+    // Syncing every packet is the cost group commit amortizes.
+    FileWriter::CommitPolicy every_packet{ 1, 0 };
+    timer.restart();
+    writeFile(filename, batch, synced_packets, &every_packet);
+    benchmark::report("sync every packet", timer.nsecsElapsed(), synced_packets);
+
+    FileWriter::CommitPolicy group{ 4 * 1024 * 1024, 100 };
+    timer.restart();
+    writeFile(filename, batch, packets, &group);
+    benchmark::report("group commit 4 MiB / 100 ms", timer.nsecsElapsed(), packets);
+
+    // A crash mid-packet leaves a torn tail after the last checkpoint.
+    const QByteArray torn(framing::packetSize(256) / 2, '\x5a');
+    {
+        QFile file(filename);
+        file.open(QIODevice::Append);
+        file.write(torn);
+    }
+    qint64 torn_size = QFileInfo(filename).size();
+
+    CheckpointLog::Recovery recovery;
+    timer.restart();
+    bool result = CheckpointLog::recover(filename, recovery);
+    benchmark::report("recover", timer.nsecsElapsed(), recovery.packets);
+
+    FileValidator validator(filename);
+    if (!result || recovery.packets != packets || recovery.truncated_bytes != torn.size() ||
+        recovery.scanned_bytes != torn.size() || recovery.size != torn_size - torn.size() ||
+        validator.validateFile() != FileValidator::ValidationError::None || validator.validPacketNumber() != packets)
+    {
+        std::cout << "Recovery kept " << recovery.packets << " of " << packets << " packets, cut "
+                  << recovery.truncated_bytes << " of " << torn.size() << " torn bytes" << std::endl;
+        result = false;
+    }
+    validator.close();
+
+    QFile::remove(filename);
+    QFile::remove(CheckpointLog::logFilename(filename));
+
+    return result ? 0 : 1;
+}
@@ -0,0 +1,72 @@
+#include "benchmark_common.hpp"
+#include "live_validator.hpp"
+
+#include <QCoreApplication>
+#include <QElapsedTimer>
+
+#include <algorithm>
+#include <thread>
+#include <vector>
+
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+
+    const uint32_t packets = 200000;
+    auto producer_ring = SharedRingBuffer::create("/dgs_live_ingest_benchmark", 16 * 1024 * 1024, true);
+    auto consumer_ring = SharedRingBuffer::open("/dgs_live_ingest_benchmark");
+    if (!producer_ring || !consumer_ring)
+    {
+        return 1;
+    }
+
+    // Producer and consumer share one clock and packets arrive in order, so the
+    // consumer looks up when the n-th packet was produced.
+    QElapsedTimer clock;
+    clock.start();
+    std::vector<std::atomic<qint64>> produced_at(packets);
+    std::vector<qint64> latencies;
+    latencies.reserve(packets);
+
+    std::atomic<bool> stop{false};
+    std::atomic<quint32> validated{0};
+    std::thread consumer([&]() {
+        LiveValidator validator(*consumer_ring);
+        quint32 index = 0;
+        validator.run([&](const framing::PacketView &packet) {
+            Q_UNUSED(packet)
+            latencies.push_back(clock.nsecsElapsed() - produced_at[index++].load(std::memory_order_acquire));
+            validated.store(index, std::memory_order_release);
+        }, stop);
+    });
+
+    device::WaveformPacket waveform;
+    waveform.nubmerOfValues = 256;
+    waveform.baseline = 1000;
+    waveform.chanelId = 0;
+    waveform.values.fill(1000, 256);
+
+    for (uint32_t index = 0; index < packets; ++index)
+    {
+        produced_at[index].store(clock.nsecsElapsed(), std::memory_order_release);
+        while (!producer_ring->write(waveform))
+        {
+            std::this_thread::yield();
+            produced_at[index].store(clock.nsecsElapsed(), std::memory_order_release);
+        }
+    }
+
+    while (validated.load(std::memory_order_acquire) < packets)
+    {
+        std::this_thread::yield();
+    }
+    stop = true;
+    consumer.join();
+
+    std::sort(latencies.begin(), latencies.end());
+    std::cout << "produced to validated latency: median " << latencies[latencies.size() / 2] / 1e3
+              << " us, p99 " << latencies[latencies.size() * 99 / 100] / 1e3 << " us" << std::endl;
+
+    return 0;
+}
@@ -0,0 +1,87 @@
+#include "benchmark_common.hpp"
+#include "packet_server.hpp"
+#include "packet_client.hpp"
+#include "file_reader.hpp"
+
+#include <QCoreApplication>
+#include <QElapsedTimer>
+
+#include <thread>
+
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+
+    QString filename = (argc > 1) ? QString::fromLocal8Bit(argv[1])
+                                  : benchmark::generateFile("packet_server_benchmark.dgs", 200000, 8);
+    const QString socket_path = "packet_server_benchmark.sock";
+    const int opens = 20;
+
+    PacketServer server(socket_path);
+    if (!server.listen())
+    {
+        return 1;
+    }
+    std::thread serving(&PacketServer::serve, &server);
+
+    QVector<device::WaveformPacket> expected;
+    QElapsedTimer timer;
+
+    // Every tool opening the file itself pays for a full validation.
+    timer.start();
+    for (int open = 0; open < opens; ++open)
+    {
+        expected.clear();
+        FileReader reader(filename);
+        reader.readWaveforms(expected);
+    }
+    benchmark::report("FileReader open + read", timer.nsecsElapsed(), quint64(expected.size()) * opens);
+
+    PacketClient client;
+    bool result = client.connectToServer(socket_path);
+
+    QVector<device::WaveformPacket> served;
+    timer.restart();
+    for (int open = 0; open < opens && result; ++open)
+    {
+        served.clear();
+        PacketSlice slice;
+        result = client.range(filename, 0, 0, slice) && slice.readWaveforms(served);
+    }
+    benchmark::report("served range + decode", timer.nsecsElapsed(), quint64(served.size()) * opens);
+
+    if (served != expected)
+    {
+        std::cout << "Served packets differ from FileReader" << std::endl;
+        result = false;
+    }
+
+    // Channel slices must partition the file.
+    PacketSlice info;
+    quint64 channel_packets = 0;
+    timer.restart();
+    for (uint16_t channel = 0; channel < 8 && result; ++channel)
+    {
+        PacketSlice slice;
+        if (client.channel(filename, channel, slice))
+        {
+            channel_packets += slice.packets();
+        }
+    }
+    benchmark::report("served channel ranges", timer.nsecsElapsed(), channel_packets);
+
+    PacketSlice last;
+    if (!client.info(filename, info) || channel_packets != info.filePackets() ||
+        !client.packet(filename, info.filePackets() - 1, last))
+    {
+        std::cout << "Channel slices hold " << channel_packets << " of " << info.filePackets() << " packets" << std::endl;
+        result = false;
+    }
+
+    client.close();
+    server.stop();
+    serving.join();
+
+    return result ? 0 : 1;
+}
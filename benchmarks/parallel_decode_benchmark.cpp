@@ -0,0 +1,49 @@
+#include "benchmark_common.hpp"
+#include "file_reader.hpp"
+
+#include <QCoreApplication>
+#include <QElapsedTimer>
+
+#include <thread>
+
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+
+    QString filename = (argc > 1) ? QString::fromLocal8Bit(argv[1])
+                                  : benchmark::generateFile("parallel_decode_benchmark.dgs", 500000);
+
+    QElapsedTimer timer;
+    QVector<device::WaveformPacket> serial;
+
+    timer.start();
+    {
+        FileReader reader(filename);
+        reader.readWaveforms(serial);
+    }
+    benchmark::report("serial", timer.nsecsElapsed(), serial.size());
+
+    uint32_t max_threads = std::max(1u, std::thread::hardware_concurrency());
+    for (uint32_t threads = 1; threads <= max_threads; threads = (threads == max_threads) ? threads + 1 : std::min(threads * 2, max_threads))
+    {
+        QVector<device::WaveformPacket> parallel;
+
+        timer.restart();
+        {
+            FileReader reader(filename, FileReader::ReadMode::Strict, threads);
+            reader.readWaveforms(parallel);
+        }
+
+        std::string name = "parallel, " + std::to_string(threads) + " threads";
+        benchmark::report(name.c_str(), timer.nsecsElapsed(), parallel.size());
+
+        if (parallel != serial)
+        {
+            std::cout << "Parallel decode with " << threads << " threads differs from serial decode" << std::endl;
+            return 1;
+        }
+    }
+
+    return 0;
+}
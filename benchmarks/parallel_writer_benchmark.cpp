@@ -0,0 +1,99 @@
+#include "benchmark_common.hpp"
+#include "parallel_file_writer.hpp"
+#include "file_validator.hpp"
+#include "file_reader.hpp"
+
+#include <QCoreApplication>
+#include <QCryptographicHash>
+#include <QElapsedTimer>
+
+#include <thread>
+
+
+namespace
+{
+QByteArray fileHash(const QString &filename)
+{
+    QFile file(filename);
+    QCryptographicHash hash(QCryptographicHash::Sha1);
+    if (file.open(QIODevice::ReadOnly))
+    {
+        hash.addData(&file);
+    }
+    return hash.result();
+}
+}
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+
+    const uint32_t batches = (argc > 1) ? QString::fromLocal8Bit(argv[1]).toUInt() : 256;
+    const uint32_t batch_packets = 1024;
+
+    // Encode from memory so the numbers show the writer, not the generator.
+    QString source = benchmark::generateFile("parallel_writer_benchmark_source.dgs", batch_packets);
+    QVector<device::DevicePSDSettings> settings = benchmark::generateSettings(8, 256);
+    QVector<device::WaveformPacket> batch;
+    {
+        FileReader reader(source);
+        reader.readWaveforms(batch);
+    }
+    QFile::remove(source);
+
+    QElapsedTimer timer;
+    quint64 packets = quint64(batches) * batch_packets;
+
+    QString serial_name = "parallel_writer_benchmark_serial.dgs";
+    timer.start();
+    {
+        FileWriter writer(serial_name);
+        writer.write(settings);
+        for (uint32_t index = 0; index < batches; ++index)
+        {
+            writer.write(batch);
+        }
+    }
+    benchmark::report("FileWriter", timer.nsecsElapsed(), packets);
+    QByteArray serial_hash = fileHash(serial_name);
+    QFile::remove(serial_name);
+
+    bool result = true;
+    uint32_t max_threads = std::max(1u, std::thread::hardware_concurrency());
+    for (uint32_t threads = 1; threads <= max_threads; threads = (threads == max_threads) ? threads + 1 : std::min(threads * 2, max_threads))
+    {
+        for (auto ordering : { ParallelFileWriter::Ordering::Ordered, ParallelFileWriter::Ordering::Unordered })
+        {
+            bool ordered = ordering == ParallelFileWriter::Ordering::Ordered;
+            QString filename = "parallel_writer_benchmark.dgs";
+
+            timer.restart();
+            {
+                ParallelFileWriter writer(filename, threads, ordering);
+                writer.write(settings);
+                for (uint32_t index = 0; index < batches; ++index)
+                {
+                    writer.write(batch);
+                }
+                writer.close();
+                result &= !writer.hasFailed();
+            }
+
+            std::string name = std::string(ordered ? "ordered, " : "unordered, ") + std::to_string(threads) + " threads";
+            benchmark::report(name.c_str(), timer.nsecsElapsed(), packets);
+
+            // Ordered output must be the very file FileWriter produces; any
+            // order must still validate with every packet present.
+            FileValidator validator(filename);
+            bool valid = validator.validateFile() == FileValidator::ValidationError::None && validator.validPacketNumber() == packets;
+            if (!valid || (ordered && fileHash(filename) != serial_hash))
+            {
+                std::cout << name << " produced a different file" << std::endl;
+                result = false;
+            }
+            QFile::remove(filename);
+        }
+    }
+
+    return result ? 0 : 1;
+}
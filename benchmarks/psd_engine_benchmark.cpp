@@ -0,0 +1,52 @@
+#include "benchmark_common.hpp"
+#include "psd_engine.hpp"
+
+#include <QCoreApplication>
+#include <QElapsedTimer>
+
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+
+    QString filename = (argc > 1) ? QString::fromLocal8Bit(argv[1])
+                                  : benchmark::generateFile("psd_engine_benchmark.dgs", 200000);
+
+    FileReader reader(filename);
+    QVector<device::DevicePSDSettings> settings;
+    QVector<device::WaveformPacket> waveforms;
+    reader.readSettings(settings);
+    reader.readWaveforms(waveforms);
+
+    PSDEngine engine(settings);
+    QVector<PSDResult> results;
+    QElapsedTimer timer;
+
+    // Warm up once, then time the in-memory kernel on a single core.
+    engine.process(waveforms, results);
+
+    const int repetitions = 10;
+    timer.start();
+    for (int repetition = 0; repetition < repetitions; ++repetition)
+    {
+        engine.process(waveforms, results);
+    }
+    benchmark::report("psd kernel, 1 core", timer.nsecsElapsed() / repetitions, waveforms.size());
+
+    double psd_sum = 0.;
+    for (const auto &result : results)
+    {
+        psd_sum += result.psd;
+    }
+    std::cout << "mean psd: " << (results.isEmpty() ? 0. : psd_sum / results.size()) << std::endl;
+
+    FileReader stream_reader(filename);
+    QVector<device::DevicePSDSettings> stream_settings;
+    stream_reader.readSettings(stream_settings);
+
+    timer.restart();
+    quint64 processed = engine.processStream(stream_reader, 4096, [](const auto &, const auto &) {});
+    benchmark::report("psd from read stream, 1 core", timer.nsecsElapsed(), processed);
+
+    return 0;
+}
@@ -0,0 +1,59 @@
+#include "benchmark_common.hpp"
+#include "file_reader.hpp"
+#include "lod_pyramid.hpp"
+
+#include <QCoreApplication>
+#include <QElapsedTimer>
+
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+
+    QString filename = (argc > 1) ? QString::fromLocal8Bit(argv[1])
+                                  : benchmark::generateFile("pyramid_benchmark.dgs", 2000000);
+
+    QElapsedTimer timer;
+    QVector<device::WaveformPacket> waveforms;
+
+    // What an overview costs without the sidecar.
+    timer.start();
+    {
+        FileReader reader(filename);
+        reader.readWaveforms(waveforms);
+    }
+    benchmark::report("full read", timer.nsecsElapsed(), waveforms.size());
+
+    timer.restart();
+    if (!LodPyramid::build(filename))
+    {
+        return 1;
+    }
+    benchmark::report("pyramid build", timer.nsecsElapsed(), waveforms.size());
+
+    LodPyramid pyramid;
+    if (!pyramid.open(filename))
+    {
+        return 1;
+    }
+
+    // Overview of every channel at screen width, then zoomed in ten times.
+    for (quint64 zoom : { 1, 10, 100, 1000 })
+    {
+        QVector<LodBin> bins;
+        quint64 packets = 0;
+
+        timer.restart();
+        for (auto channel : pyramid.channels())
+        {
+            quint64 channel_packets = pyramid.packetCount(channel);
+            pyramid.query(channel, 0, channel_packets / zoom, 2000, bins);
+            packets += channel_packets / zoom;
+        }
+
+        std::string name = "overview, zoom " + std::to_string(zoom);
+        benchmark::report(name.c_str(), timer.nsecsElapsed(), packets);
+    }
+
+    return 0;
+}
@@ -0,0 +1,138 @@
+#include "benchmark_common.hpp"
+#include "file_reader.hpp"
+#include "timing_kernel.hpp"
+
+#include <QCoreApplication>
+#include <QElapsedTimer>
+
+#include <cmath>
+
+
+namespace
+{
+// Straight per-sample definition of both triggers in double precision, the
+// reference the vectorised kernel is held against.
+TimingResult referenceTiming(const device::WaveformPacket &waveform, const device::DevicePSDSettings &settings)
+{
+    TimingResult result{ waveform.chanelId, false, 0.f };
+
+    bool cfd = settings.filterType == device::TTFilterType::CFD;
+    uint32_t threshold = cfd ? settings.cfdSettings.cfdThreshold : settings.ledSettings.ledThresholdUp;
+    double level = double(waveform.baseline) + threshold;
+    if (level > 65535.)
+    {
+        return result;
+    }
+
+    qsizetype length = waveform.values.size();
+    qsizetype armed = 0;
+    while (armed < length && waveform.values[armed] < level)
+    {
+        ++armed;
+    }
+    if (armed == length)
+    {
+        return result;
+    }
+
+    if (!cfd)
+    {
+        result.valid = true;
+        result.time = armed == 0 ? 0.f
+                                 : float((armed - 1) + (level - waveform.values[armed - 1]) /
+                                                           (double(waveform.values[armed]) - waveform.values[armed - 1]));
+        return result;
+    }
+
+    qsizetype delay = settings.cfdSettings.cfdDelay;
+    double fraction = float(settings.cfdSettings.cfdFraction);
+    auto shaped = [&](qsizetype index) {
+        return fraction * (double(waveform.values[index]) - waveform.baseline) -
+               (double(waveform.values[index - delay]) - waveform.baseline);
+    };
+
+    for (qsizetype index = std::max(armed, delay) + 1; index < length; ++index)
+    {
+        double before = shaped(index - 1);
+        double after = shaped(index);
+        if (before > 0. && after <= 0.)
+        {
+            result.valid = true;
+            result.time = float((index - 1) + before / (before - after));
+            return result;
+        }
+    }
+
+    return result;
+}
+}
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+
+    QString filename = (argc > 1) ? QString::fromLocal8Bit(argv[1])
+                                  : benchmark::generateFile("timing_kernel_benchmark.dgs", 200000);
+
+    FileReader reader(filename);
+    QVector<device::DevicePSDSettings> settings;
+    QVector<device::WaveformPacket> waveforms;
+    reader.readSettings(settings);
+    reader.readWaveforms(waveforms);
+
+    // Every other channel triggers on a leading edge instead.
+    QVector<device::DevicePSDSettings> channel_settings(65536);
+    for (auto &value : settings)
+    {
+        if (value.channelId % 2 == 1)
+        {
+            value.filterType = device::TTFilterType::LED;
+            value.ledSettings.ledThresholdUp = 200;
+            value.ledSettings.ledThresholdDown = 100;
+        }
+        channel_settings[value.channelId] = value;
+    }
+
+    TimingKernel kernel(settings);
+    QVector<TimingResult> results;
+    QElapsedTimer timer;
+
+    // Warm up once, then time the in-memory kernel on a single core.
+    kernel.process(waveforms, results);
+
+    const int repetitions = 10;
+    timer.start();
+    for (int repetition = 0; repetition < repetitions; ++repetition)
+    {
+        kernel.process(waveforms, results);
+    }
+    benchmark::report("timing kernel, 1 core", timer.nsecsElapsed() / repetitions, waveforms.size());
+
+    // Crossings agree to well below a sample; float rounding near a zero of
+    // the shaped signal moves them by far less than the tolerance.
+    quint64 mismatches = 0;
+    for (qsizetype index = 0; index < waveforms.size(); ++index)
+    {
+        TimingResult expected = referenceTiming(waveforms.at(index), channel_settings.at(waveforms.at(index).chanelId));
+        const TimingResult &actual = results.at(index);
+
+        if (actual.valid != expected.valid || (expected.valid && std::fabs(actual.time - expected.time) > 1e-2f))
+        {
+            if (mismatches < 10)
+            {
+                std::cout << "packet " << index << ": kernel " << actual.valid << " " << actual.time
+                          << ", reference " << expected.valid << " " << expected.time << std::endl;
+            }
+            ++mismatches;
+        }
+    }
+
+    std::cout << mismatches << " of " << waveforms.size() << " crossing times differ from the scalar reference" << std::endl;
+
+    if (argc <= 1)
+    {
+        QFile::remove(filename);
+    }
+
+    return mismatches == 0 ? 0 : 1;
+}
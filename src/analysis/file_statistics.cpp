@@ -0,0 +1,485 @@
+#include "file_statistics.hpp"
+#include "file_validator.hpp"
+#include "simd_reduce.hpp"
+#include "trace_events.hpp"
+
+#include <QFile>
+#include <QElapsedTimer>
+#include <QDebug>
+
+#include <algorithm>
+#include <bit>
+#include <iomanip>
+#include <limits>
+#include <string>
+#include <thread>
+#include <vector>
+
+
+namespace
+{
+constexpr qint64 minimum_chunk_size = 16 * 1024 * 1024;
+
+quint64 bucketMinimum(int bucket)
+{
+    return bucket > 0 ? quint64(1) << (bucket - 1) : 0;
+}
+
+quint64 bucketMaximum(int bucket)
+{
+    return bucket > 0 ? (quint64(1) << bucket) - 1 : 0;
+}
+
+const char *formatName(framing::PacketFormat format)
+{
+    return format == framing::PacketFormat::Timestamped ? "timestamped" : "plain";
+}
+
+std::string jsonString(const QString &value)
+{
+    static constexpr char hex_digits[] = "0123456789abcdef";
+
+    std::string escaped;
+    for (char character : value.toStdString())
+    {
+        auto byte = static_cast<unsigned char>(character);
+        if (byte < 0x20)
+        {
+            // Control characters may not appear raw inside a JSON string.
+            escaped += "\\u00";
+            escaped += hex_digits[byte >> 4];
+            escaped += hex_digits[byte & 0xf];
+            continue;
+        }
+
+        if (character == '"' || character == '\\')
+        {
+            escaped += '\\';
+        }
+        escaped += character;
+    }
+
+    return escaped;
+}
+}
+
+void ChannelStatistics::add(const framing::PacketView &view, qint64 offset)
+{
+    quint32 length = view.numberOfValues();
+    uint16_t baseline = view.baseline();
+
+    if (packets == 0)
+    {
+        min_length = max_length = length;
+        min_baseline = max_baseline = baseline;
+        first_offset = offset;
+    }
+    else
+    {
+        min_length = std::min(min_length, length);
+        max_length = std::max(max_length, length);
+        min_baseline = std::min(min_baseline, baseline);
+        max_baseline = std::max(max_baseline, baseline);
+    }
+
+    ++lengths[std::bit_width(length)];
+    samples += length;
+    baseline_sum += baseline;
+
+    if (view.format == framing::PacketFormat::Timestamped)
+    {
+        quint64 timestamp = view.timestamp();
+        if (packets == 0)
+        {
+            first_timestamp = timestamp;
+        }
+        else if (timestamp > last_timestamp && timestamp - last_timestamp > largest_gap)
+        {
+            largest_gap = timestamp - last_timestamp;
+            gap_timestamp = last_timestamp;
+            gap_offset = offset;
+        }
+        last_timestamp = timestamp;
+    }
+
+    ++packets;
+}
+
+void ChannelStatistics::addSamples(const uint16_t *values, quint32 count)
+{
+    if (count == 0)
+    {
+        return;
+    }
+
+    uint16_t minimum;
+    uint16_t maximum;
+    simd::minMaxU16(values, count, minimum, maximum);
+
+    min_sample = sampled_values > 0 ? std::min(min_sample, minimum) : minimum;
+    max_sample = sampled_values > 0 ? std::max(max_sample, maximum) : maximum;
+    sample_sum += simd::sumU16(values, count);
+    sampled_values += count;
+    ++sampled_packets;
+}
+
+void ChannelStatistics::merge(const ChannelStatistics &next)
+{
+    if (next.packets == 0)
+    {
+        return;
+    }
+
+    if (packets == 0)
+    {
+        *this = next;
+        return;
+    }
+
+    min_length = std::min(min_length, next.min_length);
+    max_length = std::max(max_length, next.max_length);
+    min_baseline = std::min(min_baseline, next.min_baseline);
+    max_baseline = std::max(max_baseline, next.max_baseline);
+
+    for (int bucket = 0; bucket < length_buckets; ++bucket)
+    {
+        lengths[bucket] += next.lengths[bucket];
+    }
+    samples += next.samples;
+    baseline_sum += next.baseline_sum;
+
+    // The gap across the seam between the two runs counts as well.
+    if (next.first_timestamp > last_timestamp && next.first_timestamp - last_timestamp > largest_gap)
+    {
+        largest_gap = next.first_timestamp - last_timestamp;
+        gap_timestamp = last_timestamp;
+        gap_offset = next.first_offset;
+    }
+    if (next.largest_gap > largest_gap)
+    {
+        largest_gap = next.largest_gap;
+        gap_timestamp = next.gap_timestamp;
+        gap_offset = next.gap_offset;
+    }
+    last_timestamp = next.last_timestamp;
+
+    if (next.sampled_values > 0)
+    {
+        min_sample = sampled_values > 0 ? std::min(min_sample, next.min_sample) : next.min_sample;
+        max_sample = sampled_values > 0 ? std::max(max_sample, next.max_sample) : next.max_sample;
+    }
+    sampled_packets += next.sampled_packets;
+    sampled_values += next.sampled_values;
+    sample_sum += next.sample_sum;
+
+    packets += next.packets;
+}
+
+FileStatistics::FileStatistics(uint32_t threads, uint32_t sample_every)
+    : threads(threads > 0 ? threads : std::max(1u, std::thread::hardware_concurrency())),
+      sample_every(sample_every), format(framing::PacketFormat::Plain), packet_count(0), file_size(0), elapsed_ns(0)
+{
+}
+
+bool FileStatistics::scan(const QString &filename)
+{
+    TRACE_SCOPE("FileStatistics::scan");
+
+    QElapsedTimer timer;
+    timer.start();
+
+    scanned_file = filename;
+    packet_count = 0;
+    file_size = 0;
+    channel_statistics.clear();
+
+    FileValidator validator(filename);
+    if (validator.validateHeader() != FileValidator::ValidationError::None)
+    {
+        qWarning() << "No statistics for file with invalid header:" << filename;
+        return false;
+    }
+    format = validator.packetFormat();
+
+    QFile file(filename);
+    if (!file.open(QIODevice::ReadOnly))
+    {
+        qWarning() << "Failed to open file for reading:" << file.errorString();
+        return false;
+    }
+
+    file_size = file.size();
+    qint64 body_offset = framing::bodyOffset(validator.settingsNumber());
+    qint64 body_size = file_size - body_offset;
+
+    uchar *data = body_size > 0 ? file.map(0, file_size) : nullptr;
+    if (body_size > 0 && !data)
+    {
+        qWarning() << "Failed to map file for statistics:" << file.errorString();
+        return false;
+    }
+
+    // Packets are counted and binned in one walk; which ones are sampled
+    // depends on their position in the file, known only once it is done.
+    qint64 chunk_count = std::clamp<qint64>(body_size / minimum_chunk_size, 1, threads);
+    QVector<framing::BodyChunk> chunks;
+    QVector<ChunkStatistics> chunk_statistics(chunk_count);
+    qint64 chain_end;
+
+    {
+        TRACE_SCOPE("FileStatistics::headers");
+
+        chain_end = framing::walkChunks(
+            data, file_size, body_offset, format, chunk_count, chunks,
+            [&chunk_statistics](qint64 index) { chunk_statistics[index].clear(); },
+            [&chunk_statistics](qint64 index, qint64 offset, const framing::PacketView &view) {
+                chunk_statistics[index].channel(view.chanelId()).add(view, offset);
+            });
+    }
+
+    if (sample_every > 0)
+    {
+        TRACE_SCOPE("FileStatistics::samples");
+
+        std::vector<std::thread> workers;
+        for (qint64 index = 0; index < chunk_count; ++index)
+        {
+            workers.emplace_back([this, data, &chunks, &chunk_statistics, index]() {
+                sampleChunk(data, chunks[index], chunk_statistics[index]);
+            });
+        }
+
+        for (auto &worker : workers)
+        {
+            worker.join();
+        }
+    }
+
+    // Whatever precedes a malformed packet is still reported.
+    QVector<int32_t> slots(std::numeric_limits<uint16_t>::max() + 1, -1);
+    for (qint64 index = 0; index < chunk_count; ++index)
+    {
+        for (const auto &statistics : chunk_statistics[index].statistics)
+        {
+            int32_t &slot = slots[statistics.channel_id];
+            if (slot < 0)
+            {
+                slot = channel_statistics.size();
+                channel_statistics.append(ChannelStatistics());
+            }
+            channel_statistics[slot].merge(statistics);
+        }
+
+        packet_count += chunks[index].packets;
+    }
+
+    if (data)
+    {
+        file.unmap(data);
+    }
+
+    std::sort(channel_statistics.begin(), channel_statistics.end(),
+              [](const ChannelStatistics &left, const ChannelStatistics &right) { return left.channel_id < right.channel_id; });
+
+    elapsed_ns = timer.nsecsElapsed();
+
+    if (chain_end < file_size)
+    {
+        qWarning() << "Malformed waveform packet near offset" << chain_end << "in" << filename;
+        return false;
+    }
+
+    return true;
+}
+
+ChannelStatistics &FileStatistics::ChunkStatistics::channel(uint16_t channel_id)
+{
+    if (slots.isEmpty())
+    {
+        slots.fill(-1, std::numeric_limits<uint16_t>::max() + 1);
+    }
+
+    int32_t &slot = slots[channel_id];
+    if (slot < 0)
+    {
+        slot = statistics.size();
+        statistics.append(ChannelStatistics());
+        statistics.last().channel_id = channel_id;
+    }
+
+    return statistics[slot];
+}
+
+void FileStatistics::ChunkStatistics::clear()
+{
+    for (const auto &value : statistics)
+    {
+        slots[value.channel_id] = -1;
+    }
+    statistics.clear();
+}
+
+void FileStatistics::sampleChunk(const uchar *data, const framing::BodyChunk &chunk, ChunkStatistics &statistics) const
+{
+    QVector<uint16_t> samples;
+
+    // The chunk is already framed, so the packet lengths alone lead the way.
+    qint64 position = chunk.first_packet;
+    for (quint64 packet = 0; packet < chunk.packets; ++packet)
+    {
+        framing::PacketView view{ data + position, 0, format };
+        view.size = framing::packetSize(view.numberOfValues(), format);
+
+        if ((chunk.first_index + packet) % sample_every == 0)
+        {
+            quint32 number_of_values = view.numberOfValues();
+            samples.resize(number_of_values);
+            qFromBigEndian<quint16>(view.samples(), number_of_values, samples.data());
+            statistics.channel(view.chanelId()).addSamples(samples.constData(), number_of_values);
+        }
+
+        position += view.size;
+    }
+}
+
+const QString &FileStatistics::filename() const
+{
+    return scanned_file;
+}
+
+framing::PacketFormat FileStatistics::packetFormat() const
+{
+    return format;
+}
+
+quint64 FileStatistics::packets() const
+{
+    return packet_count;
+}
+
+qint64 FileStatistics::fileSize() const
+{
+    return file_size;
+}
+
+qint64 FileStatistics::elapsedNs() const
+{
+    return elapsed_ns;
+}
+
+const QVector<ChannelStatistics> &FileStatistics::channels() const
+{
+    return channel_statistics;
+}
+
+void FileStatistics::writeTable(std::ostream &out) const
+{
+    double seconds = std::max<qint64>(elapsed_ns, 1) / 1e9;
+    bool timestamped = format == framing::PacketFormat::Timestamped;
+    bool sampled = sample_every > 0;
+
+    // The caller's stream is handed back formatted the way it came in.
+    std::ios_base::fmtflags flags = out.flags();
+    std::streamsize precision = out.precision();
+
+    out << scanned_file.toStdString() << ": " << formatName(format) << ", " << file_size << " bytes, "
+        << packet_count << " packets, " << channel_statistics.size() << " channels, "
+        << std::fixed << std::setprecision(3) << seconds << " s ("
+        << std::setprecision(1) << (file_size / seconds) / (1024 * 1024) << " MiB/s)" << std::endl;
+
+    out << std::setw(8) << "channel" << std::setw(14) << "packets"
+        << std::setw(10) << "len min" << std::setw(10) << "len mean" << std::setw(10) << "len max"
+        << std::setw(10) << "base min" << std::setw(11) << "base mean" << std::setw(10) << "base max";
+    if (timestamped)
+    {
+        out << std::setw(14) << "largest gap" << std::setw(22) << "gap after" << std::setw(16) << "gap offset";
+    }
+    if (sampled)
+    {
+        out << std::setw(10) << "smp min" << std::setw(10) << "smp mean" << std::setw(10) << "smp max";
+    }
+    out << std::endl;
+
+    std::array<quint64, ChannelStatistics::length_buckets> lengths{};
+
+    for (const auto &channel : channel_statistics)
+    {
+        out << std::setw(8) << channel.channel_id << std::setw(14) << channel.packets
+            << std::setw(10) << channel.min_length << std::setw(10) << channel.meanLength() << std::setw(10) << channel.max_length
+            << std::setw(10) << channel.min_baseline << std::setw(11) << channel.meanBaseline() << std::setw(10) << channel.max_baseline;
+        if (timestamped)
+        {
+            out << std::setw(14) << channel.largest_gap << std::setw(22) << channel.gap_timestamp << std::setw(16) << channel.gap_offset;
+        }
+        if (sampled)
+        {
+            out << std::setw(10) << channel.min_sample << std::setw(10) << channel.meanSample() << std::setw(10) << channel.max_sample;
+        }
+        out << std::endl;
+
+        for (int bucket = 0; bucket < ChannelStatistics::length_buckets; ++bucket)
+        {
+            lengths[bucket] += channel.lengths[bucket];
+        }
+    }
+
+    out << "lengths:";
+    for (int bucket = 0; bucket < ChannelStatistics::length_buckets; ++bucket)
+    {
+        if (lengths[bucket] > 0)
+        {
+            out << " [" << bucketMinimum(bucket) << "-" << bucketMaximum(bucket) << "] " << lengths[bucket];
+        }
+    }
+    out << std::endl;
+
+    out.flags(flags);
+    out.precision(precision);
+}
+
+void FileStatistics::writeJson(std::ostream &out) const
+{
+    out << "{\"file\":\"" << jsonString(scanned_file) << "\",\"format\":\"" << formatName(format)
+        << "\",\"bytes\":" << file_size << ",\"packets\":" << packet_count << ",\"elapsed_ns\":" << elapsed_ns
+        << ",\"channels\":[";
+
+    for (qsizetype index = 0; index < channel_statistics.size(); ++index)
+    {
+        const auto &channel = channel_statistics.at(index);
+
+        out << (index > 0 ? "," : "") << "{\"channel\":" << channel.channel_id << ",\"packets\":" << channel.packets
+            << ",\"samples\":" << channel.samples
+            << ",\"length\":{\"min\":" << channel.min_length << ",\"mean\":" << channel.meanLength() << ",\"max\":" << channel.max_length << "}"
+            << ",\"baseline\":{\"min\":" << channel.min_baseline << ",\"mean\":" << channel.meanBaseline() << ",\"max\":" << channel.max_baseline << "}";
+
+        out << ",\"lengths\":[";
+        bool first = true;
+        for (int bucket = 0; bucket < ChannelStatistics::length_buckets; ++bucket)
+        {
+            if (channel.lengths[bucket] > 0)
+            {
+                out << (first ? "" : ",") << "{\"min\":" << bucketMinimum(bucket) << ",\"max\":" << bucketMaximum(bucket)
+                    << ",\"packets\":" << channel.lengths[bucket] << "}";
+                first = false;
+            }
+        }
+        out << "]";
+
+        if (format == framing::PacketFormat::Timestamped)
+        {
+            out << ",\"timestamps\":{\"first\":" << channel.first_timestamp << ",\"last\":" << channel.last_timestamp
+                << ",\"largest_gap\":" << channel.largest_gap << ",\"gap_after\":" << channel.gap_timestamp
+                << ",\"gap_offset\":" << channel.gap_offset << "}";
+        }
+
+        if (sample_every > 0)
+        {
+            out << ",\"sampled\":{\"packets\":" << channel.sampled_packets << ",\"values\":" << channel.sampled_values
+                << ",\"min\":" << channel.min_sample << ",\"mean\":" << channel.meanSample() << ",\"max\":" << channel.max_sample << "}";
+        }
+
+        out << "}";
+    }
+
+    out << "]}";
+}
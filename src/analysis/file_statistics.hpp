@@ -0,0 +1,103 @@
+#ifndef FILE_STATISTICS_HPP
+#define FILE_STATISTICS_HPP
+
+#include "packet_framing.hpp"
+#include "chunk_walker.hpp"
+
+#include <QString>
+#include <QVector>
+
+#include <array>
+#include <ostream>
+
+
+// Per-channel summary of the packets of one file. Length buckets are powers of
+// two: bucket 0 counts empty packets, bucket b lengths in [2^(b-1), 2^b).
+struct ChannelStatistics
+{
+    static constexpr int length_buckets = 33;
+
+    uint16_t channel_id = 0;
+    quint64 packets = 0;
+    quint64 samples = 0;
+    quint32 min_length = 0;
+    quint32 max_length = 0;
+    std::array<quint64, length_buckets> lengths{};
+
+    uint16_t min_baseline = 0;
+    uint16_t max_baseline = 0;
+    quint64 baseline_sum = 0;
+
+    // Timestamped files only; the gap is measured between consecutive packets
+    // of the channel and located by the offset of the packet that ends it.
+    qint64 first_offset = -1;
+    quint64 first_timestamp = 0;
+    quint64 last_timestamp = 0;
+    quint64 largest_gap = 0;
+    quint64 gap_timestamp = 0;
+    qint64 gap_offset = -1;
+
+    // Filled for sampled packets only.
+    quint64 sampled_packets = 0;
+    quint64 sampled_values = 0;
+    quint64 sample_sum = 0;
+    uint16_t min_sample = 0;
+    uint16_t max_sample = 0;
+
+    double meanLength() const { return packets > 0 ? double(samples) / packets : 0.; }
+    double meanBaseline() const { return packets > 0 ? double(baseline_sum) / packets : 0.; }
+    double meanSample() const { return sampled_values > 0 ? double(sample_sum) / sampled_values : 0.; }
+
+    void add(const framing::PacketView &view, qint64 offset);
+    void addSamples(const uint16_t *values, quint32 count);
+    // Appends the statistics of packets that follow these in the file.
+    void merge(const ChannelStatistics &next);
+};
+
+// One parallel pass over the packet headers of a .dgs file. The body is cut
+// into byte chunks that are walked side by side, the same way ChannelDemuxer
+// does, and only the samples of every sample_every-th packet of the file are
+// decoded and reduced (0 - never).
+class FileStatistics
+{
+public:
+    explicit FileStatistics(uint32_t threads = 0, uint32_t sample_every = 0);
+
+    bool scan(const QString &filename);
+
+    const QString &filename() const;
+    framing::PacketFormat packetFormat() const;
+    quint64 packets() const;
+    qint64 fileSize() const;
+    qint64 elapsedNs() const;
+    const QVector<ChannelStatistics> &channels() const;
+
+    void writeTable(std::ostream &out) const;
+    void writeJson(std::ostream &out) const;
+
+private:
+    // Statistics gathered by one chunk, one entry per channel it has seen.
+    struct ChunkStatistics
+    {
+        QVector<int32_t> slots; // chanelId -> index into statistics, -1 if unseen
+        QVector<ChannelStatistics> statistics;
+
+        ChannelStatistics &channel(uint16_t channel_id);
+        void clear();
+    };
+
+    void sampleChunk(const uchar *data, const framing::BodyChunk &chunk, ChunkStatistics &statistics) const;
+
+private:
+    uint32_t threads;
+    uint32_t sample_every;
+
+    QString scanned_file;
+    framing::PacketFormat format;
+    quint64 packet_count;
+    qint64 file_size;
+    qint64 elapsed_ns;
+    QVector<ChannelStatistics> channel_statistics;
+};
+
+#endif // FILE_STATISTICS_HPP
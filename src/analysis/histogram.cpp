@@ -0,0 +1,78 @@
+#include "histogram.hpp"
+
+#include <QFile>
+#include <QDataStream>
+#include <QtEndian>
+#include <QDebug>
+
+
+Histogram::Histogram(const HistogramAxis &x_axis, uint32_t threads)
+    : dimensions(1), x_axis(x_axis), y_axis{ 0, 0., 0. }
+{
+    cells = x_axis.bins + 2;
+    allocate(threads);
+}
+
+Histogram::Histogram(const HistogramAxis &x_axis, const HistogramAxis &y_axis, uint32_t threads)
+    : dimensions(2), x_axis(x_axis), y_axis(y_axis)
+{
+    cells = (x_axis.bins + 2) * (y_axis.bins + 2);
+    allocate(threads);
+}
+
+void Histogram::allocate(uint32_t threads)
+{
+    const uint32_t per_line = sizeof(CacheLine) / sizeof(quint64);
+
+    thread_count = std::max(threads, 1u);
+    stride = ((cells + per_line - 1) / per_line) * per_line;
+
+    storage.assign(static_cast<size_t>(stride / per_line) * thread_count, CacheLine{});
+}
+
+void Histogram::merge()
+{
+    merged.resize(cells);
+    merged.fill(0);
+
+    for (uint32_t thread = 0; thread < thread_count; ++thread)
+    {
+        const quint64 *bins = localBins() + thread * stride;
+        for (uint32_t cell = 0; cell < cells; ++cell)
+        {
+            merged[cell] += bins[cell];
+        }
+    }
+}
+
+const QVector<quint64> &Histogram::counts() const
+{
+    return merged;
+}
+
+bool Histogram::save(const QString &filename) const
+{
+    QFile file(filename);
+    if (!file.open(QIODevice::WriteOnly))
+    {
+        qWarning() << "Failed to open histogram for writing:" << file.errorString();
+        return false;
+    }
+
+    QByteArray header;
+    QDataStream out(&header, QIODevice::WriteOnly);
+    out.setByteOrder(QDataStream::LittleEndian);
+
+    out.writeRawData("DGSH", 4);
+    out << dimensions;
+    out << x_axis.bins << x_axis.minimum << x_axis.maximum;
+    if (dimensions == 2)
+    {
+        out << y_axis.bins << y_axis.minimum << y_axis.maximum;
+    }
+
+    QByteArray body(merged.size() * sizeof(quint64), Qt::Uninitialized);
+    qToLittleEndian<quint64>(merged.constData(), merged.size(), body.data());
+
+    return file.write(header) == header.size() && file.write(body) == body.size();
+}
@@ -0,0 +1,83 @@
+#ifndef HISTOGRAM_HPP
+#define HISTOGRAM_HPP
+
+#include <QString>
+#include <QVector>
+
+#include <vector>
+
+
+struct HistogramAxis
+{
+    uint32_t bins;
+    double minimum;
+    double maximum;
+
+    // Bin 0 collects underflow and bin bins + 1 overflow.
+    uint32_t bin(double value) const
+    {
+        if (!(value >= minimum))
+        {
+            return 0;
+        }
+        if (value >= maximum)
+        {
+            return bins + 1;
+        }
+        return 1 + static_cast<uint32_t>((value - minimum) / (maximum - minimum) * bins);
+    }
+};
+
+// Histogram filled concurrently without locks: every thread owns a private,
+// cache line aligned copy of the bins and merge() folds them together once
+// filling is done. Counts include the under- and overflow bins of every axis.
+class Histogram
+{
+public:
+    Histogram(const HistogramAxis &x_axis, uint32_t threads);
+    Histogram(const HistogramAxis &x_axis, const HistogramAxis &y_axis, uint32_t threads);
+
+    void fill(uint32_t thread, double x)
+    {
+        localBins()[thread * stride + x_axis.bin(x)]++;
+    }
+
+    void fill(uint32_t thread, double x, double y)
+    {
+        localBins()[thread * stride + y_axis.bin(y) * (x_axis.bins + 2) + x_axis.bin(x)]++;
+    }
+
+    void merge();
+    const QVector<quint64> &counts() const;
+
+    // Little-endian dump: "DGSH", dimensions, every axis (bins, minimum,
+    // maximum) and the merged counts as uint64.
+    bool save(const QString &filename) const;
+
+private:
+    struct alignas(64) CacheLine
+    {
+        quint64 counts[8];
+    };
+
+    void allocate(uint32_t threads);
+
+    // Taken from storage on every use so copies and moves stay valid.
+    quint64 *localBins() { return storage.data()->counts; }
+    const quint64 *localBins() const { return storage.data()->counts; }
+
+private:
+    uint32_t dimensions;
+    HistogramAxis x_axis;
+    HistogramAxis y_axis;
+
+    uint32_t cells;
+    uint32_t stride;
+    uint32_t thread_count;
+
+    std::vector<CacheLine> storage;
+
+    QVector<quint64> merged;
+};
+
+#endif // HISTOGRAM_HPP
@@ -0,0 +1,267 @@
+#include "histogram_builder.hpp"
+#include "psd_engine.hpp"
+#include "simd_reduce.hpp"
+#include "file_validator.hpp"
+#include "packet_decoders.hpp"
+
+#include <QDir>
+#include <QFile>
+#include <QDataStream>
+#include <QDebug>
+
+#include <atomic>
+#include <limits>
+#include <thread>
+
+
+struct HistogramBuilder::FileScan
+{
+    QString filename;
+    bool valid;
+
+    QVector<device::DevicePSDSettings> settings;
+    framing::PacketIndex index;
+
+    std::shared_ptr<QFile> file;
+    const uchar *data;
+    std::shared_ptr<PSDEngine> engine;
+};
+
+HistogramBuilder::HistogramBuilder(const Configuration &configuration)
+    : configuration(configuration),
+      threads(configuration.threads ? configuration.threads : std::max(1u, std::thread::hardware_concurrency())),
+      channel_index(std::numeric_limits<uint16_t>::max() + 1, -1),
+      processed_packets(0)
+{
+}
+
+HistogramBuilder::~HistogramBuilder()
+{
+}
+
+bool HistogramBuilder::build(const QStringList &filenames)
+{
+    QVector<FileScan> files(filenames.size());
+    for (qsizetype index = 0; index < filenames.size(); ++index)
+    {
+        files[index].filename = filenames.at(index);
+        files[index].valid = false;
+        files[index].data = nullptr;
+    }
+
+    bool result = scanFiles(files);
+
+    for (const auto &scan : files)
+    {
+        for (const auto &settings : scan.settings)
+        {
+            channelHistograms(settings.channelId);
+        }
+    }
+
+    fillChunks(files);
+
+    for (auto &scan : files)
+    {
+        if (scan.data)
+        {
+            scan.file->unmap(const_cast<uchar *>(scan.data));
+        }
+    }
+
+    for (auto &channel : channel_histograms)
+    {
+        channel->height.merge();
+        channel->integral.merge();
+        channel->psd.merge();
+        channel->integral_psd.merge();
+    }
+
+    return result;
+}
+
+bool HistogramBuilder::save(const QString &directory) const
+{
+    if (!QDir().mkpath(directory))
+    {
+        qWarning() << "Failed to create histogram directory:" << directory;
+        return false;
+    }
+
+    QDir output(directory);
+    bool result = true;
+
+    for (const auto &channel : channel_histograms)
+    {
+        auto prefix = QString::fromLatin1("channel_%1_").arg(channel->channelId);
+        result &= channel->height.save(output.filePath(prefix + "height.hist"));
+        result &= channel->integral.save(output.filePath(prefix + "integral.hist"));
+        result &= channel->psd.save(output.filePath(prefix + "psd.hist"));
+        result &= channel->integral_psd.save(output.filePath(prefix + "integral_psd.hist"));
+    }
+
+    return result;
+}
+
+quint64 HistogramBuilder::processedPackets() const
+{
+    return processed_packets;
+}
+
+const QVector<std::shared_ptr<HistogramBuilder::ChannelHistograms>> &HistogramBuilder::channels() const
+{
+    return channel_histograms;
+}
+
+bool HistogramBuilder::scanFiles(QVector<FileScan> &files)
+{
+    // Validation walks each file sequentially, so files are validated side by
+    // side and the packet offsets are kept for the chunked fill.
+    std::atomic<qsizetype> next_file{0};
+    std::vector<std::thread> workers;
+
+    for (uint32_t thread = 0; thread < std::min<qsizetype>(threads, files.size()); ++thread)
+    {
+        workers.emplace_back([&files, &next_file]() {
+            for (qsizetype index = next_file++; index < files.size(); index = next_file++)
+            {
+                auto &scan = files[index];
+
+                FileValidator validator(scan.filename);
+                validator.setRecordPacketOffsets(true);
+                if (validator.validateFile() != FileValidator::ValidationError::None)
+                {
+                    qWarning() << "Skipping invalid file:" << scan.filename;
+                    continue;
+                }
+                scan.index = validator.packetIndex();
+
+                scan.file = std::make_shared<QFile>(scan.filename);
+                if (!scan.file->open(QIODevice::ReadOnly) || !(scan.data = scan.file->map(0, scan.file->size())))
+                {
+                    qWarning() << "Failed to map file:" << scan.filename;
+                    continue;
+                }
+
+                QDataStream in(QByteArray::fromRawData(reinterpret_cast<const char *>(scan.data) + framing::signature_size + framing::settings_count_size,
+                                                       validator.settingsNumber() * framing::settings_size));
+                scan.settings.resize(validator.settingsNumber());
+                for (auto &settings : scan.settings)
+                {
+                    in >> settings;
+                }
+
+                scan.engine = std::make_shared<PSDEngine>(scan.settings);
+                scan.valid = true;
+            }
+        });
+    }
+
+    for (auto &worker : workers)
+    {
+        worker.join();
+    }
+
+    bool result = true;
+    for (const auto &scan : files)
+    {
+        result &= scan.valid;
+    }
+    return result;
+}
+
+void HistogramBuilder::fillChunks(const QVector<FileScan> &files)
+{
+    struct Chunk
+    {
+        const FileScan *scan;
+        qsizetype begin;
+        qsizetype end;
+    };
+
+    QVector<Chunk> chunks;
+    for (const auto &scan : files)
+    {
+        if (!scan.valid)
+        {
+            continue;
+        }
+
+        for (qsizetype begin = 0; begin < scan.index.packet_count; begin += packets_per_chunk)
+        {
+            chunks.append({ &scan, begin, std::min<qsizetype>(scan.index.packet_count, begin + packets_per_chunk) });
+        }
+    }
+
+    std::atomic<qsizetype> next_chunk{0};
+    std::atomic<quint64> filled_packets{0};
+    std::vector<std::thread> workers;
+
+    for (uint32_t thread = 0; thread < threads; ++thread)
+    {
+        workers.emplace_back([this, thread, &chunks, &next_chunk, &filled_packets]() {
+            device::WaveformPacket waveform;
+            quint64 filled = 0;
+
+            for (qsizetype index = next_chunk++; index < chunks.size(); index = next_chunk++)
+            {
+                const auto &chunk = chunks.at(index);
+                framing::PacketDecoder decoder = framing::decoderFor(chunk.scan->index);
+
+                for (qsizetype packet = chunk.begin; packet < chunk.end; ++packet)
+                {
+                    decoder(chunk.scan->data + chunk.scan->index.offset(packet), waveform);
+
+                    int32_t channel = channel_index.at(waveform.chanelId);
+                    if (channel < 0 || waveform.values.isEmpty())
+                    {
+                        continue;
+                    }
+                    auto &histograms = *channel_histograms.at(channel);
+
+                    uint16_t minimum;
+                    uint16_t maximum;
+                    simd::minMaxU16(waveform.values.constData(), waveform.values.size(), minimum, maximum);
+
+                    auto psd = chunk.scan->engine->process(waveform);
+
+                    histograms.height.fill(thread, static_cast<double>(maximum) - waveform.baseline);
+                    if (psd.valid)
+                    {
+                        histograms.integral.fill(thread, psd.longIntegral);
+                        histograms.psd.fill(thread, psd.psd);
+                        histograms.integral_psd.fill(thread, psd.longIntegral, psd.psd);
+                    }
+                    ++filled;
+                }
+            }
+
+            filled_packets += filled;
+        });
+    }
+
+    for (auto &worker : workers)
+    {
+        worker.join();
+    }
+
+    // Packets of unknown channels or without samples are skipped above.
+    processed_packets += filled_packets;
+}
+
+HistogramBuilder::ChannelHistograms *HistogramBuilder::channelHistograms(uint16_t channel_id)
+{
+    if (channel_index.at(channel_id) < 0)
+    {
+        channel_index[channel_id] = channel_histograms.size();
+        channel_histograms.append(std::make_shared<ChannelHistograms>(ChannelHistograms{
+            channel_id,
+            Histogram(configuration.height, threads),
+            Histogram(configuration.integral, threads),
+            Histogram(configuration.psd, threads),
+            Histogram(configuration.integral_2d, configuration.psd_2d, threads),
+        }));
+    }
+
+    return channel_histograms.at(channel_index.at(channel_id)).get();
+}
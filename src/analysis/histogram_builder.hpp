@@ -0,0 +1,70 @@
+#ifndef HISTOGRAM_BUILDER_HPP
+#define HISTOGRAM_BUILDER_HPP
+
+#include "histogram.hpp"
+#include "header_structure.hpp"
+
+#include <QString>
+#include <QStringList>
+#include <QVector>
+
+#include <memory>
+
+
+// Fills per-channel pulse height, long gate integral, PSD and integral vs PSD
+// histograms from any number of .dgs files. Files are validated and then cut
+// into packet chunks that all worker threads pull from a shared atomic
+// cursor, so one large file and many small ones both keep every core busy.
+class HistogramBuilder
+{
+public:
+    struct Configuration
+    {
+        HistogramAxis height;
+        HistogramAxis integral;
+        HistogramAxis psd;
+        HistogramAxis integral_2d; // coarser axes keep the per-thread 2D copies small
+        HistogramAxis psd_2d;
+        uint32_t threads;          // 0 - one per hardware thread
+    };
+
+    struct ChannelHistograms
+    {
+        uint16_t channelId;
+
+        Histogram height;
+        Histogram integral;
+        Histogram psd;
+        Histogram integral_psd;
+    };
+
+    static constexpr uint32_t packets_per_chunk = 16384;
+
+    explicit HistogramBuilder(const Configuration &configuration);
+    ~HistogramBuilder();
+
+    bool build(const QStringList &filenames);
+    bool save(const QString &directory) const;
+
+    quint64 processedPackets() const;
+    const QVector<std::shared_ptr<ChannelHistograms>> &channels() const;
+
+private:
+    struct FileScan;
+
+    bool scanFiles(QVector<FileScan> &files);
+    void fillChunks(const QVector<FileScan> &files);
+
+    ChannelHistograms *channelHistograms(uint16_t channel_id);
+
+private:
+    Configuration configuration;
+    uint32_t threads;
+
+    QVector<std::shared_ptr<ChannelHistograms>> channel_histograms;
+    QVector<int32_t> channel_index; // chanelId -> index into channel_histograms, -1 if unknown
+
+    quint64 processed_packets;
+};
+
+#endif // HISTOGRAM_BUILDER_HPP
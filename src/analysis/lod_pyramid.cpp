@@ -0,0 +1,622 @@
+#include "lod_pyramid.hpp"
+#include "simd_reduce.hpp"
+#include "file_validator.hpp"
+#include "trace_events.hpp"
+#include "validation_cache.hpp"
+
+#include <QDataStream>
+#include <QDebug>
+
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+
+namespace
+{
+const auto pyramid_magic = QByteArray{ "DGSL" };
+constexpr quint32 pyramid_version = 2;
+constexpr qint64 bin_size = 24; // minimum, maximum, packets, count, sum
+constexpr qint64 identity_size = 8 + 8 + 8 + 16; // device, inode, modification time, edge hash
+constexpr qint64 header_size = 4 + 4 + 4 + 8 + identity_size + 4 + 4 + 8 * LodPyramid::levels;
+constexpr qint64 entry_size = 2 + 8 + 16 * LodPyramid::levels + 8;
+constexpr size_t spill_batch = 4096;
+
+// Level 0 result of one packet, spilled in file order during the scan.
+struct SpillRecord
+{
+    qint64 offset;
+    LodBin bin;
+    uint16_t channel;
+};
+
+struct ChannelBuild
+{
+    uint16_t channel = 0;
+    quint64 packets = 0;
+    std::array<qint64, LodPyramid::levels> offset{};
+    std::array<quint64, LodPyramid::levels> bins{};
+    std::array<quint64, LodPyramid::levels> written{};
+    std::array<LodBin, LodPyramid::levels> pending;
+    qint64 packet_offsets = 0;
+};
+
+// Little-endian writes into the mapped sidecar.
+class RecordWriter
+{
+public:
+    explicit RecordWriter(uchar *data) : data(data), position(0) {}
+
+    template <typename T>
+    void put(T value)
+    {
+        qToLittleEndian<T>(value, data + position);
+        position += sizeof(T);
+    }
+
+    void put(const QByteArray &bytes)
+    {
+        std::memcpy(data + position, bytes.constData(), bytes.size());
+        position += bytes.size();
+    }
+
+private:
+    uchar *data;
+    qint64 position;
+};
+
+void writeBin(uchar *record, const LodBin &bin)
+{
+    qToLittleEndian<quint16>(bin.minimum, record);
+    qToLittleEndian<quint16>(bin.maximum, record + 2);
+    qToLittleEndian<quint32>(bin.packets, record + 4);
+    qToLittleEndian<quint64>(bin.count, record + 8);
+    qToLittleEndian<quint64>(bin.sum, record + 16);
+}
+
+bool writeRecords(int descriptor, const std::vector<SpillRecord> &records)
+{
+    const char *bytes = reinterpret_cast<const char *>(records.data());
+    size_t remaining = records.size() * sizeof(SpillRecord);
+
+    while (remaining > 0)
+    {
+        ssize_t written = ::write(descriptor, bytes, remaining);
+        if (written < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if (written <= 0)
+        {
+            return false;
+        }
+        bytes += written;
+        remaining -= written;
+    }
+
+    return true;
+}
+
+// Refills records with up to spill_batch records; empty at the end.
+bool readRecords(int descriptor, std::vector<SpillRecord> &records)
+{
+    records.resize(spill_batch);
+    char *bytes = reinterpret_cast<char *>(records.data());
+    size_t capacity = spill_batch * sizeof(SpillRecord);
+    size_t filled = 0;
+
+    while (filled < capacity)
+    {
+        ssize_t received = ::read(descriptor, bytes + filled, capacity - filled);
+        if (received < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if (received < 0)
+        {
+            return false;
+        }
+        if (received == 0)
+        {
+            break;
+        }
+        filled += received;
+    }
+
+    records.resize(filled / sizeof(SpillRecord));
+    return filled % sizeof(SpillRecord) == 0;
+}
+}
+
+LodPyramid::LodPyramid()
+    : sidecar_data(nullptr), source_data(nullptr), source_size(0), format(framing::PacketFormat::Plain)
+{
+}
+
+LodPyramid::~LodPyramid()
+{
+    close();
+}
+
+QString LodPyramid::pyramidFilename(const QString &filename)
+{
+    return default_pyramid.arg(filename);
+}
+
+bool LodPyramid::build(const QString &filename)
+{
+    TRACE_SCOPE("LodPyramid::build");
+
+    FileValidator validator(filename);
+    if (validator.validateHeader() != FileValidator::ValidationError::None)
+    {
+        qWarning() << "Cannot build pyramid for invalid file:" << filename;
+        return false;
+    }
+    framing::PacketFormat packet_format = validator.packetFormat();
+    validator.close();
+
+    FileIdentity identity;
+    if (!validation_cache::identify(filename, identity))
+    {
+        return false;
+    }
+
+    QFile file(filename);
+    if (!file.open(QIODevice::ReadOnly))
+    {
+        qWarning() << "Failed to open file for reading:" << file.errorString();
+        return false;
+    }
+
+    qint64 file_size = file.size();
+    const uchar *data = file.map(0, file_size);
+    if (!data)
+    {
+        qWarning() << "Failed to map file for pyramid:" << file.errorString();
+        return false;
+    }
+
+    // The scan spills every packet's level 0 bin to an unlinked file, so memory
+    // stays bounded by the number of channels however long the file is.
+    const QString output_name = pyramidFilename(filename);
+    const QByteArray spill_path = QFile::encodeName(output_name + ".spill");
+    int spill = ::open(spill_path.constData(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+    if (spill < 0)
+    {
+        qWarning() << "Failed to create pyramid spill file:" << std::strerror(errno);
+        file.unmap(const_cast<uchar *>(data));
+        return false;
+    }
+    ::unlink(spill_path.constData());
+
+    std::vector<int32_t> channel_slot(std::numeric_limits<uint16_t>::max() + 1, -1);
+    QVector<ChannelBuild> builds;
+    QVector<uint16_t> samples;
+    std::vector<SpillRecord> records;
+    records.reserve(spill_batch);
+    bool result = true;
+
+    for (qint64 position = framing::bodyOffset(validator.settingsNumber()), packet_size = 0; result && position < file_size; position += packet_size)
+    {
+        packet_size = framing::frameAt(data + position, file_size - position, packet_format);
+        if (packet_size == 0)
+        {
+            qWarning() << "Malformed waveform packet at offset" << position << "in" << filename;
+            result = false;
+            break;
+        }
+
+        framing::PacketView view{ data + position, packet_size, packet_format };
+        quint32 number_of_values = view.numberOfValues();
+
+        LodBin bin;
+        bin.packets = 1;
+        bin.count = number_of_values;
+        if (number_of_values > 0)
+        {
+            samples.resize(number_of_values);
+            qFromBigEndian<quint16>(view.samples(), number_of_values, samples.data());
+            simd::minMaxU16(samples.constData(), number_of_values, bin.minimum, bin.maximum);
+            bin.sum = simd::sumU16(samples.constData(), number_of_values);
+        }
+
+        int32_t &slot = channel_slot[view.chanelId()];
+        if (slot < 0)
+        {
+            slot = builds.size();
+            builds.append(ChannelBuild());
+            builds.last().channel = view.chanelId();
+        }
+        ++builds[slot].packets;
+
+        records.push_back({ position, bin, view.chanelId() });
+        if (records.size() == spill_batch)
+        {
+            result = writeRecords(spill, records);
+            records.clear();
+        }
+    }
+
+    file.unmap(const_cast<uchar *>(data));
+    file.close();
+
+    if (result && !(result = writeRecords(spill, records)))
+    {
+        qWarning() << "Failed to spill pyramid bins:" << std::strerror(errno);
+    }
+    if (!result)
+    {
+        ::close(spill);
+        return false;
+    }
+
+    // With every channel's packet count known the layout is fixed up front.
+    std::sort(builds.begin(), builds.end(), [](const ChannelBuild &left, const ChannelBuild &right) {
+        return left.channel < right.channel;
+    });
+
+    qint64 output_size = header_size + builds.size() * entry_size;
+    for (qsizetype slot = 0; slot < builds.size(); ++slot)
+    {
+        auto &build = builds[slot];
+        channel_slot[build.channel] = slot;
+
+        for (int level = 0; level < levels; ++level)
+        {
+            build.offset[level] = output_size;
+            build.bins[level] = (build.packets + level_packets[level] - 1) / level_packets[level];
+            output_size += build.bins[level] * bin_size;
+        }
+        build.packet_offsets = output_size;
+        output_size += build.packets * 8;
+    }
+
+    // Built next to the target and renamed on success, like merged files.
+    const QByteArray partial_path = QFile::encodeName(output_name + ".part");
+    int descriptor = ::open(partial_path.constData(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    void *mapping = MAP_FAILED;
+    if (descriptor >= 0 && ::ftruncate(descriptor, output_size) == 0)
+    {
+        mapping = ::mmap(nullptr, output_size, PROT_READ | PROT_WRITE, MAP_SHARED, descriptor, 0);
+    }
+    if (mapping == MAP_FAILED)
+    {
+        qWarning() << "Failed to create pyramid" << output_name << ":" << std::strerror(errno);
+        if (descriptor >= 0)
+        {
+            ::close(descriptor);
+            ::unlink(partial_path.constData());
+        }
+        ::close(spill);
+        return false;
+    }
+    auto output = static_cast<uchar *>(mapping);
+
+    RecordWriter header(output);
+    header.put(pyramid_magic);
+    header.put<quint32>(pyramid_version);
+    header.put<quint32>(static_cast<quint32>(packet_format));
+    header.put<quint64>(file_size);
+    header.put<quint64>(identity.device);
+    header.put<quint64>(identity.inode);
+    header.put<qint64>(identity.modified_ns);
+    header.put(identity.edge_hash);
+    header.put<quint32>(builds.size());
+    header.put<quint32>(levels);
+    for (auto packets : level_packets)
+    {
+        header.put<quint64>(packets);
+    }
+
+    for (const auto &build : builds)
+    {
+        header.put<quint16>(build.channel);
+        header.put<quint64>(build.packets);
+        for (int level = 0; level < levels; ++level)
+        {
+            header.put<qint64>(build.offset[level]);
+            header.put<quint64>(build.bins[level]);
+        }
+        header.put<qint64>(build.packet_offsets);
+    }
+
+    // Second pass over the spill only: scatter level 0 into place and fold the
+    // coarse levels, of which just the pending bin of each channel is held.
+    result = ::lseek(spill, 0, SEEK_SET) == 0;
+    while (result && (result = readRecords(spill, records)) && !records.empty())
+    {
+        for (const auto &record : records)
+        {
+            auto &build = builds[channel_slot[record.channel]];
+            quint64 packet = build.written[0]++;
+
+            writeBin(output + build.offset[0] + packet * bin_size, record.bin);
+            qToLittleEndian<qint64>(record.offset, output + build.packet_offsets + packet * 8);
+
+            for (int level = 1; level < levels; ++level)
+            {
+                build.pending[level].merge(record.bin);
+                if (build.pending[level].packets == level_packets[level])
+                {
+                    writeBin(output + build.offset[level] + build.written[level]++ * bin_size, build.pending[level]);
+                    build.pending[level] = LodBin();
+                }
+            }
+        }
+    }
+    ::close(spill);
+
+    for (auto &build : builds)
+    {
+        for (int level = 1; level < levels; ++level)
+        {
+            if (build.pending[level].packets > 0)
+            {
+                writeBin(output + build.offset[level] + build.written[level]++ * bin_size, build.pending[level]);
+            }
+        }
+    }
+
+    result = (::munmap(mapping, output_size) == 0) && result;
+    result = (::close(descriptor) == 0) && result;
+
+    if (!result || std::rename(partial_path.constData(), QFile::encodeName(output_name).constData()) != 0)
+    {
+        qWarning() << "Failed to write pyramid:" << output_name;
+        ::unlink(partial_path.constData());
+        return false;
+    }
+
+    return true;
+}
+
+bool LodPyramid::open(const QString &filename)
+{
+    close();
+
+    sidecar.setFileName(pyramidFilename(filename));
+    if (!sidecar.open(QIODevice::ReadOnly))
+    {
+        qWarning() << "Failed to open pyramid:" << sidecar.errorString();
+        return false;
+    }
+
+    qint64 sidecar_size = sidecar.size();
+    sidecar_data = sidecar.map(0, sidecar_size);
+    if (!sidecar_data)
+    {
+        qWarning() << "Failed to map pyramid:" << sidecar.errorString();
+        sidecar.close();
+        return false;
+    }
+
+    QDataStream in(QByteArray::fromRawData(reinterpret_cast<const char *>(sidecar_data), sidecar_size));
+    in.setByteOrder(QDataStream::LittleEndian);
+
+    QByteArray magic(pyramid_magic.size(), Qt::Uninitialized);
+    quint32 version = 0;
+    quint32 packet_format = 0;
+    quint64 data_size = 0;
+    FileIdentity stored;
+    quint32 channel_count = 0;
+    quint32 level_count = 0;
+
+    stored.edge_hash.resize(16);
+    in.readRawData(magic.data(), magic.size());
+    in >> version >> packet_format >> data_size >> stored.device >> stored.inode >> stored.modified_ns;
+    in.readRawData(stored.edge_hash.data(), stored.edge_hash.size());
+    in >> channel_count >> level_count;
+    stored.size = static_cast<qint64>(data_size);
+
+    bool valid = in.status() == QDataStream::Ok && magic == pyramid_magic && version == pyramid_version && level_count == levels;
+    for (int level = 0; valid && level < levels; ++level)
+    {
+        quint64 packets = 0;
+        in >> packets;
+        valid = packets == level_packets[level];
+    }
+
+    // Keyed like the validation cache, so a rewritten file of the same size
+    // is not read through offsets that belonged to the old one.
+    FileIdentity identity;
+    if (!valid || !validation_cache::identify(filename, identity) || !(identity == stored))
+    {
+        qWarning() << "Pyramid of" << filename << "is stale or unsupported, rebuild it.";
+        close();
+        return false;
+    }
+
+    if (channel_count > (sidecar_size - header_size) / entry_size)
+    {
+        qWarning() << "Truncated pyramid:" << sidecar.fileName();
+        close();
+        return false;
+    }
+
+    channel_levels.resize(channel_count);
+    for (auto &entry : channel_levels)
+    {
+        in >> entry.channel >> entry.packets;
+        for (int level = 0; level < levels; ++level)
+        {
+            in >> entry.offset[level] >> entry.bins[level];
+        }
+        in >> entry.packet_offsets;
+
+        // Everything is read in place later on, so it must all be mapped and
+        // every level must cover all packets of the channel.
+        auto fits = [sidecar_size](qint64 offset, quint64 count, qint64 size) {
+            return offset >= 0 && offset <= sidecar_size && count <= static_cast<quint64>((sidecar_size - offset) / size);
+        };
+
+        valid &= fits(entry.packet_offsets, entry.packets, 8);
+        for (int level = 0; level < levels; ++level)
+        {
+            valid &= entry.bins[level] == (entry.packets + level_packets[level] - 1) / level_packets[level] &&
+                     fits(entry.offset[level], entry.bins[level], bin_size);
+        }
+    }
+
+    if (in.status() != QDataStream::Ok || !valid)
+    {
+        qWarning() << "Truncated pyramid:" << sidecar.fileName();
+        close();
+        return false;
+    }
+
+    source_name = filename;
+    format = static_cast<framing::PacketFormat>(packet_format);
+    return true;
+}
+
+void LodPyramid::close()
+{
+    if (sidecar_data)
+    {
+        sidecar.unmap(const_cast<uchar *>(sidecar_data));
+        sidecar_data = nullptr;
+    }
+    sidecar.close();
+
+    if (source_data)
+    {
+        source.unmap(const_cast<uchar *>(source_data));
+        source_data = nullptr;
+    }
+    source_size = 0;
+    source.close();
+
+    channel_levels.clear();
+}
+
+QVector<uint16_t> LodPyramid::channels() const
+{
+    QVector<uint16_t> result;
+    for (const auto &entry : channel_levels)
+    {
+        result.append(entry.channel);
+    }
+    return result;
+}
+
+quint64 LodPyramid::packetCount(uint16_t channel) const
+{
+    const auto *entry = find(channel);
+    return entry ? entry->packets : 0;
+}
+
+bool LodPyramid::query(uint16_t channel, quint64 first, quint64 last, uint32_t bins, QVector<LodBin> &result) const
+{
+    TRACE_SCOPE("LodPyramid::query");
+
+    result.clear();
+
+    const auto *entry = find(channel);
+    if (!entry)
+    {
+        qWarning() << "No pyramid for channel" << channel;
+        return false;
+    }
+
+    last = std::min(last, entry->packets);
+    if (first >= last)
+    {
+        return true;
+    }
+    bins = std::max(bins, 1u);
+
+    // The coarsest level that still has at least one bin per output bin keeps
+    // the number of bins touched below bins * 1024.
+    int level = 0;
+    for (int candidate = levels - 1; candidate > 0; --candidate)
+    {
+        quint64 level_first = first / level_packets[candidate];
+        quint64 level_last = (last + level_packets[candidate] - 1) / level_packets[candidate];
+        if (level_last - level_first >= bins)
+        {
+            level = candidate;
+            break;
+        }
+    }
+
+    quint64 level_first = first / level_packets[level];
+    quint64 level_last = (last + level_packets[level] - 1) / level_packets[level];
+    quint64 level_bins = level_last - level_first;
+    quint64 output_bins = std::min<quint64>(level_bins, bins);
+
+    result.resize(output_bins);
+    for (quint64 index = 0; index < level_bins; ++index)
+    {
+        result[index * output_bins / level_bins].merge(binAt(*entry, level, level_first + index));
+    }
+
+    return true;
+}
+
+bool LodPyramid::readPackets(uint16_t channel, quint64 first, quint64 last, QVector<device::WaveformPacket> &waveforms)
+{
+    const auto *entry = find(channel);
+    if (!entry)
+    {
+        qWarning() << "No pyramid for channel" << channel;
+        return false;
+    }
+
+    if (!source_data)
+    {
+        source.setFileName(source_name);
+        source_size = source.open(QIODevice::ReadOnly) ? source.size() : 0;
+        if (source_size == 0 || !(source_data = source.map(0, source_size)))
+        {
+            qWarning() << "Failed to map" << source_name << ":" << source.errorString();
+            return false;
+        }
+    }
+
+    last = std::min(last, entry->packets);
+    framing::PacketDecoder decoder = (format == framing::PacketFormat::Timestamped) ? &framing::decodeTimestampedPacket
+                                                                                     : &framing::decodePacket;
+
+    for (quint64 packet = first; packet < last; ++packet)
+    {
+        // The source may have changed since open(); never decode outside it.
+        qint64 offset = qFromLittleEndian<qint64>(sidecar_data + entry->packet_offsets + packet * 8);
+        if (offset < 0 || offset >= source_size || framing::frameAt(source_data + offset, source_size - offset, format) == 0)
+        {
+            qWarning() << "Pyramid offset" << offset << "does not frame a packet of" << source_name;
+            return false;
+        }
+
+        decoder(source_data + offset, waveforms.emplace_back());
+    }
+
+    return true;
+}
+
+const LodPyramid::ChannelLevels *LodPyramid::find(uint16_t channel) const
+{
+    auto entry = std::lower_bound(channel_levels.cbegin(), channel_levels.cend(), channel, [](const ChannelLevels &levels, uint16_t value) {
+        return levels.channel < value;
+    });
+
+    return (entry != channel_levels.cend() && entry->channel == channel) ? &*entry : nullptr;
+}
+
+LodBin LodPyramid::binAt(const ChannelLevels &levels, int level, quint64 index) const
+{
+    const uchar *record = sidecar_data + levels.offset[level] + index * bin_size;
+
+    LodBin bin;
+    bin.minimum = qFromLittleEndian<quint16>(record);
+    bin.maximum = qFromLittleEndian<quint16>(record + 2);
+    bin.packets = qFromLittleEndian<quint32>(record + 4);
+    bin.count = qFromLittleEndian<quint64>(record + 8);
+    bin.sum = qFromLittleEndian<quint64>(record + 16);
+    return bin;
+}
@@ -0,0 +1,95 @@
+#ifndef LOD_PYRAMID_HPP
+#define LOD_PYRAMID_HPP
+
+#include "packet_structure.hpp"
+#include "packet_decoders.hpp"
+
+#include <QString>
+#include <QVector>
+#include <QFile>
+
+#include <algorithm>
+#include <array>
+
+
+// Summary of the samples of a run of packets of one channel.
+struct LodBin
+{
+    uint16_t minimum = 0;
+    uint16_t maximum = 0;
+    uint32_t packets = 0;
+    quint64 count = 0; // samples
+    quint64 sum = 0;
+
+    double mean() const { return count > 0 ? double(sum) / count : 0.; }
+
+    void merge(const LodBin &other)
+    {
+        if (other.count > 0)
+        {
+            minimum = count > 0 ? std::min(minimum, other.minimum) : other.minimum;
+            maximum = count > 0 ? std::max(maximum, other.maximum) : other.maximum;
+        }
+        packets += other.packets;
+        count += other.count;
+        sum += other.sum;
+    }
+};
+
+// Min/max/mean pyramid over the packets of every channel of a .dgs file, kept
+// next to it as a .dgsl sidecar. Levels summarise 1, 1024 and 1048576 packets
+// of a channel per bin; queries are answered from the mapped sidecar and only
+// fall back to the packets themselves once fewer packets than bins remain.
+class LodPyramid
+{
+public:
+    static constexpr int levels = 3;
+    static constexpr std::array<quint64, levels> level_packets = { 1, 1024, 1024 * 1024 };
+
+    LodPyramid();
+    ~LodPyramid();
+
+    static QString pyramidFilename(const QString &filename);
+
+    // One streaming pass over the packets of filename; the per-packet bins
+    // are spilled to disk, so memory only grows with the channel count.
+    static bool build(const QString &filename);
+
+    bool open(const QString &filename);
+    void close();
+
+    QVector<uint16_t> channels() const;
+    quint64 packetCount(uint16_t channel) const;
+
+    // Summarises packets [first, last) of channel into at most bins bins,
+    // widened to the boundaries of the level used. A result with one bin per
+    // packet means the view is at full zoom and readPackets() can take over.
+    bool query(uint16_t channel, quint64 first, quint64 last, uint32_t bins, QVector<LodBin> &result) const;
+    bool readPackets(uint16_t channel, quint64 first, quint64 last, QVector<device::WaveformPacket> &waveforms);
+
+private:
+    struct ChannelLevels
+    {
+        uint16_t channel;
+        quint64 packets;
+        std::array<qint64, levels> offset;
+        std::array<quint64, levels> bins;
+        qint64 packet_offsets;
+    };
+
+    const ChannelLevels *find(uint16_t channel) const;
+    LodBin binAt(const ChannelLevels &levels, int level, quint64 index) const;
+
+private:
+    QFile sidecar;
+    const uchar *sidecar_data;
+    QVector<ChannelLevels> channel_levels;
+
+    QString source_name;
+    QFile source;
+    const uchar *source_data;
+    qint64 source_size;
+    framing::PacketFormat format;
+};
+
+#endif // LOD_PYRAMID_HPP
@@ -0,0 +1,91 @@
+#include "psd_engine.hpp"
+#include "simd_reduce.hpp"
+
+#include <algorithm>
+#include <limits>
+
+
+PSDEngine::PSDEngine(const QVector<device::DevicePSDSettings> &settings)
+    : channel_gates(std::numeric_limits<uint16_t>::max() + 1, -1)
+{
+    gates.reserve(settings.size());
+
+    for (const auto &value : settings)
+    {
+        GateWindow window;
+        window.start = value.psdPreTriggerLength - std::min(value.psdPreGateLength, value.psdPreTriggerLength);
+        window.short_length = value.psdShortGateLength;
+        window.long_length = value.psdLongGateLength;
+
+        channel_gates[value.channelId] = gates.size();
+        gates.append(window);
+    }
+}
+
+PSDResult PSDEngine::process(const device::WaveformPacket &waveform) const
+{
+    PSDResult result{ waveform.chanelId, false, 0, 0, 0.f };
+
+    int32_t gate_index = channel_gates.at(waveform.chanelId);
+    if (gate_index < 0)
+    {
+        return result;
+    }
+
+    const auto &window = gates.at(gate_index);
+    const uint16_t *values = waveform.values.constData();
+    uint32_t length = waveform.values.size();
+
+    uint32_t start = std::min(window.start, length);
+    uint32_t short_end = start + std::min(window.short_length, length - start);
+    uint32_t long_end = start + std::min(window.long_length, length - start);
+
+    // Both gates share their start, so the longer one only sums its tail.
+    uint32_t common_end = std::min(short_end, long_end);
+    int64_t common = simd::sumU16(values + start, common_end - start);
+    int64_t short_sum = common + simd::sumU16(values + common_end, short_end - common_end);
+    int64_t long_sum = common + simd::sumU16(values + common_end, long_end - common_end);
+
+    result.valid = true;
+    result.shortIntegral = short_sum - static_cast<int64_t>(waveform.baseline) * (short_end - start);
+    result.longIntegral = long_sum - static_cast<int64_t>(waveform.baseline) * (long_end - start);
+    result.psd = (result.longIntegral != 0)
+                     ? static_cast<float>(result.longIntegral - result.shortIntegral) / result.longIntegral
+                     : 0.f;
+
+    return result;
+}
+
+void PSDEngine::process(const QVector<device::WaveformPacket> &waveforms, QVector<PSDResult> &results) const
+{
+    results.resize(waveforms.size());
+
+    PSDResult *output = results.data();
+    for (qsizetype index = 0; index < waveforms.size(); ++index)
+    {
+        output[index] = process(waveforms.at(index));
+    }
+}
+
+quint64 PSDEngine::processStream(FileReader &reader, uint32_t batch_size,
+                                 const std::function<void(const QVector<device::WaveformPacket> &, const QVector<PSDResult> &)> &consumer) const
+{
+    QVector<device::WaveformPacket> batch;
+    QVector<PSDResult> results;
+    quint64 processed = 0;
+
+    while (!reader.atEnd())
+    {
+        batch.clear();
+        if (!reader.readWaveforms(batch, batch_size))
+        {
+            break;
+        }
+
+        process(batch, results);
+        consumer(batch, results);
+        processed += batch.size();
+    }
+
+    return processed;
+}
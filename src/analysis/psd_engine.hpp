@@ -0,0 +1,52 @@
+#ifndef PSD_ENGINE_HPP
+#define PSD_ENGINE_HPP
+
+#include "header_structure.hpp"
+#include "packet_structure.hpp"
+#include "file_reader.hpp"
+
+#include <QVector>
+
+#include <functional>
+
+
+struct PSDResult
+{
+    uint16_t channelId;
+    bool valid; // false when the file has no DevicePSDSettings for the channel
+
+    int64_t shortIntegral;
+    int64_t longIntegral;
+    float psd;  // (long - short) / long
+};
+
+// Pulse shape discrimination over batches of packets. Gates are derived once
+// per channel from DevicePSDSettings: both open psdPreGateLength samples before
+// the trigger (psdPreTriggerLength) and last psdShortGateLength and
+// psdLongGateLength samples; integrals are baseline subtracted.
+class PSDEngine
+{
+public:
+    explicit PSDEngine(const QVector<device::DevicePSDSettings> &settings);
+
+    PSDResult process(const device::WaveformPacket &waveform) const;
+    void process(const QVector<device::WaveformPacket> &waveforms, QVector<PSDResult> &results) const;
+
+    // Reads the remaining packets of reader in batches and hands every batch
+    // with its results to consumer. Returns the number of processed packets.
+    quint64 processStream(FileReader &reader, uint32_t batch_size,
+                          const std::function<void(const QVector<device::WaveformPacket> &, const QVector<PSDResult> &)> &consumer) const;
+
+private:
+    struct GateWindow
+    {
+        uint32_t start;
+        uint32_t short_length;
+        uint32_t long_length;
+    };
+
+    QVector<GateWindow> gates;
+    QVector<int32_t> channel_gates; // chanelId -> index into gates, -1 if unknown
+};
+
+#endif // PSD_ENGINE_HPP
@@ -0,0 +1,132 @@
+#include "simd_reduce.hpp"
+
+#include <algorithm>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE4_1__)
+#include <smmintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+
+namespace simd
+{
+uint64_t sumU16(const uint16_t *values, size_t count)
+{
+    uint64_t sum = 0;
+    size_t index = 0;
+
+#if defined(__AVX2__)
+    const __m256i zero = _mm256_setzero_si256();
+
+    while (index + 16 <= count)
+    {
+        // 32 bit lanes cannot overflow within 32768 iterations of 65535 * 2.
+        size_t block_end = std::min(count - (count - index) % 16, index + 16 * 32768);
+        __m256i accumulator = _mm256_setzero_si256();
+
+        for (; index < block_end; index += 16)
+        {
+            __m256i block = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(values + index));
+            accumulator = _mm256_add_epi32(accumulator, _mm256_unpacklo_epi16(block, zero));
+            accumulator = _mm256_add_epi32(accumulator, _mm256_unpackhi_epi16(block, zero));
+        }
+
+        alignas(32) uint32_t lanes[8];
+        _mm256_store_si256(reinterpret_cast<__m256i *>(lanes), accumulator);
+        for (auto lane : lanes)
+        {
+            sum += lane;
+        }
+    }
+#elif defined(__SSE2__)
+    const __m128i zero = _mm_setzero_si128();
+
+    while (index + 8 <= count)
+    {
+        // 32 bit lanes cannot overflow within 32768 iterations of 65535 * 2.
+        size_t block_end = std::min(count - (count - index) % 8, index + 8 * 32768);
+        __m128i accumulator = _mm_setzero_si128();
+
+        for (; index < block_end; index += 8)
+        {
+            __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i *>(values + index));
+            accumulator = _mm_add_epi32(accumulator, _mm_unpacklo_epi16(block, zero));
+            accumulator = _mm_add_epi32(accumulator, _mm_unpackhi_epi16(block, zero));
+        }
+
+        alignas(16) uint32_t lanes[4];
+        _mm_store_si128(reinterpret_cast<__m128i *>(lanes), accumulator);
+        for (auto lane : lanes)
+        {
+            sum += lane;
+        }
+    }
+#endif
+
+    for (; index < count; ++index)
+    {
+        sum += values[index];
+    }
+
+    return sum;
+}
+
+void minMaxU16(const uint16_t *values, size_t count, uint16_t &minimum, uint16_t &maximum)
+{
+    minimum = values[0];
+    maximum = values[0];
+    size_t index = 0;
+
+#if defined(__AVX2__)
+    if (count >= 16)
+    {
+        __m256i block_min = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(values));
+        __m256i block_max = block_min;
+
+        for (index = 16; index + 16 <= count; index += 16)
+        {
+            __m256i block = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(values + index));
+            block_min = _mm256_min_epu16(block_min, block);
+            block_max = _mm256_max_epu16(block_max, block);
+        }
+
+        alignas(32) uint16_t lanes_min[16];
+        alignas(32) uint16_t lanes_max[16];
+        _mm256_store_si256(reinterpret_cast<__m256i *>(lanes_min), block_min);
+        _mm256_store_si256(reinterpret_cast<__m256i *>(lanes_max), block_max);
+        minimum = *std::min_element(lanes_min, lanes_min + 16);
+        maximum = *std::max_element(lanes_max, lanes_max + 16);
+    }
+#elif defined(__SSE4_1__)
+    if (count >= 8)
+    {
+        __m128i block_min = _mm_loadu_si128(reinterpret_cast<const __m128i *>(values));
+        __m128i block_max = block_min;
+
+        for (index = 8; index + 8 <= count; index += 8)
+        {
+            __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i *>(values + index));
+            block_min = _mm_min_epu16(block_min, block);
+            block_max = _mm_max_epu16(block_max, block);
+        }
+
+        alignas(16) uint16_t lanes_min[8];
+        alignas(16) uint16_t lanes_max[8];
+        _mm_store_si128(reinterpret_cast<__m128i *>(lanes_min), block_min);
+        _mm_store_si128(reinterpret_cast<__m128i *>(lanes_max), block_max);
+        minimum = *std::min_element(lanes_min, lanes_min + 8);
+        maximum = *std::max_element(lanes_max, lanes_max + 8);
+    }
+#endif
+
+    for (; index < count; ++index)
+    {
+        minimum = std::min(minimum, values[index]);
+        maximum = std::max(maximum, values[index]);
+    }
+}
+
+} // namespace simd
@@ -0,0 +1,20 @@
+#ifndef SIMD_REDUCE_HPP
+#define SIMD_REDUCE_HPP
+
+#include <QtGlobal>
+
+#include <cstddef>
+#include <cstdint>
+
+
+namespace simd
+{
+// Sum of count unsigned 16 bit samples.
+uint64_t sumU16(const uint16_t *values, size_t count);
+
+// Minimum and maximum of count unsigned 16 bit samples, count must be > 0.
+void minMaxU16(const uint16_t *values, size_t count, uint16_t &minimum, uint16_t &maximum);
+
+} // namespace simd
+
+#endif // SIMD_REDUCE_HPP
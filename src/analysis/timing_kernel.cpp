@@ -0,0 +1,190 @@
+#include "timing_kernel.hpp"
+
+#include <algorithm>
+#include <limits>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+
+TimingKernel::TimingKernel(const QVector<device::DevicePSDSettings> &settings)
+    : channel_timings(std::numeric_limits<uint16_t>::max() + 1, -1)
+{
+    channels.reserve(settings.size());
+
+    for (const auto &value : settings)
+    {
+        ChannelTiming timing;
+        timing.filter = value.filterType;
+
+        if (value.filterType == device::TTFilterType::CFD)
+        {
+            timing.delay = value.cfdSettings.cfdDelay;
+            timing.fraction = static_cast<float>(value.cfdSettings.cfdFraction);
+            timing.threshold = value.cfdSettings.cfdThreshold;
+        }
+        else
+        {
+            timing.delay = 0;
+            timing.fraction = 0.f;
+            timing.threshold = value.ledSettings.ledThresholdUp;
+        }
+
+        channel_timings[value.channelId] = channels.size();
+        channels.append(timing);
+    }
+}
+
+TimingResult TimingKernel::process(const device::WaveformPacket &waveform)
+{
+    TimingResult result{ waveform.chanelId, false, 0.f };
+
+    int32_t timing_index = channel_timings.at(waveform.chanelId);
+    if (timing_index < 0)
+    {
+        return result;
+    }
+
+    const auto &timing = channels.at(timing_index);
+    int64_t armed = findArming(waveform, timing.threshold);
+    if (armed < 0)
+    {
+        return result;
+    }
+
+    float time = (timing.filter == device::TTFilterType::CFD) ? cfdTime(waveform, timing, armed)
+                                                               : ledTime(waveform, timing, armed);
+
+    result.valid = time >= 0.f;
+    result.time = time;
+    return result;
+}
+
+void TimingKernel::process(const QVector<device::WaveformPacket> &waveforms, QVector<TimingResult> &results)
+{
+    results.resize(waveforms.size());
+
+    TimingResult *output = results.data();
+    for (qsizetype index = 0; index < waveforms.size(); ++index)
+    {
+        output[index] = process(waveforms.at(index));
+    }
+}
+
+float TimingKernel::cfdTime(const device::WaveformPacket &waveform, const ChannelTiming &timing, uint32_t armed)
+{
+    const uint16_t *values = waveform.values.constData();
+    uint32_t length = waveform.values.size();
+    uint32_t first = std::max(armed, timing.delay);
+
+    if (first + 1 >= length)
+    {
+        return -1.f;
+    }
+
+    if (scratch.size() < length)
+    {
+        scratch.resize(length);
+    }
+
+    // cfd[i] = fraction * (x[i] - b) - (x[i - delay] - b), computed for the
+    // whole tail after arming so the crossing search below is branch-light.
+    const float fraction = timing.fraction;
+    const float offset = (1.f - fraction) * waveform.baseline;
+    float *cfd = scratch.data();
+    uint32_t index = first;
+
+#if defined(__SSE2__)
+    const __m128i zero = _mm_setzero_si128();
+    const __m128 fraction_block = _mm_set1_ps(fraction);
+    const __m128 offset_block = _mm_set1_ps(offset);
+
+    for (; index + 8 <= length; index += 8)
+    {
+        __m128i current = _mm_loadu_si128(reinterpret_cast<const __m128i *>(values + index));
+        __m128i delayed = _mm_loadu_si128(reinterpret_cast<const __m128i *>(values + index - timing.delay));
+
+        __m128 current_low = _mm_cvtepi32_ps(_mm_unpacklo_epi16(current, zero));
+        __m128 current_high = _mm_cvtepi32_ps(_mm_unpackhi_epi16(current, zero));
+        __m128 delayed_low = _mm_cvtepi32_ps(_mm_unpacklo_epi16(delayed, zero));
+        __m128 delayed_high = _mm_cvtepi32_ps(_mm_unpackhi_epi16(delayed, zero));
+
+        _mm_storeu_ps(cfd + index, _mm_add_ps(_mm_sub_ps(_mm_mul_ps(fraction_block, current_low), delayed_low), offset_block));
+        _mm_storeu_ps(cfd + index + 4, _mm_add_ps(_mm_sub_ps(_mm_mul_ps(fraction_block, current_high), delayed_high), offset_block));
+    }
+#endif
+
+    for (; index < length; ++index)
+    {
+        cfd[index] = fraction * values[index] - values[index - timing.delay] + offset;
+    }
+
+    for (index = first + 1; index < length; ++index)
+    {
+        if (cfd[index - 1] > 0.f && cfd[index] <= 0.f)
+        {
+            return (index - 1) + cfd[index - 1] / (cfd[index - 1] - cfd[index]);
+        }
+    }
+
+    return -1.f;
+}
+
+float TimingKernel::ledTime(const device::WaveformPacket &waveform, const ChannelTiming &timing, uint32_t armed) const
+{
+    if (armed == 0)
+    {
+        return 0.f;
+    }
+
+    float threshold = static_cast<float>(waveform.baseline) + timing.threshold;
+    float before = waveform.values.at(armed - 1);
+    float after = waveform.values.at(armed);
+
+    return (armed - 1) + (threshold - before) / (after - before);
+}
+
+int64_t TimingKernel::findArming(const device::WaveformPacket &waveform, uint32_t threshold)
+{
+    uint32_t level = static_cast<uint32_t>(waveform.baseline) + threshold;
+    if (level > std::numeric_limits<uint16_t>::max())
+    {
+        return -1;
+    }
+
+    const uint16_t *values = waveform.values.constData();
+    uint32_t length = waveform.values.size();
+    uint32_t index = 0;
+
+    if (level == 0)
+    {
+        return (length > 0) ? 0 : -1;
+    }
+
+#if defined(__SSE2__)
+    // Unsigned x >= level is tested as (x - level) saturating to zero == 0.
+    const __m128i level_block = _mm_set1_epi16(static_cast<short>(level - 1));
+    const __m128i zero = _mm_setzero_si128();
+
+    for (; index + 8 <= length; index += 8)
+    {
+        __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i *>(values + index));
+        int mask = _mm_movemask_epi8(_mm_cmpeq_epi16(_mm_subs_epu16(block, level_block), zero));
+        if (mask != 0xFFFF)
+        {
+            return index + __builtin_ctz(~mask & 0xFFFF) / 2;
+        }
+    }
+#endif
+
+    for (; index < length; ++index)
+    {
+        if (values[index] >= level)
+        {
+            return index;
+        }
+    }
+
+    return -1;
+}
@@ -0,0 +1,56 @@
+#ifndef TIMING_KERNEL_HPP
+#define TIMING_KERNEL_HPP
+
+#include "header_structure.hpp"
+#include "packet_structure.hpp"
+
+#include <QVector>
+
+#include <vector>
+
+
+struct TimingResult
+{
+    uint16_t channelId;
+    bool valid; // false when the channel is unknown or never triggered
+
+    float time; // in samples from the start of the waveform
+};
+
+// Trigger timing over batches of packets, chosen per channel by filterType:
+//  - CFD: zero crossing of fraction * s[i] - s[i - delay] after s first
+//    reaches cfdThreshold, linearly interpolated between samples;
+//  - LED: first crossing of ledThresholdUp, linearly interpolated.
+// s is the baseline subtracted waveform. The kernel keeps one scratch buffer
+// that grows to the longest packet seen, so steady state batches allocate
+// nothing beyond the result vector.
+class TimingKernel
+{
+public:
+    explicit TimingKernel(const QVector<device::DevicePSDSettings> &settings);
+
+    TimingResult process(const device::WaveformPacket &waveform);
+    void process(const QVector<device::WaveformPacket> &waveforms, QVector<TimingResult> &results);
+
+private:
+    struct ChannelTiming
+    {
+        device::TTFilterType filter;
+        uint32_t delay;
+        float fraction;
+        uint32_t threshold;
+    };
+
+    float cfdTime(const device::WaveformPacket &waveform, const ChannelTiming &timing, uint32_t armed);
+    float ledTime(const device::WaveformPacket &waveform, const ChannelTiming &timing, uint32_t armed) const;
+
+    static int64_t findArming(const device::WaveformPacket &waveform, uint32_t threshold);
+
+private:
+    QVector<ChannelTiming> channels;
+    QVector<int32_t> channel_timings; // chanelId -> index into channels, -1 if unknown
+
+    std::vector<float> scratch;
+};
+
+#endif // TIMING_KERNEL_HPP
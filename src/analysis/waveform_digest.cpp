@@ -0,0 +1,218 @@
+#include "waveform_digest.hpp"
+
+#include <QtEndian>
+
+#include <algorithm>
+#include <bit>
+#include <cstring>
+
+
+namespace
+{
+constexpr quint64 prime1 = 11400714785074694791ULL;
+constexpr quint64 prime2 = 14029467366897019727ULL;
+constexpr quint64 prime3 = 1609587929392839161ULL;
+constexpr quint64 prime4 = 9650029242287828579ULL;
+constexpr quint64 prime5 = 2870177450012600261ULL;
+
+quint64 read64(const uchar *data)
+{
+    return qFromLittleEndian<quint64>(data);
+}
+
+quint32 read32(const uchar *data)
+{
+    return qFromLittleEndian<quint32>(data);
+}
+}
+
+Xxh64::Xxh64(quint64 seed)
+    : seed(seed), accumulators{ seed + prime1 + prime2, seed + prime2, seed, seed - prime1 }, total_size(0), stripe_size(0)
+{
+}
+
+quint64 Xxh64::round(quint64 accumulator, quint64 input)
+{
+    accumulator += input * prime2;
+    accumulator = std::rotl(accumulator, 31);
+    return accumulator * prime1;
+}
+
+void Xxh64::consume(const uchar *data)
+{
+    for (int lane = 0; lane < 4; ++lane)
+    {
+        accumulators[lane] = round(accumulators[lane], read64(data + lane * 8));
+    }
+}
+
+void Xxh64::update(const void *data, qint64 size)
+{
+    // Empty input may come with a null pointer, which memcpy must not see.
+    if (size <= 0)
+    {
+        return;
+    }
+
+    const uchar *input = static_cast<const uchar *>(data);
+    total_size += size;
+
+    // Top up a partly filled stripe first.
+    if (stripe_size > 0)
+    {
+        qint64 take = std::min<qint64>(size, sizeof(stripe) - stripe_size);
+        std::memcpy(stripe + stripe_size, input, take);
+        stripe_size += take;
+        input += take;
+        size -= take;
+
+        if (stripe_size < sizeof(stripe))
+        {
+            return;
+        }
+
+        consume(stripe);
+        stripe_size = 0;
+    }
+
+    for (; size >= static_cast<qint64>(sizeof(stripe)); input += sizeof(stripe), size -= sizeof(stripe))
+    {
+        consume(input);
+    }
+
+    std::memcpy(stripe, input, size);
+    stripe_size = size;
+}
+
+quint64 Xxh64::digest() const
+{
+    quint64 hash;
+    if (total_size >= sizeof(stripe))
+    {
+        hash = std::rotl(accumulators[0], 1) + std::rotl(accumulators[1], 7) +
+               std::rotl(accumulators[2], 12) + std::rotl(accumulators[3], 18);
+
+        for (quint64 accumulator : accumulators)
+        {
+            hash ^= round(0, accumulator);
+            hash = hash * prime1 + prime4;
+        }
+    }
+    else
+    {
+        hash = seed + prime5;
+    }
+
+    hash += total_size;
+
+    const uchar *tail = stripe;
+    const uchar *end = stripe + stripe_size;
+
+    for (; tail + 8 <= end; tail += 8)
+    {
+        hash ^= round(0, read64(tail));
+        hash = std::rotl(hash, 27) * prime1 + prime4;
+    }
+
+    if (tail + 4 <= end)
+    {
+        hash ^= static_cast<quint64>(read32(tail)) * prime1;
+        hash = std::rotl(hash, 23) * prime2 + prime3;
+        tail += 4;
+    }
+
+    for (; tail < end; ++tail)
+    {
+        hash ^= *tail * prime5;
+        hash = std::rotl(hash, 11) * prime1;
+    }
+
+    hash ^= hash >> 33;
+    hash *= prime2;
+    hash ^= hash >> 29;
+    hash *= prime3;
+    hash ^= hash >> 32;
+
+    return hash;
+}
+
+void WaveformDigest::add(const device::WaveformPacket &waveform)
+{
+    // Fixed little-endian header so the same packet always hashes the same,
+    // whatever padding the struct has.
+    uchar header[16];
+    qToLittleEndian<quint32>(waveform.nubmerOfValues, header);
+    qToLittleEndian<quint16>(waveform.baseline, header + 4);
+    qToLittleEndian<quint16>(waveform.chanelId, header + 6);
+    qToLittleEndian<quint64>(waveform.timestamp, header + 8);
+
+    qint64 size = waveform.values.size() * static_cast<qint64>(sizeof(uint16_t));
+
+    overall.update(header, sizeof(header));
+    overall.update(waveform.values.constData(), size);
+
+    auto &channel = channels[waveform.chanelId];
+    channel.update(header, sizeof(header));
+    channel.update(waveform.values.constData(), size);
+
+    ++packet_count;
+    sample_bytes += size;
+}
+
+quint64 WaveformDigest::packets() const
+{
+    return packet_count;
+}
+
+quint64 WaveformDigest::sampleBytes() const
+{
+    return sample_bytes;
+}
+
+quint64 WaveformDigest::value() const
+{
+    return overall.digest();
+}
+
+QHash<uint16_t, quint64> WaveformDigest::channelValues() const
+{
+    QHash<uint16_t, quint64> values;
+    for (uint16_t channel : channels.keys())
+    {
+        values.insert(channel, channels.value(channel).digest());
+    }
+
+    return values;
+}
+
+QVector<uint16_t> WaveformDigest::differingChannels(const WaveformDigest &other) const
+{
+    auto ours = channelValues();
+    auto theirs = other.channelValues();
+
+    QVector<uint16_t> differing;
+    for (uint16_t channel : ours.keys())
+    {
+        if (!theirs.contains(channel) || theirs.value(channel) != ours.value(channel))
+        {
+            differing.append(channel);
+        }
+    }
+
+    for (uint16_t channel : theirs.keys())
+    {
+        if (!ours.contains(channel))
+        {
+            differing.append(channel);
+        }
+    }
+
+    std::sort(differing.begin(), differing.end());
+    return differing;
+}
+
+bool WaveformDigest::operator==(const WaveformDigest &other) const
+{
+    return packet_count == other.packet_count && sample_bytes == other.sample_bytes &&
+           value() == other.value() && differingChannels(other).isEmpty();
+}
@@ -0,0 +1,59 @@
+#ifndef WAVEFORM_DIGEST_HPP
+#define WAVEFORM_DIGEST_HPP
+
+#include "packet_structure.hpp"
+
+#include <QHash>
+#include <QVector>
+
+#include <cstdint>
+
+
+// Streaming XXH64, fed in pieces of any size. Same result as hashing the
+// concatenated input in one go with the reference implementation.
+class Xxh64
+{
+public:
+    explicit Xxh64(quint64 seed = 0);
+
+    void update(const void *data, qint64 size);
+    quint64 digest() const;
+
+private:
+    static quint64 round(quint64 accumulator, quint64 input);
+    void consume(const uchar *stripe);
+
+private:
+    quint64 seed;
+    quint64 accumulators[4];
+    quint64 total_size;
+    uchar stripe[32];
+    uint32_t stripe_size;
+};
+
+// Running digest of a packet stream, overall and per channel, so a writer and
+// a reader can compare what passed through them without keeping packets.
+// Samples are hashed in host byte order; digests are meant to be compared on
+// the machine that computed them.
+class WaveformDigest
+{
+public:
+    void add(const device::WaveformPacket &waveform);
+
+    quint64 packets() const;
+    quint64 sampleBytes() const;
+    quint64 value() const;
+    QHash<uint16_t, quint64> channelValues() const;
+
+    // Channels whose digest or presence differs between the two streams.
+    QVector<uint16_t> differingChannels(const WaveformDigest &other) const;
+    bool operator==(const WaveformDigest &other) const;
+
+private:
+    Xxh64 overall;
+    QHash<uint16_t, Xxh64> channels;
+    quint64 packet_count = 0;
+    quint64 sample_bytes = 0;
+};
+
+#endif // WAVEFORM_DIGEST_HPP
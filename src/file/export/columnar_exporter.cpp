@@ -0,0 +1,186 @@
+#include "columnar_exporter.hpp"
+#include "npy_column_writer.hpp"
+#include "file_reader.hpp"
+#include "packet_framing.hpp"
+
+#include <QDir>
+#include <QFile>
+#include <QDebug>
+
+#include <memory>
+
+
+ColumnarExporter::ColumnarExporter(const QString &output_directory, QObject *parent)
+    : QObject(parent), directory(output_directory), exported_packets(0)
+{
+}
+
+bool ColumnarExporter::exportFile(const QString &filename)
+{
+    exported_packets = 0;
+
+    if (!QDir().mkpath(directory))
+    {
+        qWarning() << "Failed to create output directory:" << directory;
+        return false;
+    }
+
+    QVector<device::DevicePSDSettings> settings;
+    uint32_t packets = 0;
+    framing::PacketFormat format = framing::PacketFormat::Plain;
+    {
+        FileReader reader(filename);
+        if (!reader.readSettings(settings))
+        {
+            qWarning() << "Failed to read settings from" << filename;
+            return false;
+        }
+        packets = reader.validPacketNumber();
+        format = reader.packetFormat();
+    }
+
+    if (!exportSettings(settings))
+    {
+        return false;
+    }
+
+    return exportWaveforms(filename, framing::bodyOffset(settings.size()), packets, format);
+}
+
+quint64 ColumnarExporter::exportedPackets() const
+{
+    return exported_packets;
+}
+
+bool ColumnarExporter::exportSettings(const QVector<device::DevicePSDSettings> &settings)
+{
+    NpyColumnWriter channel(columnPath("settings_channel_id"), "<u2", 2);
+    NpyColumnWriter wave_length(columnPath("settings_wave_length"), "<u4", 4);
+    NpyColumnWriter pre_trigger(columnPath("settings_pre_trigger_length"), "<u4", 4);
+    NpyColumnWriter hold_off(columnPath("settings_trigger_hold_off"), "<u4", 4);
+    NpyColumnWriter pre_gate(columnPath("settings_pre_gate_length"), "<u4", 4);
+    NpyColumnWriter short_gate(columnPath("settings_short_gate_length"), "<u4", 4);
+    NpyColumnWriter long_gate(columnPath("settings_long_gate_length"), "<u4", 4);
+    NpyColumnWriter filter_type(columnPath("settings_filter_type"), "<u1", 1);
+    NpyColumnWriter threshold_up(columnPath("settings_led_threshold_up"), "<u4", 4);
+    NpyColumnWriter threshold_down(columnPath("settings_led_threshold_down"), "<u4", 4);
+    NpyColumnWriter cfd_delay(columnPath("settings_cfd_delay"), "<u4", 4);
+    NpyColumnWriter cfd_threshold(columnPath("settings_cfd_threshold"), "<u4", 4);
+    NpyColumnWriter cfd_fraction(columnPath("settings_cfd_fraction"), "<f8", 8);
+
+    for (const auto &value : settings)
+    {
+        bool led = value.filterType == device::TTFilterType::LED;
+
+        channel.append<quint16>(value.channelId);
+        wave_length.append<quint32>(value.psdWaveLength);
+        pre_trigger.append<quint32>(value.psdPreTriggerLength);
+        hold_off.append<quint32>(value.triggerHoldOff);
+        pre_gate.append<quint32>(value.psdPreGateLength);
+        short_gate.append<quint32>(value.psdShortGateLength);
+        long_gate.append<quint32>(value.psdLongGateLength);
+        filter_type.append<quint8>(static_cast<quint8>(value.filterType));
+        threshold_up.append<quint32>(led ? value.ledSettings.ledThresholdUp : 0);
+        threshold_down.append<quint32>(led ? value.ledSettings.ledThresholdDown : 0);
+        cfd_delay.append<quint32>(led ? 0 : value.cfdSettings.cfdDelay);
+        cfd_threshold.append<quint32>(led ? 0 : value.cfdSettings.cfdThreshold);
+        cfd_fraction.append<double>(led ? 0. : value.cfdSettings.cfdFraction);
+    }
+
+    bool result = channel.finish();
+    for (auto column : { &wave_length, &pre_trigger, &hold_off, &pre_gate, &short_gate, &long_gate, &filter_type,
+                         &threshold_up, &threshold_down, &cfd_delay, &cfd_threshold, &cfd_fraction })
+    {
+        result &= column->finish();
+    }
+
+    if (!result)
+    {
+        qWarning() << "Failed to write settings columns to" << directory;
+    }
+    return result;
+}
+
+bool ColumnarExporter::exportWaveforms(const QString &filename, qint64 body_offset, uint32_t packets, framing::PacketFormat format)
+{
+    QFile file(filename);
+    if (!file.open(QIODevice::ReadOnly))
+    {
+        qWarning() << "Failed to open file for reading:" << file.errorString();
+        return false;
+    }
+
+    qint64 file_size = file.size();
+    uchar *data = file.map(0, file_size);
+    if (!data)
+    {
+        qWarning() << "Failed to map file for export:" << file.errorString();
+        return false;
+    }
+
+    NpyColumnWriter samples(columnPath("samples"), "<u2", 2);
+    NpyColumnWriter sample_offset(columnPath("sample_offset"), "<u8", 8);
+    NpyColumnWriter length(columnPath("length"), "<u4", 4);
+    NpyColumnWriter channel(columnPath("channel"), "<u2", 2);
+    NpyColumnWriter baseline(columnPath("baseline"), "<u2", 2);
+
+    bool timestamped = format == framing::PacketFormat::Timestamped;
+    std::unique_ptr<NpyColumnWriter> timestamp;
+    if (timestamped)
+    {
+        timestamp = std::make_unique<NpyColumnWriter>(columnPath("timestamp"), "<u8", 8);
+    }
+
+    quint64 total_samples = 0;
+    qint64 position = body_offset;
+
+    for (uint32_t index = 0; index < packets; ++index)
+    {
+        const uchar *header = data + position + framing::magic_size;
+        quint32 number_of_values = qFromBigEndian<quint32>(header);
+
+        sample_offset.append<quint64>(total_samples);
+        length.append<quint32>(number_of_values);
+        baseline.append<quint16>(qFromBigEndian<quint16>(header + 4));
+        channel.append<quint16>(qFromBigEndian<quint16>(header + 6));
+        if (timestamped)
+        {
+            timestamp->append<quint64>(qFromBigEndian<quint64>(header + framing::packet_header_size));
+        }
+
+        // Samples are big-endian on disk; swap them straight into the column buffer.
+        const uchar *values = header + framing::headerSize(format);
+        for (quint32 copied = 0; copied < number_of_values;)
+        {
+            quint32 chunk = std::min<qint64>(number_of_values - copied, samples.capacity());
+            uchar *room = samples.claim(chunk);
+            for (quint32 sample = 0; sample < chunk; ++sample)
+            {
+                qToLittleEndian<quint16>(qFromBigEndian<quint16>(values + (copied + sample) * 2), room + sample * 2);
+            }
+            copied += chunk;
+        }
+
+        total_samples += number_of_values;
+        position += framing::packetSize(number_of_values, format);
+        ++exported_packets;
+    }
+
+    file.unmap(data);
+
+    bool result = samples.finish() & sample_offset.finish() & length.finish() & channel.finish() & baseline.finish();
+    if (timestamped)
+    {
+        result &= timestamp->finish();
+    }
+    if (!result)
+    {
+        qWarning() << "Failed to write waveform columns to" << directory;
+    }
+    return result;
+}
+
+QString ColumnarExporter::columnPath(const QString &column) const
+{
+    return QDir(directory).filePath(column + ".npy");
+}
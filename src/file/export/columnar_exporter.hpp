@@ -0,0 +1,44 @@
+#ifndef COLUMNAR_EXPORTER_HPP
+#define COLUMNAR_EXPORTER_HPP
+
+#include "header_structure.hpp"
+#include "packet_framing.hpp"
+
+#include <QString>
+#include <QObject>
+
+
+// Converts a .dgs file into a directory of NumPy .npy columns:
+//
+//   samples.npy        <u2  all samples of all packets, back to back
+//   sample_offset.npy  <u8  index of the first sample of each packet
+//   length.npy         <u4  nubmerOfValues of each packet
+//   channel.npy        <u2  chanelId of each packet
+//   baseline.npy       <u2  baseline of each packet
+//   timestamp.npy      <u8  trigger timestamp of each packet, timestamped files only
+//   settings_*.npy          one column per DevicePSDSettings field
+//
+// Packets are taken straight from the mapped file, so memory use is bounded
+// by the column write buffers regardless of the file size.
+class ColumnarExporter : public QObject
+{
+    Q_OBJECT
+public:
+    explicit ColumnarExporter(const QString &output_directory, QObject *parent = nullptr);
+
+    bool exportFile(const QString &filename);
+
+    quint64 exportedPackets() const;
+
+private:
+    bool exportSettings(const QVector<device::DevicePSDSettings> &settings);
+    bool exportWaveforms(const QString &filename, qint64 body_offset, uint32_t packets, framing::PacketFormat format);
+
+    QString columnPath(const QString &column) const;
+
+private:
+    QString directory;
+    quint64 exported_packets;
+};
+
+#endif // COLUMNAR_EXPORTER_HPP
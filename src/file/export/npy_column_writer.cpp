@@ -0,0 +1,105 @@
+#include "npy_column_writer.hpp"
+
+#include <QDebug>
+
+
+NpyColumnWriter::NpyColumnWriter(const QString &filename, const char *descr, qint64 item_size, qint64 buffer_size)
+    : file(filename), descriptor(descr), item_size(item_size), buffer_used(0), items(0), failed(false)
+{
+    buffer.resize((buffer_size / item_size) * item_size);
+
+    if (!file.open(QIODevice::WriteOnly))
+    {
+        qWarning() << "Failed to open column for writing:" << file.errorString();
+        failed = true;
+        return;
+    }
+
+    failed = !writeHeader();
+}
+
+NpyColumnWriter::~NpyColumnWriter()
+{
+    if (file.isOpen())
+    {
+        finish();
+    }
+}
+
+bool NpyColumnWriter::isOpen() const
+{
+    return !failed && file.isOpen();
+}
+
+uchar *NpyColumnWriter::claim(qint64 count)
+{
+    if (buffer_used + (count * item_size) > buffer.size())
+    {
+        flush();
+    }
+
+    auto room = reinterpret_cast<uchar *>(buffer.data()) + buffer_used;
+    buffer_used += count * item_size;
+    items += count;
+
+    return room;
+}
+
+qint64 NpyColumnWriter::capacity() const
+{
+    return buffer.size() / item_size;
+}
+
+bool NpyColumnWriter::finish()
+{
+    if (!file.isOpen())
+    {
+        return !failed;
+    }
+
+    if (flush() && file.seek(0))
+    {
+        failed |= !writeHeader();
+    }
+    else
+    {
+        failed = true;
+    }
+
+    file.close();
+    return !failed;
+}
+
+bool NpyColumnWriter::writeHeader()
+{
+    auto dictionary = QByteArray("{'descr': '") + descriptor + "', 'fortran_order': False, 'shape': (" +
+                      QByteArray::number(items) + ",), }";
+
+    // magic (6) + version (2) + header length (2) + dictionary, padded with
+    // spaces and terminated by a newline.
+    QByteArray header("\x93NUMPY\x01\x00", 8);
+    header.append(char((header_size - 10) & 0xFF));
+    header.append(char((header_size - 10) >> 8));
+    header.append(dictionary);
+    header.append(QByteArray(header_size - header.size() - 1, ' '));
+    header.append('\n');
+
+    return file.write(header) == header_size;
+}
+
+bool NpyColumnWriter::flush()
+{
+    if (buffer_used == 0)
+    {
+        return true;
+    }
+
+    if (file.write(buffer.constData(), buffer_used) != buffer_used)
+    {
+        qWarning() << "Failed to write column:" << file.errorString();
+        failed = true;
+    }
+
+    buffer_used = 0;
+    return !failed;
+}
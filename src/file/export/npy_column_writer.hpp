@@ -0,0 +1,53 @@
+#ifndef NPY_COLUMN_WRITER_HPP
+#define NPY_COLUMN_WRITER_HPP
+
+#include <QString>
+#include <QByteArray>
+#include <QFile>
+#include <QtEndian>
+
+
+// Streams one little-endian column into a NumPy .npy file. The header is
+// written with a placeholder shape and a fixed size, so the data always
+// starts at a 64 byte aligned offset and can be memory mapped as-is; the
+// final element count is patched in by finish().
+class NpyColumnWriter
+{
+public:
+    static constexpr qint64 header_size = 128;
+    static constexpr qint64 default_buffer_size = 4 * 1024 * 1024;
+
+    NpyColumnWriter(const QString &filename, const char *descr, qint64 item_size, qint64 buffer_size = default_buffer_size);
+    ~NpyColumnWriter();
+
+    bool isOpen() const;
+
+    template<typename T>
+    void append(T value)
+    {
+        qToLittleEndian<T>(value, claim(1));
+    }
+
+    // Returns room for count items in the write buffer, flushing it first if
+    // needed. count must not exceed capacity().
+    uchar *claim(qint64 count);
+    qint64 capacity() const;
+
+    bool finish();
+
+private:
+    bool writeHeader();
+    bool flush();
+
+private:
+    QFile file;
+    QByteArray descriptor;
+    qint64 item_size;
+
+    QByteArray buffer;
+    qint64 buffer_used;
+    quint64 items;
+    bool failed;
+};
+
+#endif // NPY_COLUMN_WRITER_HPP
@@ -0,0 +1,161 @@
+#ifndef CHUNK_WALKER_HPP
+#define CHUNK_WALKER_HPP
+
+#include "packet_framing.hpp"
+
+#include <QVector>
+
+#include <algorithm>
+#include <thread>
+#include <vector>
+
+
+namespace framing
+{
+// One byte range of a file body and the packets of the real chain that start
+// inside it.
+struct BodyChunk
+{
+    qint64 begin = 0;
+    qint64 end = 0;
+    qint64 first_packet = -1; // offset the chunk was walked from, -1 if none
+    qint64 exit = 0;          // first packet offset at or past end
+    quint64 first_index = 0;  // position in the file of the packet at first_packet
+    quint64 packets = 0;
+};
+
+namespace detail
+{
+template <typename Reset, typename Visit>
+bool walkChunk(const uchar *data, qint64 file_size, PacketFormat format, qint64 index, qint64 start, BodyChunk &chunk,
+               Reset &reset, Visit &visit)
+{
+    reset(index);
+    chunk.first_packet = start;
+    chunk.packets = 0;
+
+    qint64 position = start;
+    while (position < chunk.end)
+    {
+        qint64 packet_size = frameAt(data + position, file_size - position, format);
+        if (packet_size == 0)
+        {
+            chunk.exit = position;
+            return false;
+        }
+
+        visit(index, position, PacketView{ data + position, packet_size, format });
+
+        ++chunk.packets;
+        position += packet_size;
+    }
+
+    chunk.exit = position;
+    return true;
+}
+
+template <typename Reset, typename Visit>
+void synchroniseChunk(const uchar *data, qint64 file_size, PacketFormat format, qint64 index, BodyChunk &chunk,
+                      Reset &reset, Visit &visit)
+{
+    for (qint64 position = chunk.begin; position < chunk.end;)
+    {
+        qint64 next_magic = findMagic(data + position, file_size - position);
+        if (next_magic < 0 || position + next_magic >= chunk.end)
+        {
+            break;
+        }
+
+        // A magic inside sample data rarely starts a chain reaching the end
+        // of the chunk; if it does, the fix-up pass catches it.
+        if (walkChunk(data, file_size, format, index, position + next_magic, chunk, reset, visit))
+        {
+            return;
+        }
+        position += next_magic + 1;
+    }
+
+    reset(index);
+    chunk.first_packet = -1;
+    chunk.exit = chunk.end;
+    chunk.packets = 0;
+}
+} // namespace detail
+
+// Walks the packet chain of the body [body_offset, file_size) in chunk_count
+// byte chunks side by side. Every chunk but the first guesses its first packet
+// from the next magic; one whose guess differs from where the previous chunk
+// really ended is walked again from there. reset(index) drops whatever
+// visit(index, offset, view) gathered for a chunk before each walk of it, so
+// afterwards every chunk holds exactly its share of the real chain and chunks
+// past a malformed packet hold nothing. Returns the offset the chain stopped
+// at, file_size if every packet is framed.
+template <typename Reset, typename Visit>
+qint64 walkChunks(const uchar *data, qint64 file_size, qint64 body_offset, PacketFormat format, qint64 chunk_count,
+                  QVector<BodyChunk> &chunks, Reset reset, Visit visit)
+{
+    qint64 body_size = file_size - body_offset;
+    qint64 chunk_size = (body_size + chunk_count - 1) / std::max<qint64>(chunk_count, 1);
+
+    chunks.fill(BodyChunk(), chunk_count);
+    for (qint64 index = 0; index < chunk_count; ++index)
+    {
+        chunks[index].begin = body_offset + index * chunk_size;
+        chunks[index].end = std::min(file_size, chunks[index].begin + chunk_size);
+        chunks[index].exit = chunks[index].begin;
+    }
+
+    std::vector<std::thread> workers;
+    for (qint64 index = 0; index < chunk_count; ++index)
+    {
+        workers.emplace_back([&, index]() {
+            if (index == 0)
+            {
+                detail::walkChunk(data, file_size, format, index, body_offset, chunks[index], reset, visit);
+            }
+            else
+            {
+                detail::synchroniseChunk(data, file_size, format, index, chunks[index], reset, visit);
+            }
+        });
+    }
+
+    for (auto &worker : workers)
+    {
+        worker.join();
+    }
+
+    qint64 expected = body_offset;
+    quint64 packets = 0;
+    bool valid = true;
+
+    for (qint64 index = 0; index < chunk_count; ++index)
+    {
+        auto &chunk = chunks[index];
+
+        if (!valid)
+        {
+            reset(index);
+            chunk.first_packet = -1;
+            chunk.exit = expected;
+            chunk.packets = 0;
+        }
+        else
+        {
+            if (chunk.first_packet != expected)
+            {
+                valid = detail::walkChunk(data, file_size, format, index, expected, chunk, reset, visit);
+            }
+            expected = chunk.exit;
+        }
+
+        chunk.first_index = packets;
+        packets += chunk.packets;
+    }
+
+    return expected;
+}
+
+} // namespace framing
+
+#endif // CHUNK_WALKER_HPP
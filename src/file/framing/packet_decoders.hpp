@@ -0,0 +1,77 @@
+#ifndef PACKET_DECODERS_HPP
+#define PACKET_DECODERS_HPP
+
+#include "packet_framing.hpp"
+
+
+namespace framing
+{
+using PacketDecoder = void (*)(const uchar *data, device::WaveformPacket &waveform);
+
+// Decoder for packets known to hold N values. The constant trip count lets
+// the compiler vectorise the byte swap without a remainder loop; it is
+// unrolled by up to 64 iterations rather than fully, to bound code size.
+template<quint32 N>
+void decodeFixedPacket(const uchar *data, device::WaveformPacket &waveform)
+{
+    data += magic_size;
+
+    waveform.nubmerOfValues = N;
+    waveform.baseline = qFromBigEndian<quint16>(data + 4);
+    waveform.chanelId = qFromBigEndian<quint16>(data + 6);
+    waveform.timestamp = 0;
+
+    waveform.values.resize(N);
+    uint16_t *values = waveform.values.data();
+    const uchar *samples = data + packet_header_size;
+
+#pragma GCC unroll 64
+    for (quint32 index = 0; index < N; ++index)
+    {
+        values[index] = qFromBigEndian<quint16>(samples + index * 2);
+    }
+}
+
+// Picks the specialised decoder for the usual psdWaveLength values and the
+// generic one for everything else.
+inline PacketDecoder decoderFor(quint32 number_of_values)
+{
+    switch (number_of_values)
+    {
+    case 32:
+        return &decodeFixedPacket<32>;
+    case 64:
+        return &decodeFixedPacket<64>;
+    case 128:
+        return &decodeFixedPacket<128>;
+    case 256:
+        return &decodeFixedPacket<256>;
+    case 512:
+        return &decodeFixedPacket<512>;
+    case 1024:
+        return &decodeFixedPacket<1024>;
+    case 2048:
+        return &decodeFixedPacket<2048>;
+    default:
+        return &decodePacket;
+    }
+}
+
+inline PacketDecoder decoderFor(const PacketIndex &index)
+{
+    if (index.format == PacketFormat::Timestamped)
+    {
+        return &decodeTimestampedPacket;
+    }
+
+    if (!index.isUniform())
+    {
+        return &decodePacket;
+    }
+
+    return decoderFor(static_cast<quint32>((index.uniform_size - packet_overhead) / 2));
+}
+
+} // namespace framing
+
+#endif // PACKET_DECODERS_HPP
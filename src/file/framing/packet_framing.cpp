@@ -0,0 +1,58 @@
+#include "packet_framing.hpp"
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+
+namespace framing
+{
+qint64 findMagic(const uchar *data, qint64 size)
+{
+    qint64 position = 0;
+
+#if defined(__SSE2__)
+    // Match the first two magic bytes sixteen candidates at a time and only
+    // fall back to a full compare on hits, which are rare in sample data.
+    const __m128i first  = _mm_set1_epi8(default_body_prefix[0]);
+    const __m128i second = _mm_set1_epi8(default_body_prefix[1]);
+
+    for (; position + 16 + magic_size <= size; position += 16)
+    {
+        __m128i block_first  = _mm_loadu_si128(reinterpret_cast<const __m128i *>(data + position));
+        __m128i block_second = _mm_loadu_si128(reinterpret_cast<const __m128i *>(data + position + 1));
+
+        uint32_t mask = _mm_movemask_epi8(_mm_and_si128(_mm_cmpeq_epi8(block_first, first),
+                                                        _mm_cmpeq_epi8(block_second, second)));
+        while (mask != 0)
+        {
+            qint64 candidate = position + __builtin_ctz(mask);
+            if (isMagic(data + candidate))
+            {
+                return candidate;
+            }
+            mask &= mask - 1;
+        }
+    }
+#endif
+
+    while (position + magic_size <= size)
+    {
+        auto hit = static_cast<const uchar *>(std::memchr(data + position, static_cast<uchar>(default_body_prefix[0]), size - position - magic_size + 1));
+        if (!hit)
+        {
+            break;
+        }
+
+        position = hit - data;
+        if (isMagic(data + position))
+        {
+            return position;
+        }
+        ++position;
+    }
+
+    return -1;
+}
+
+} // namespace framing
@@ -0,0 +1,180 @@
+#ifndef PACKET_FRAMING_HPP
+#define PACKET_FRAMING_HPP
+
+#include "validation_defines.hpp"
+#include "packet_structure.hpp"
+
+#include <QtGlobal>
+#include <QtEndian>
+
+#include <cstring>
+
+
+namespace framing
+{
+constexpr qint64 signature_size      = 8;
+constexpr qint64 settings_count_size = 2;
+constexpr qint64 settings_size       = 46;
+constexpr qint64 settings_hash_size  = 16;
+
+constexpr qint64 magic_size         = 4;
+constexpr qint64 packet_header_size = 8; // nubmerOfValues + baseline + chanelId
+constexpr qint64 packet_overhead    = magic_size + packet_header_size + magic_size;
+constexpr qint64 timestamp_size     = 8; // trigger timestamp after chanelId, timestamped format only
+
+// Packet layout of a file, selected by the minor version in its signature.
+enum class PacketFormat
+{
+    Plain,
+    Timestamped
+};
+
+inline PacketFormat formatForVersion(uchar minor)
+{
+    return minor >= timestamped_version_minor ? PacketFormat::Timestamped : PacketFormat::Plain;
+}
+
+inline qint64 headerSize(PacketFormat format)
+{
+    return format == PacketFormat::Timestamped ? packet_header_size + timestamp_size : packet_header_size;
+}
+
+struct ByteRange
+{
+    qint64 offset;
+    qint64 length;
+
+    bool operator==(const ByteRange &other) const
+    {
+        return offset == other.offset && length == other.length;
+    }
+};
+
+// Read-only view of one framed packet (prefix, header, samples, trailer) in
+// a mapped buffer. Samples stay big-endian as on disk.
+struct PacketView
+{
+    const uchar *data;
+    qint64 size;
+    PacketFormat format = PacketFormat::Plain;
+
+    quint32 numberOfValues() const { return qFromBigEndian<quint32>(data + magic_size); }
+    uint16_t baseline() const { return qFromBigEndian<quint16>(data + magic_size + 4); }
+    uint16_t chanelId() const { return qFromBigEndian<quint16>(data + magic_size + 6); }
+    const uchar *samples() const { return data + magic_size + headerSize(format); }
+
+    quint64 timestamp() const
+    {
+        return format == PacketFormat::Timestamped ? qFromBigEndian<quint64>(data + magic_size + packet_header_size) : 0;
+    }
+};
+
+// Where the packets of a validated file start: arithmetic when every packet
+// has the same length, a recorded table otherwise.
+struct PacketIndex
+{
+    qint64 body_offset = 0;
+    qint64 uniform_size = 0; // bytes per packet when uniform, 0 otherwise
+    qint64 packet_count = 0;
+    PacketFormat format = PacketFormat::Plain;
+    QVector<qint64> offsets; // recorded offsets of variable length packets
+
+    bool isUniform() const { return uniform_size > 0; }
+    bool isAddressable() const { return isUniform() || offsets.size() == packet_count; }
+
+    qint64 offset(qint64 index) const
+    {
+        return isUniform() ? body_offset + index * uniform_size : offsets.at(index);
+    }
+};
+
+inline qint64 bodyOffset(uint16_t settings_number)
+{
+    return signature_size + settings_count_size + (settings_number * settings_size) + settings_hash_size;
+}
+
+inline qint64 packetSize(quint32 number_of_values, PacketFormat format = PacketFormat::Plain)
+{
+    return magic_size + headerSize(format) + magic_size + (static_cast<qint64>(number_of_values) * 2);
+}
+
+inline bool isMagic(const uchar *data)
+{
+    return std::memcmp(data, default_body_prefix.constData(), magic_size) == 0;
+}
+
+// Returns the size of the packet framed at data, or 0 if prefix, length and
+// trailer do not line up within the available bytes.
+inline qint64 frameAt(const uchar *data, qint64 available, PacketFormat format = PacketFormat::Plain)
+{
+    if (available < packetSize(0, format) || !isMagic(data))
+    {
+        return 0;
+    }
+
+    qint64 packet_size = packetSize(qFromBigEndian<quint32>(data + magic_size), format);
+    if (packet_size > available || !isMagic(data + packet_size - magic_size))
+    {
+        return 0;
+    }
+
+    return packet_size;
+}
+
+// Decodes the packet framed at data, byte for byte like operator>> does from a
+// QDataStream, but straight out of a mapped buffer.
+inline void decodePacket(const uchar *data, device::WaveformPacket &waveform)
+{
+    data += magic_size;
+
+    waveform.nubmerOfValues = qFromBigEndian<quint32>(data);
+    waveform.baseline = qFromBigEndian<quint16>(data + 4);
+    waveform.chanelId = qFromBigEndian<quint16>(data + 6);
+    waveform.timestamp = 0;
+
+    waveform.values.resize(waveform.nubmerOfValues);
+    qFromBigEndian<quint16>(data + packet_header_size, waveform.nubmerOfValues, waveform.values.data());
+}
+
+inline void decodeTimestampedPacket(const uchar *data, device::WaveformPacket &waveform)
+{
+    data += magic_size;
+
+    waveform.nubmerOfValues = qFromBigEndian<quint32>(data);
+    waveform.baseline = qFromBigEndian<quint16>(data + 4);
+    waveform.chanelId = qFromBigEndian<quint16>(data + 6);
+    waveform.timestamp = qFromBigEndian<quint64>(data + packet_header_size);
+
+    waveform.values.resize(waveform.nubmerOfValues);
+    qFromBigEndian<quint16>(data + packet_header_size + timestamp_size, waveform.nubmerOfValues, waveform.values.data());
+}
+
+// Encodes waveform framed as on disk into out, which must hold
+// packetSize(waveform.values.size(), format) bytes. The inverse of the
+// decoders above and byte for byte what operator<< streams.
+inline qint64 encodePacket(const device::WaveformPacket &waveform, uchar *out, PacketFormat format = PacketFormat::Plain)
+{
+    qint64 size = packetSize(waveform.values.size(), format);
+
+    std::memcpy(out, default_body_prefix.constData(), magic_size);
+    qToBigEndian<quint32>(waveform.nubmerOfValues, out + magic_size);
+    qToBigEndian<quint16>(waveform.baseline, out + magic_size + 4);
+    qToBigEndian<quint16>(waveform.chanelId, out + magic_size + 6);
+
+    if (format == PacketFormat::Timestamped)
+    {
+        qToBigEndian<quint64>(waveform.timestamp, out + magic_size + packet_header_size);
+    }
+
+    qToBigEndian<quint16>(waveform.values.constData(), waveform.values.size(), out + magic_size + headerSize(format));
+    std::memcpy(out + size - magic_size, default_body_prefix.constData(), magic_size);
+
+    return size;
+}
+
+// Returns the offset of the first body magic in data, or -1 if there is none.
+qint64 findMagic(const uchar *data, qint64 size);
+
+} // namespace framing
+
+#endif // PACKET_FRAMING_HPP
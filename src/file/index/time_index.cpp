@@ -0,0 +1,241 @@
+#include "time_index.hpp"
+#include "validation_cache.hpp"
+#include "validation_defines.hpp"
+
+#include <QFile>
+#include <QSaveFile>
+#include <QDataStream>
+#include <QDebug>
+
+#include <algorithm>
+
+
+namespace
+{
+constexpr quint32 index_version = 2;
+// first_packet, offset, min_timestamp and max_timestamp.
+constexpr qint64 entry_size = 4 * sizeof(quint64);
+constexpr qint64 edge_hash_size = 16;
+}
+
+
+TimeIndex::TimeIndex(uint32_t interval)
+    : interval(interval > 0 ? interval : default_time_index_interval), packet_count(0)
+{
+}
+
+QString TimeIndex::indexFilename(const QString &filename)
+{
+    return default_time_index.arg(filename);
+}
+
+void TimeIndex::add(qint64 offset, quint64 timestamp)
+{
+    if (packet_count % interval == 0)
+    {
+        blocks.append({ packet_count, offset, timestamp, timestamp });
+    }
+    else
+    {
+        auto &block = blocks.last();
+        block.min_timestamp = std::min(block.min_timestamp, timestamp);
+        block.max_timestamp = std::max(block.max_timestamp, timestamp);
+    }
+
+    ++packet_count;
+}
+
+void TimeIndex::append(const TimeIndex &other, qint64 offset_shift)
+{
+    for (auto block : other.blocks)
+    {
+        block.first_packet += packet_count;
+        block.offset += offset_shift;
+        blocks.append(block);
+    }
+
+    packet_count += other.packet_count;
+}
+
+void TimeIndex::finish()
+{
+    updateBounds();
+}
+
+bool TimeIndex::save(const QString &filename) const
+{
+    FileIdentity identity;
+    if (!validation_cache::identify(filename, identity))
+    {
+        qWarning() << "Failed to identify" << filename << "for its time index.";
+        return false;
+    }
+
+    QSaveFile file(indexFilename(filename));
+    if (!file.open(QIODevice::WriteOnly))
+    {
+        qWarning() << "Failed to open time index for writing:" << file.errorString();
+        return false;
+    }
+
+    QDataStream out(&file);
+    out.writeRawData(default_time_index_magic.constData(), default_time_index_magic.size());
+    out << index_version << interval << packet_count;
+    out << identity.device << identity.inode << static_cast<quint64>(identity.size) << identity.modified_ns;
+    out.writeRawData(identity.edge_hash.constData(), identity.edge_hash.size());
+    out << static_cast<quint32>(blocks.size());
+
+    for (const auto &block : blocks)
+    {
+        out << block.first_packet << block.offset << block.min_timestamp << block.max_timestamp;
+    }
+
+    if (!file.commit())
+    {
+        qWarning() << "Failed to commit time index:" << file.errorString();
+        return false;
+    }
+
+    return true;
+}
+
+bool TimeIndex::load(const QString &filename, qint64 body_offset)
+{
+    QString index_filename = indexFilename(filename);
+    QFile file(index_filename);
+    if (!file.open(QIODevice::ReadOnly))
+    {
+        return false;
+    }
+
+    QDataStream in(&file);
+
+    QByteArray magic(default_time_index_magic.size(), Qt::Uninitialized);
+    quint32 version = 0;
+    quint32 stored_interval = 0;
+    quint64 stored_packets = 0;
+    quint64 indexed_size = 0;
+    FileIdentity stored;
+    quint32 block_count = 0;
+
+    if (in.readRawData(magic.data(), magic.size()) != magic.size() || magic != default_time_index_magic)
+    {
+        qWarning() << "Not a time index:" << index_filename;
+        return false;
+    }
+
+    stored.edge_hash.resize(edge_hash_size);
+    in >> version >> stored_interval >> stored_packets;
+    in >> stored.device >> stored.inode >> indexed_size >> stored.modified_ns;
+    in.readRawData(stored.edge_hash.data(), stored.edge_hash.size());
+    in >> block_count;
+    stored.size = static_cast<qint64>(indexed_size);
+
+    if (in.status() != QDataStream::Ok || version != index_version || stored_interval == 0)
+    {
+        qWarning() << "Truncated or unsupported time index:" << index_filename;
+        return false;
+    }
+
+    FileIdentity identity;
+    if (!validation_cache::identify(filename, identity) || !(identity == stored))
+    {
+        qWarning() << "Time index" << index_filename << "does not match its file, ignoring it.";
+        return false;
+    }
+
+    // The count is only trusted as far as the sidecar can hold its entries.
+    if (block_count > (file.size() - file.pos()) / entry_size)
+    {
+        qWarning() << "Truncated time index:" << index_filename;
+        return false;
+    }
+
+    QVector<TimeIndexEntry> stored_blocks(block_count);
+    for (auto &block : stored_blocks)
+    {
+        in >> block.first_packet >> block.offset >> block.min_timestamp >> block.max_timestamp;
+    }
+
+    if (in.status() != QDataStream::Ok)
+    {
+        qWarning() << "Truncated time index:" << index_filename;
+        return false;
+    }
+
+    // Readers walk each block from its offset for blockPackets() packets, so
+    // blocks must start at packet 0, follow each other and stay in the body.
+    bool valid = stored_blocks.isEmpty() ? stored_packets == 0 : stored_blocks.first().first_packet == 0;
+    for (qsizetype block = 0; valid && block < stored_blocks.size(); ++block)
+    {
+        const auto &entry = stored_blocks.at(block);
+        valid = entry.first_packet < stored_packets && entry.offset >= body_offset && entry.offset < identity.size &&
+                entry.min_timestamp <= entry.max_timestamp;
+
+        if (valid && block > 0)
+        {
+            const auto &previous = stored_blocks.at(block - 1);
+            valid = entry.first_packet > previous.first_packet && entry.offset > previous.offset;
+        }
+    }
+
+    if (!valid)
+    {
+        qWarning() << "Time index" << index_filename << "has inconsistent entries, ignoring it.";
+        return false;
+    }
+
+    interval = stored_interval;
+    packet_count = stored_packets;
+    blocks = std::move(stored_blocks);
+    updateBounds();
+    return true;
+}
+
+bool TimeIndex::find(quint64 from, quint64 to, qsizetype &first_block, qsizetype &last_block) const
+{
+    if (blocks.isEmpty() || from > to)
+    {
+        return false;
+    }
+
+    // No block before the first whose running maximum reaches from, and none
+    // after the last whose running minimum is still within to, can match.
+    first_block = std::lower_bound(prefix_max.cbegin(), prefix_max.cend(), from) - prefix_max.cbegin();
+    last_block = std::upper_bound(suffix_min.cbegin(), suffix_min.cend(), to) - suffix_min.cbegin();
+
+    return first_block < last_block;
+}
+
+const QVector<TimeIndexEntry> &TimeIndex::entries() const
+{
+    return blocks;
+}
+
+quint64 TimeIndex::blockPackets(qsizetype block) const
+{
+    quint64 end = (block + 1 < blocks.size()) ? blocks.at(block + 1).first_packet : packet_count;
+    return end - blocks.at(block).first_packet;
+}
+
+quint64 TimeIndex::packetCount() const
+{
+    return packet_count;
+}
+
+void TimeIndex::updateBounds()
+{
+    prefix_max.resize(blocks.size());
+    suffix_min.resize(blocks.size());
+
+    for (qsizetype block = 0; block < blocks.size(); ++block)
+    {
+        prefix_max[block] = std::max(block > 0 ? prefix_max.at(block - 1) : 0, blocks.at(block).max_timestamp);
+    }
+
+    for (qsizetype block = blocks.size() - 1; block >= 0; --block)
+    {
+        suffix_min[block] = std::min(block + 1 < blocks.size() ? suffix_min.at(block + 1) : blocks.at(block).min_timestamp,
+                                     blocks.at(block).min_timestamp);
+    }
+}
@@ -0,0 +1,62 @@
+#ifndef TIME_INDEX_HPP
+#define TIME_INDEX_HPP
+
+#include <QString>
+#include <QVector>
+
+
+struct TimeIndexEntry
+{
+    quint64 first_packet;
+    qint64 offset; // file offset of first_packet
+    quint64 min_timestamp;
+    quint64 max_timestamp;
+};
+
+// Sparse index over the trigger timestamps of a timestamped .dgs file: one
+// entry per block of interval packets, stored next to the file as .dgst.
+// Blocks keep their minimum and maximum so lookups stay correct when
+// timestamps are only roughly ordered, e.g. across channels.
+class TimeIndex
+{
+public:
+    explicit TimeIndex(uint32_t interval = 0);
+
+    static QString indexFilename(const QString &filename);
+
+    void add(qint64 offset, quint64 timestamp);
+    // Appends the blocks of another index, renumbered to follow this one.
+    void append(const TimeIndex &other, qint64 offset_shift);
+    void finish();
+
+    // Stored as indexFilename(filename), big-endian: "DGST", version,
+    // interval, packet count, identity of the indexed file, entry count and
+    // the entries. Keyed like the validation cache, so an index is never used
+    // for a rewritten file of the same size.
+    bool save(const QString &filename) const;
+    // Rejects entries that are out of order or point before body_offset.
+    bool load(const QString &filename, qint64 body_offset);
+
+    // Blocks [first_block, last_block) that may hold packets stamped within
+    // [from, to]. Returns false when no block can.
+    bool find(quint64 from, quint64 to, qsizetype &first_block, qsizetype &last_block) const;
+
+    const QVector<TimeIndexEntry> &entries() const;
+    quint64 blockPackets(qsizetype block) const;
+    quint64 packetCount() const;
+
+private:
+    void updateBounds();
+
+private:
+    uint32_t interval;
+    quint64 packet_count;
+    QVector<TimeIndexEntry> blocks;
+
+    // Running maximum from the front and running minimum from the back are
+    // both sorted, which is what makes the lookup a binary search.
+    QVector<quint64> prefix_max;
+    QVector<quint64> suffix_min;
+};
+
+#endif // TIME_INDEX_HPP
@@ -0,0 +1,121 @@
+#include "live_validator.hpp"
+
+#include <QDebug>
+
+#include <thread>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+
+LiveValidator::LiveValidator(SharedRingBuffer &ring, FileWriter *tee)
+    : ring(ring), tee(tee), valid_packets(0), corrupted_bytes(0)
+{
+}
+
+qint64 LiveValidator::poll(const PacketHandler &handler)
+{
+    const uchar *data;
+    qint64 available = ring.readable(&data);
+    qint64 consumed = 0;
+    qint64 packets = 0;
+
+    while (available - consumed >= framing::magic_size + 4)
+    {
+        const uchar *position = data + consumed;
+        qint64 remaining = available - consumed;
+
+        qint64 packet_size = framing::isMagic(position)
+                                 ? framing::packetSize(qFromBigEndian<quint32>(position + framing::magic_size))
+                                 : 0;
+
+        if (packet_size > 0 && packet_size <= ring.capacity())
+        {
+            if (packet_size > remaining)
+            {
+                // Releasing what was consumed makes room for the rest of the
+                // packet. With nothing to release and the producer stalled on
+                // a full ring the rest never arrives, so the size is bogus.
+                if (consumed > 0 || !ring.producerStalled())
+                {
+                    break;
+                }
+
+                available = ring.readable(&data);
+                remaining = available - consumed;
+            }
+
+            if (packet_size <= remaining && framing::isMagic(position + packet_size - framing::magic_size))
+            {
+                framing::PacketView view{ position, packet_size };
+                handler(view);
+
+                if (tee)
+                {
+                    tee->writeFramed(reinterpret_cast<const char *>(position), packet_size);
+                }
+
+                consumed += packet_size;
+                ++valid_packets;
+                ++packets;
+                continue;
+            }
+        }
+
+        // Not a packet: skip to the next magic, keeping a possible partial
+        // magic at the end of the available bytes.
+        qint64 next_magic = framing::findMagic(position + 1, remaining - 1);
+        qint64 skipped = (next_magic < 0) ? remaining - (framing::magic_size - 1) : next_magic + 1;
+
+        qWarning() << "Skipping" << skipped << "corrupted bytes in live stream.";
+        corrupted_bytes += skipped;
+        consumed += skipped;
+    }
+
+    if (consumed > 0)
+    {
+        ring.release(consumed);
+    }
+
+    return packets;
+}
+
+void LiveValidator::run(const PacketHandler &handler, const std::atomic<bool> &stop)
+{
+    uint32_t idle = 0;
+
+    while (!stop.load(std::memory_order_relaxed))
+    {
+        if (poll(handler) > 0)
+        {
+            idle = 0;
+            continue;
+        }
+
+        // Spin briefly before yielding so a busy producer is picked up
+        // within microseconds without burning a core when the ring is idle.
+        if (++idle < 1024)
+        {
+#if defined(__SSE2__)
+            _mm_pause();
+#endif
+        }
+        else
+        {
+            std::this_thread::yield();
+        }
+    }
+
+    poll(handler);
+}
+
+quint64 LiveValidator::validPackets() const
+{
+    return valid_packets;
+}
+
+quint64 LiveValidator::corruptedBytes() const
+{
+    return corrupted_bytes;
+}
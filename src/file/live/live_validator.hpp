@@ -0,0 +1,39 @@
+#ifndef LIVE_VALIDATOR_HPP
+#define LIVE_VALIDATOR_HPP
+
+#include "shared_ring_buffer.hpp"
+#include "packet_framing.hpp"
+#include "file_writer.hpp"
+
+#include <atomic>
+#include <functional>
+
+
+// Consumer side of the live ingest path. Validates the framing of packets as
+// they appear in a SharedRingBuffer and hands each one to a handler as a view
+// into the ring, optionally teeing the framed bytes into a FileWriter. Damaged
+// bytes are skipped by resynchronising on the next body magic.
+class LiveValidator
+{
+public:
+    using PacketHandler = std::function<void(const framing::PacketView &packet)>;
+
+    explicit LiveValidator(SharedRingBuffer &ring, FileWriter *tee = nullptr);
+
+    // Processes every complete packet currently in the ring.
+    qint64 poll(const PacketHandler &handler);
+    // Busy-polls the ring until stop is set, for microsecond latency.
+    void run(const PacketHandler &handler, const std::atomic<bool> &stop);
+
+    quint64 validPackets() const;
+    quint64 corruptedBytes() const;
+
+private:
+    SharedRingBuffer &ring;
+    FileWriter *tee;
+
+    quint64 valid_packets;
+    quint64 corrupted_bytes;
+};
+
+#endif // LIVE_VALIDATOR_HPP
@@ -0,0 +1,249 @@
+#include "shared_ring_buffer.hpp"
+#include "packet_framing.hpp"
+
+#include <QDebug>
+
+#include <cerrno>
+#include <new>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+
+namespace
+{
+constexpr quint32 ring_magic = 0x44475352; // "DGSR"
+
+qint64 pageSize()
+{
+    static const qint64 page = ::sysconf(_SC_PAGESIZE);
+    return page;
+}
+}
+
+struct SharedRingBuffer::Header
+{
+    quint32 magic;
+    quint32 reserved;
+    qint64 capacity;
+
+    alignas(64) std::atomic<quint64> head; // total bytes committed by the producer
+    std::atomic<quint64> stalled;          // size of a reservation that did not fit, or 0
+    alignas(64) std::atomic<quint64> tail; // total bytes released by the consumer
+};
+
+static_assert(std::atomic<quint64>::is_always_lock_free, "Shared ring needs address free atomics");
+
+qint64 SharedRingBuffer::headerBytes()
+{
+    // Used as the mmap offset of the data area, so 16K and 64K pages count.
+    return ((static_cast<qint64>(sizeof(Header)) + pageSize() - 1) / pageSize()) * pageSize();
+}
+
+std::unique_ptr<SharedRingBuffer> SharedRingBuffer::create(const QString &name, qint64 capacity, bool replace)
+{
+    qint64 page = pageSize();
+    capacity = ((capacity + page - 1) / page) * page;
+
+    auto name_bytes = name.toLocal8Bit();
+    if (replace)
+    {
+        ::shm_unlink(name_bytes.constData());
+    }
+
+    int descriptor = ::shm_open(name_bytes.constData(), O_CREAT | O_EXCL | O_RDWR, 0600);
+    if (descriptor < 0)
+    {
+        if (errno == EEXIST)
+        {
+            qWarning() << "Shared ring" << name << "already exists";
+        }
+        else
+        {
+            qWarning() << "Failed to create shared ring" << name;
+        }
+        return nullptr;
+    }
+
+    if (::ftruncate(descriptor, headerBytes() + capacity) != 0)
+    {
+        qWarning() << "Failed to size shared ring" << name;
+        ::close(descriptor);
+        ::shm_unlink(name_bytes.constData());
+        return nullptr;
+    }
+
+    std::unique_ptr<SharedRingBuffer> ring(new SharedRingBuffer(name, true));
+    if (!ring->map(descriptor, capacity))
+    {
+        ::close(descriptor);
+        return nullptr;
+    }
+    ::close(descriptor);
+
+    new (ring->header) Header{ ring_magic, 0, capacity, {0}, {0}, {0} };
+
+    return ring;
+}
+
+std::unique_ptr<SharedRingBuffer> SharedRingBuffer::open(const QString &name)
+{
+    int descriptor = ::shm_open(name.toLocal8Bit().constData(), O_RDWR, 0600);
+    if (descriptor < 0)
+    {
+        qWarning() << "Failed to open shared ring" << name;
+        return nullptr;
+    }
+
+    auto header = static_cast<Header *>(::mmap(nullptr, headerBytes(), PROT_READ, MAP_SHARED, descriptor, 0));
+    if (header == MAP_FAILED || header->magic != ring_magic)
+    {
+        qWarning() << "Shared ring" << name << "is not initialised";
+        if (header != MAP_FAILED)
+        {
+            ::munmap(header, headerBytes());
+        }
+        ::close(descriptor);
+        return nullptr;
+    }
+    qint64 capacity = header->capacity;
+    ::munmap(header, headerBytes());
+
+    std::unique_ptr<SharedRingBuffer> ring(new SharedRingBuffer(name, false));
+    bool mapped = ring->map(descriptor, capacity);
+    ::close(descriptor);
+
+    return mapped ? std::move(ring) : nullptr;
+}
+
+SharedRingBuffer::SharedRingBuffer(const QString &name, bool owner)
+    : shared_name(name), owner(owner), header(nullptr), data(nullptr), data_capacity(0)
+{
+}
+
+SharedRingBuffer::~SharedRingBuffer()
+{
+    if (data)
+    {
+        ::munmap(data, data_capacity * 2);
+    }
+
+    if (header)
+    {
+        ::munmap(header, headerBytes());
+    }
+
+    if (owner)
+    {
+        ::shm_unlink(shared_name.toLocal8Bit().constData());
+    }
+}
+
+bool SharedRingBuffer::map(int descriptor, qint64 capacity)
+{
+    void *header_memory = ::mmap(nullptr, headerBytes(), PROT_READ | PROT_WRITE, MAP_SHARED, descriptor, 0);
+    if (header_memory == MAP_FAILED)
+    {
+        qWarning() << "Failed to map shared ring header";
+        return false;
+    }
+    header = static_cast<Header *>(header_memory);
+
+    // Reserve twice the capacity, then map the data area into both halves.
+    void *area = ::mmap(nullptr, capacity * 2, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (area == MAP_FAILED)
+    {
+        qWarning() << "Failed to reserve shared ring address space";
+        return false;
+    }
+
+    auto base = static_cast<uchar *>(area);
+    for (qint64 half = 0; half < 2; ++half)
+    {
+        void *mapped = ::mmap(base + half * capacity, capacity, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED,
+                              descriptor, headerBytes());
+        if (mapped == MAP_FAILED)
+        {
+            qWarning() << "Failed to map shared ring data";
+            ::munmap(area, capacity * 2);
+            return false;
+        }
+    }
+
+    data = base;
+    data_capacity = capacity;
+    return true;
+}
+
+qint64 SharedRingBuffer::capacity() const
+{
+    return data_capacity;
+}
+
+bool SharedRingBuffer::write(const device::WaveformPacket &waveform)
+{
+    qint64 size = framing::packetSize(waveform.values.size());
+    uchar *room = reserve(size);
+    if (!room)
+    {
+        return false;
+    }
+
+    std::memcpy(room, default_body_prefix.constData(), framing::magic_size);
+    qToBigEndian<quint32>(waveform.values.size(), room + framing::magic_size);
+    qToBigEndian<quint16>(waveform.baseline, room + framing::magic_size + 4);
+    qToBigEndian<quint16>(waveform.chanelId, room + framing::magic_size + 6);
+    qToBigEndian<quint16>(waveform.values.constData(), waveform.values.size(), room + framing::magic_size + framing::packet_header_size);
+    std::memcpy(room + size - framing::magic_size, default_body_prefix.constData(), framing::magic_size);
+
+    commit(size);
+    return true;
+}
+
+uchar *SharedRingBuffer::reserve(qint64 size)
+{
+    quint64 head = header->head.load(std::memory_order_relaxed);
+    quint64 tail = header->tail.load(std::memory_order_acquire);
+
+    if (static_cast<qint64>(head - tail) + size > data_capacity)
+    {
+        header->stalled.store(size, std::memory_order_release);
+        return nullptr;
+    }
+
+    if (header->stalled.load(std::memory_order_relaxed) != 0)
+    {
+        header->stalled.store(0, std::memory_order_relaxed);
+    }
+
+    return data + (head % data_capacity);
+}
+
+void SharedRingBuffer::commit(qint64 size)
+{
+    header->head.fetch_add(size, std::memory_order_release);
+}
+
+qint64 SharedRingBuffer::readable(const uchar **view) const
+{
+    quint64 tail = header->tail.load(std::memory_order_relaxed);
+    quint64 head = header->head.load(std::memory_order_acquire);
+
+    *view = data + (tail % data_capacity);
+    return static_cast<qint64>(head - tail);
+}
+
+void SharedRingBuffer::release(qint64 size)
+{
+    header->tail.fetch_add(size, std::memory_order_release);
+}
+
+bool SharedRingBuffer::producerStalled() const
+{
+    quint64 stalled = header->stalled.load(std::memory_order_acquire);
+    quint64 tail = header->tail.load(std::memory_order_relaxed);
+    quint64 head = header->head.load(std::memory_order_acquire);
+
+    return stalled != 0 && static_cast<qint64>(head - tail + stalled) > data_capacity;
+}
@@ -0,0 +1,59 @@
+#ifndef SHARED_RING_BUFFER_HPP
+#define SHARED_RING_BUFFER_HPP
+
+#include "packet_structure.hpp"
+
+#include <QString>
+#include <QtGlobal>
+
+#include <atomic>
+#include <memory>
+
+
+// Single producer, single consumer byte ring in POSIX shared memory carrying
+// the .dgs body wire format (prefix, packet, trailer). The data area is mapped
+// twice back to back, so every readable or writable range is contiguous in
+// memory and packets can be handed out without copying across the wrap.
+class SharedRingBuffer
+{
+public:
+    // Fails if a ring of that name exists unless replace is set, which unlinks
+    // a stale ring left behind by a producer that did not shut down cleanly.
+    static std::unique_ptr<SharedRingBuffer> create(const QString &name, qint64 capacity, bool replace = false);
+    static std::unique_ptr<SharedRingBuffer> open(const QString &name);
+
+    ~SharedRingBuffer();
+
+    qint64 capacity() const;
+
+    // Producer side.
+    bool write(const device::WaveformPacket &waveform);
+    uchar *reserve(qint64 size);
+    void commit(qint64 size);
+
+    // Consumer side.
+    qint64 readable(const uchar **data) const;
+    void release(qint64 size);
+    // True while the producer waits for room that only releasing bytes can
+    // make. The committed bytes cannot grow until the consumer releases some.
+    bool producerStalled() const;
+
+private:
+    struct Header;
+
+    // Whole system pages holding the header; the data area is mapped after it.
+    static qint64 headerBytes();
+
+    SharedRingBuffer(const QString &name, bool owner);
+    bool map(int descriptor, qint64 capacity);
+
+private:
+    QString shared_name;
+    bool owner;
+
+    Header *header;
+    uchar *data;
+    qint64 data_capacity;
+};
+
+#endif // SHARED_RING_BUFFER_HPP
@@ -15,6 +15,10 @@ struct WaveformPacket
     uint16_t baseline;
     uint16_t chanelId;
 
+    // Trigger timestamp, only stored by the timestamped format and left out
+    // of the QDataStream operators, which keep the plain packet layout.
+    uint64_t timestamp = 0;
+
     QVector<uint16_t> values;
 
     friend QDataStream &operator<<(QDataStream &s, const WaveformPacket &value)
@@ -54,6 +58,7 @@ struct WaveformPacket
         result = nubmerOfValues == other.nubmerOfValues;
         result &= baseline == other.baseline;
         result &= chanelId == other.chanelId;
+        result &= timestamp == other.timestamp;
         result &= values.size() == other.values.size();
 
         if (result)
@@ -76,6 +81,7 @@ struct WaveformPacket
         os << "Number Of Values: " << value.nubmerOfValues << "\n";
         os << "Baseline: " << value.baseline << "\n";
         os << "Channel Id: " << value.chanelId << "\n";
+        os << "Timestamp: " << value.timestamp << "\n";
 
         for (auto val : value.values)
         {
@@ -0,0 +1,167 @@
+#include "async_file_reader.hpp"
+
+#include <QDebug>
+
+
+AsyncFileReader::BatchAwaiter::BatchAwaiter(AsyncFileReader &reader) : reader(reader)
+{
+}
+
+bool AsyncFileReader::BatchAwaiter::await_ready()
+{
+    std::lock_guard<std::mutex> lock(reader.mutex);
+    return reader.batch_ready || reader.finished;
+}
+
+bool AsyncFileReader::BatchAwaiter::await_suspend(std::coroutine_handle<> handle)
+{
+    std::lock_guard<std::mutex> lock(reader.mutex);
+    if (reader.batch_ready || reader.finished)
+    {
+        return false;
+    }
+
+    reader.waiting = handle;
+    return true;
+}
+
+std::optional<AsyncFileReader::Batch> AsyncFileReader::BatchAwaiter::await_resume()
+{
+    std::lock_guard<std::mutex> lock(reader.mutex);
+    if (!reader.batch_ready)
+    {
+        return std::nullopt;
+    }
+
+    Batch result = std::move(reader.batch);
+    reader.batch = Batch();
+    reader.batch_ready = false;
+    reader.prefetch_requested = true;
+    reader.condition.notify_one();
+
+    return result;
+}
+
+AsyncFileReader::Task AsyncFileReader::Task::promise_type::get_return_object()
+{
+    return Task(std::coroutine_handle<promise_type>::from_promise(*this));
+}
+
+AsyncFileReader::Task::Task(std::coroutine_handle<promise_type> handle) : handle(handle), completion(handle.promise().completion)
+{
+}
+
+AsyncFileReader::Task::Task(Task &&other) noexcept
+    : handle(std::exchange(other.handle, nullptr)), completion(std::move(other.completion))
+{
+}
+
+AsyncFileReader::Task::~Task()
+{
+    if (handle)
+    {
+        wait();
+        handle.destroy();
+    }
+}
+
+void AsyncFileReader::Task::wait()
+{
+    if (completion)
+    {
+        std::unique_lock<std::mutex> lock(completion->mutex);
+        completion->condition.wait(lock, [this] { return completion->done; });
+    }
+}
+
+AsyncFileReader::AsyncFileReader(const QString &filename, ReaderExecutor &executor, uint32_t batch_size)
+    : reader(filename), executor(executor), batch_size(batch_size),
+      prefetch_requested(true), batch_ready(false), finished(false), stopping(false)
+{
+    if (!reader.readSettings(settings_array))
+    {
+        qWarning() << "Failed to read settings, no waveforms will be delivered.";
+        prefetch_requested = false;
+        finished = true;
+        return;
+    }
+
+    io_thread = std::thread(&AsyncFileReader::prefetch, this);
+}
+
+AsyncFileReader::~AsyncFileReader()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    condition.notify_one();
+
+    if (io_thread.joinable())
+    {
+        io_thread.join();
+    }
+    reader.close();
+}
+
+FileValidator::ValidationError AsyncFileReader::checkErrors()
+{
+    return reader.checkErrors();
+}
+
+const QVector<device::DevicePSDSettings> &AsyncFileReader::settings() const
+{
+    return settings_array;
+}
+
+AsyncFileReader::BatchAwaiter AsyncFileReader::nextBatch()
+{
+    return BatchAwaiter(*this);
+}
+
+void AsyncFileReader::prefetch()
+{
+    while (true)
+    {
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            condition.wait(lock, [this] { return stopping || prefetch_requested; });
+
+            if (stopping)
+            {
+                return;
+            }
+            prefetch_requested = false;
+        }
+
+        Batch next;
+        bool success = reader.readWaveforms(next, batch_size);
+
+        bool done = !success || next.isEmpty();
+
+        std::coroutine_handle<> handle;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (done)
+            {
+                finished = true;
+            }
+            else
+            {
+                batch = std::move(next);
+                batch_ready = true;
+            }
+            handle = std::exchange(waiting, nullptr);
+        }
+
+        if (handle)
+        {
+            executor.post([handle] { handle.resume(); });
+        }
+
+        if (done)
+        {
+            return;
+        }
+    }
+}
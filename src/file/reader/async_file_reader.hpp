@@ -0,0 +1,131 @@
+#ifndef ASYNC_FILE_READER_HPP
+#define ASYNC_FILE_READER_HPP
+
+#include "file_reader.hpp"
+#include "reader_executor.hpp"
+
+#include <QVector>
+
+#include <atomic>
+#include <condition_variable>
+#include <coroutine>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <thread>
+
+
+// Coroutine front end for FileReader. A background thread always keeps the
+// next batch of packets decoded while the consumer works on the current one;
+// consumers are resumed through the supplied ReaderExecutor.
+//
+//     AsyncFileReader::Task consume(AsyncFileReader &reader)
+//     {
+//         while (auto batch = co_await reader.nextBatch())
+//         {
+//             process(*batch);
+//         }
+//     }
+class AsyncFileReader
+{
+public:
+    using Batch = QVector<device::WaveformPacket>;
+
+    static constexpr uint32_t default_batch_size = 4096;
+
+    class BatchAwaiter
+    {
+    public:
+        explicit BatchAwaiter(AsyncFileReader &reader);
+
+        bool await_ready();
+        bool await_suspend(std::coroutine_handle<> handle);
+        std::optional<Batch> await_resume();
+
+    private:
+        AsyncFileReader &reader;
+    };
+
+    class Task
+    {
+    public:
+        // Lives outside the coroutine frame: wait() may return and destroy
+        // the frame as soon as done is published, while the final suspend is
+        // still notifying.
+        struct Completion
+        {
+            std::mutex mutex;
+            std::condition_variable condition;
+            bool done = false;
+        };
+
+        struct promise_type
+        {
+            std::shared_ptr<Completion> completion = std::make_shared<Completion>();
+
+            Task get_return_object();
+            std::suspend_never initial_suspend() noexcept { return {}; }
+            auto final_suspend() noexcept
+            {
+                struct FinalAwaiter
+                {
+                    bool await_ready() noexcept { return false; }
+                    void await_suspend(std::coroutine_handle<promise_type> handle) noexcept
+                    {
+                        std::shared_ptr<Completion> completion = handle.promise().completion;
+                        std::lock_guard<std::mutex> lock(completion->mutex);
+                        completion->done = true;
+                        completion->condition.notify_all();
+                    }
+                    void await_resume() noexcept {}
+                };
+                return FinalAwaiter{};
+            }
+            void return_void() {}
+            void unhandled_exception() { std::terminate(); }
+        };
+
+        Task(Task &&other) noexcept;
+        ~Task();
+
+        void wait();
+
+    private:
+        explicit Task(std::coroutine_handle<promise_type> handle);
+
+        std::coroutine_handle<promise_type> handle;
+        std::shared_ptr<Completion> completion;
+    };
+
+    AsyncFileReader(const QString &filename, ReaderExecutor &executor, uint32_t batch_size = default_batch_size);
+    ~AsyncFileReader();
+
+    FileValidator::ValidationError checkErrors();
+    const QVector<device::DevicePSDSettings> &settings() const;
+
+    BatchAwaiter nextBatch();
+
+private:
+    void prefetch();
+
+private:
+    FileReader reader;
+    ReaderExecutor &executor;
+    uint32_t batch_size;
+
+    QVector<device::DevicePSDSettings> settings_array;
+
+    std::mutex mutex;
+    std::condition_variable condition;
+    bool prefetch_requested;
+    bool batch_ready;
+    bool finished;
+    bool stopping;
+
+    Batch batch;
+    std::coroutine_handle<> waiting;
+
+    std::thread io_thread;
+};
+
+#endif // ASYNC_FILE_READER_HPP
@@ -0,0 +1,81 @@
+#include "decode_pool.hpp"
+
+
+DecodePool::DecodePool(uint32_t threads)
+    : job_context(nullptr), job_invoke(nullptr), job_shares(0), next_share(0), pending(0), generation(0), stopping(false)
+{
+    for (uint32_t thread = 1; thread < threads; ++thread)
+    {
+        workers.emplace_back(&DecodePool::loop, this);
+    }
+}
+
+DecodePool::~DecodePool()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    work_ready.notify_all();
+
+    for (auto &worker : workers)
+    {
+        worker.join();
+    }
+}
+
+uint32_t DecodePool::threads() const
+{
+    return workers.size() + 1;
+}
+
+void DecodePool::dispatch(uint32_t shares, void *context, void (*invoke)(void *, uint32_t))
+{
+    std::unique_lock<std::mutex> lock(mutex);
+    job_context = context;
+    job_invoke = invoke;
+    job_shares = shares;
+    next_share = 0;
+    pending = shares;
+    ++generation;
+    work_ready.notify_all();
+
+    // The caller takes shares as well and then waits for the stragglers.
+    takeShares(lock);
+    work_done.wait(lock, [this] { return pending == 0; });
+}
+
+void DecodePool::takeShares(std::unique_lock<std::mutex> &lock)
+{
+    while (next_share < job_shares)
+    {
+        uint32_t share = next_share++;
+
+        lock.unlock();
+        job_invoke(job_context, share);
+        lock.lock();
+
+        if (--pending == 0)
+        {
+            work_done.notify_all();
+        }
+    }
+}
+
+void DecodePool::loop()
+{
+    quint64 seen = 0;
+
+    std::unique_lock<std::mutex> lock(mutex);
+    while (true)
+    {
+        work_ready.wait(lock, [this, seen] { return stopping || generation != seen; });
+        if (stopping)
+        {
+            return;
+        }
+
+        seen = generation;
+        takeShares(lock);
+    }
+}
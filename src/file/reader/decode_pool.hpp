@@ -0,0 +1,52 @@
+#ifndef DECODE_POOL_HPP
+#define DECODE_POOL_HPP
+
+#include <QtGlobal>
+
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+
+// Threads kept for the whole life of a reader that split each batch between
+// them and the calling thread. A batch neither creates threads nor allocates.
+class DecodePool
+{
+public:
+    // threads counts the calling thread, so threads - 1 are started.
+    explicit DecodePool(uint32_t threads);
+    ~DecodePool();
+
+    uint32_t threads() const;
+
+    // Calls work(share) for every share in [0, shares) and returns once all
+    // of them are done.
+    template <typename Work>
+    void run(uint32_t shares, Work &work)
+    {
+        dispatch(shares, &work, [](void *context, uint32_t share) { (*static_cast<Work *>(context))(share); });
+    }
+
+private:
+    void dispatch(uint32_t shares, void *context, void (*invoke)(void *, uint32_t));
+    void takeShares(std::unique_lock<std::mutex> &lock);
+    void loop();
+
+private:
+    std::mutex mutex;
+    std::condition_variable work_ready;
+    std::condition_variable work_done;
+
+    void *job_context;
+    void (*job_invoke)(void *, uint32_t);
+    uint32_t job_shares;
+    uint32_t next_share;
+    uint32_t pending;
+    quint64 generation;
+    bool stopping;
+
+    std::vector<std::thread> workers;
+};
+
+#endif // DECODE_POOL_HPP
@@ -1,16 +1,28 @@
 #include "file_reader.hpp"
+#include "validation_cache.hpp"
+#include "packet_decoders.hpp"
+#include "trace_events.hpp"
 
 #include <QByteArray>
 #include <QDataStream>
 #include <QCryptographicHash>
 #include <QDebug>
 
+#include <algorithm>
 
-FileReader::FileReader(QObject *parent) : QObject(parent), file(nullptr), validator(nullptr)
+
+FileReader::FileReader(QObject *parent) : QObject(parent), file(nullptr), validator(nullptr), read_mode(ReadMode::Strict), decode_threads(1), next_packet(0), next_offset(0), mapping(nullptr), mapping_size(0), time_index_loaded(false), body_validated(true)
 {
 }
 
-FileReader::FileReader(const QString &filename, QObject *parent) : QObject(parent), file(nullptr), validator(nullptr)
+FileReader::FileReader(const QString &filename, QObject *parent)
+    : QObject(parent), file(nullptr), validator(nullptr), read_mode(ReadMode::Strict), decode_threads(1), next_packet(0), next_offset(0), mapping(nullptr), mapping_size(0), time_index_loaded(false), body_validated(true)
+{
+    initialize(filename);
+}
+
+FileReader::FileReader(const QString &filename, ReadMode mode, uint32_t decode_threads, QObject *parent)
+    : QObject(parent), file(nullptr), validator(nullptr), read_mode(mode), decode_threads(std::max(decode_threads, 1u)), next_packet(0), next_offset(0), mapping(nullptr), mapping_size(0), time_index_loaded(false), body_validated(true)
 {
     initialize(filename);
 }
@@ -24,16 +36,42 @@ FileReader::~FileReader()
 
 bool FileReader::initialize(const QString &filename)
 {
-    validator = new (std::nothrow) FileValidator(filename);
-    if (!validator)
+    TRACE_SCOPE("FileReader::open");
+
+    if (!createValidator(filename))
     {
-        qWarning() << "Failed to allocate memory for FileValidator";
         return false;
     }
 
-    if (validator->validateFile() != FileValidator::ValidationError::None)
+    if (read_mode == ReadMode::TimeIndexed)
     {
-        qWarning() << "Failed to validate:" << file->errorString();
+        // A timestamped file with a matching index skips the packet walk.
+        body_validated = !(validator->validateHeader() == FileValidator::ValidationError::None &&
+                           validator->packetFormat() == framing::PacketFormat::Timestamped &&
+                           time_index.load(filename, framing::bodyOffset(validator->settingsNumber())));
+        time_index_loaded = !body_validated;
+
+        if (body_validated && !createValidator(filename))
+        {
+            return false;
+        }
+    }
+
+    if (read_mode == ReadMode::Salvage)
+    {
+        auto result = validator->salvageFile();
+        if (result == FileValidator::ValidationError::UnableToOpen ||
+            result == FileValidator::ValidationError::ReadError)
+        {
+            qWarning() << "Failed to salvage file:" << filename;
+            delete validator;
+            validator = nullptr;
+            return false;
+        }
+    }
+    else if (body_validated && validate(filename) != FileValidator::ValidationError::None)
+    {
+        qWarning() << "Failed to validate:" << filename;
         validator->close();
         delete validator;
         validator = nullptr;
@@ -63,14 +101,96 @@ bool FileReader::initialize(const QString &filename)
     return true;
 }
 
+bool FileReader::createValidator(const QString &filename)
+{
+    delete validator;
+
+    validator = new (std::nothrow) FileValidator(filename);
+    if (!validator)
+    {
+        qWarning() << "Failed to allocate memory for FileValidator";
+        return false;
+    }
+    validator->setRecordPacketOffsets(decode_threads > 1);
+
+    return true;
+}
+
+bool FileReader::validateBody()
+{
+    if (body_validated)
+    {
+        return true;
+    }
+    body_validated = true;
+
+    TRACE_SCOPE("FileReader::validateBody");
+
+    QString filename = file->fileName();
+    if (!createValidator(filename))
+    {
+        return false;
+    }
+
+    if (validate(filename) != FileValidator::ValidationError::None)
+    {
+        qWarning() << "Failed to validate:" << filename;
+        validator->close();
+        return false;
+    }
+    validator->close();
+
+    time_index_loaded = time_index.packetCount() == validator->validPacketNumber();
+    return true;
+}
+
+FileValidator::ValidationError FileReader::validate(const QString &filename)
+{
+    FileIdentity identity;
+    bool cacheable = validation_cache::isEnabled() && validation_cache::identify(filename, identity);
+
+    // A cached result carries no per-packet offsets, so it only stands in for
+    // a scan when the body is uniform or will be read serially anyway.
+    ValidationRecord record;
+    if (cacheable && validation_cache::lookup(filename, identity, record) &&
+        (record.error != FileValidator::ValidationError::None || record.uniform_size > 0 ||
+         (record.packet_format == framing::PacketFormat::Plain && decode_threads == 1)))
+    {
+        framing::PacketIndex index;
+        index.body_offset = record.body_offset;
+        index.uniform_size = record.uniform_size;
+        index.packet_count = record.valid_packets;
+        index.format = record.packet_format;
+
+        validator->restore(record.error, record.settings_number, record.valid_packets, index);
+        return record.error;
+    }
+
+    auto result = validator->validateFile();
+
+    if (cacheable)
+    {
+        const auto &index = validator->packetIndex();
+        validation_cache::store(filename, identity, { result, static_cast<uint16_t>(validator->settingsNumber()),
+                                                      validator->validPacketNumber(), validator->packetFormat(),
+                                                      index.body_offset, index.uniform_size });
+    }
+
+    return result;
+}
+
 bool FileReader::readSettings(QVector<device::DevicePSDSettings> &settings)
 {
-    if (checkErrors() != FileValidator::ValidationError::None)
+    TRACE_SCOPE("FileReader::readSettings");
+
+    auto error = checkErrors();
+    if (error != FileValidator::ValidationError::None &&
+        error != FileValidator::ValidationError::MalformedWaveformPacket)
     {
         return false;
     }
 
-    if (!file->isOpen())
+    if (!file || !file->isOpen())
     {
         qWarning() << "File is not open for reading.";
         return false;
@@ -84,9 +204,7 @@ bool FileReader::readSettings(QVector<device::DevicePSDSettings> &settings)
 
     for (uint16_t index = 0; index < settings_size; ++index)
     {
-        device::DevicePSDSettings settings_temp;
-        in >> settings_temp;
-        settings.append(settings_temp);
+        in >> settings.emplace_back();
     }
 
     file->seek(10 + (settings_size * 46) + 16); // 10 - 64 bits for signature + 16 bits for settings size
@@ -98,47 +216,373 @@ bool FileReader::readSettings(QVector<device::DevicePSDSettings> &settings)
 
 bool FileReader::readWaveforms(QVector<device::WaveformPacket> &waveforms)
 {
+    if (!validator)
+    {
+        qWarning() << "File is not open for reading.";
+        return false;
+    }
+
+    return readWaveforms(waveforms, validator->validPacketNumber());
+}
+
+bool FileReader::readWaveforms(QVector<device::WaveformPacket> &waveforms, uint32_t max_count)
+{
+    if (!validator || !validateBody())
+    {
+        qWarning() << "File is not open for reading.";
+        return false;
+    }
+
+    // Packets are decoded in place into the grown vector, never through a
+    // temporary that would then be copied in.
+    uint32_t count = std::min(max_count, validator->validPacketNumber() - next_packet);
+    qsizetype first_slot = waveforms.size();
+    waveforms.resize(first_slot + count);
+
+    uint32_t read_count = 0;
+    bool result = readWaveforms(std::span<device::WaveformPacket>(waveforms.data() + first_slot, count), read_count);
+
+    waveforms.resize(first_slot + read_count);
+    return result;
+}
+
+bool FileReader::readWaveforms(std::span<device::WaveformPacket> waveforms, uint32_t &read_count)
+{
+    TRACE_SCOPE("FileReader::readWaveforms");
+
+    read_count = 0;
+
+    // Salvaged packets do not depend on the header that was found damaged.
     auto error = checkErrors();
+    bool damaged_header = read_mode == ReadMode::Salvage &&
+                          (error == FileValidator::ValidationError::InvalidSignature ||
+                           error == FileValidator::ValidationError::WrongHeaderHash);
     if (error != FileValidator::ValidationError::None &&
-        error != FileValidator::ValidationError::MalformedWaveformPacket)
+        error != FileValidator::ValidationError::MalformedWaveformPacket && !damaged_header)
     {
         return false;
     }
 
-    if (!file->isOpen())
+    if (!validator || !file || !file->isOpen() || !validateBody())
     {
         qWarning() << "File is not open for reading.";
         return false;
     }
 
-    uint32_t valid_packages = validator->validPacketNumber();
-    waveforms.reserve(valid_packages);
+    waveforms = waveforms.first(std::min<size_t>(waveforms.size(), validator->validPacketNumber() - next_packet));
+
+    const auto &index = validator->packetIndex();
+    if (decode_threads > 1 || index.isUniform() ||
+        (index.format == framing::PacketFormat::Timestamped && index.isAddressable()))
+    {
+        return readIndexedWaveforms(waveforms, read_count);
+    }
+
+    if (read_mode == ReadMode::Salvage)
+    {
+        return readSalvagedWaveforms(waveforms, read_count);
+    }
+
+    return readSerialWaveforms(waveforms, read_count);
+}
+
+bool FileReader::readSerialWaveforms(std::span<device::WaveformPacket> waveforms, uint32_t &read_count)
+{
+    if (next_packet == 0)
+    {
+        next_offset = framing::bodyOffset(validator->settingsNumber());
+    }
+
+    // Timestamped packets are framed straight from the mapping, so their
+    // offsets need not be recorded during validation.
+    if (validator->packetFormat() == framing::PacketFormat::Timestamped)
+    {
+        const uchar *data = mappedData();
+        if (!data)
+        {
+            return false;
+        }
+
+        for (auto &waveform : waveforms)
+        {
+            qint64 packet_size = (next_offset < mapping_size)
+                                     ? framing::frameAt(data + next_offset, mapping_size - next_offset, framing::PacketFormat::Timestamped)
+                                     : 0;
+            if (packet_size == 0)
+            {
+                qWarning() << "Malformed waveform packet at offset" << next_offset;
+                return false;
+            }
+
+            framing::decodeTimestampedPacket(data + next_offset, waveform);
+            next_offset += packet_size;
+
+            ++read_count;
+            ++next_packet;
+        }
+
+        return true;
+    }
 
-    for (uint32_t index = 0; index < valid_packages; ++index)
+    if (!file->seek(next_offset))
     {
-        QByteArray buffer;
-        QDataStream in(file);
+        qWarning() << "Failed to seek to waveform" << next_packet;
+        return false;
+    }
+
+    QDataStream in(file);
+    char magic[framing::magic_size];
 
-        buffer.resize(4);
-        if (in.readRawData(buffer.data(), 4) != 4)
+    for (auto &waveform : waveforms)
+    {
+        if (in.readRawData(magic, framing::magic_size) != framing::magic_size)
         {
             qWarning() << "Failed to read waveform prefix";
             return false;
         }
 
-        device::WaveformPacket waveform_temp;
-        in >> waveform_temp;
+        // Reuses the capacity of the values the caller passed in.
+        in >> waveform;
 
-        buffer.resize(4);
-        if (in.readRawData(buffer.data(), 4) != 4)
+        if (in.readRawData(magic, framing::magic_size) != framing::magic_size)
         {
             qWarning() << "Failed to read waveform postfix";
             return false;
         }
 
-        waveforms.append(waveform_temp);
+        ++read_count;
+        ++next_packet;
     }
 
+    next_offset = file->pos();
+    return true;
+}
+
+bool FileReader::readWaveforms(QVector<device::WaveformPacket> &waveforms, quint64 from, quint64 to)
+{
+    TRACE_SCOPE("FileReader::readTimeRange");
+
+    if (!validator || !file || !file->isOpen())
+    {
+        qWarning() << "File is not open for reading.";
+        return false;
+    }
+
+    if (validator->packetFormat() != framing::PacketFormat::Timestamped)
+    {
+        qWarning() << "File has no packet timestamps.";
+        return false;
+    }
+
+    const auto &index = validator->packetIndex();
+
+    // Without a usable sidecar every packet is a candidate.
+    qsizetype first_block = 0;
+    qsizetype last_block = 0;
+    bool indexed = time_index_loaded || loadTimeIndex();
+    if (indexed && !time_index.find(from, to, first_block, last_block))
+    {
+        return true;
+    }
+
+    const uchar *data = mappedData();
+    if (!data)
+    {
+        return false;
+    }
+    qint64 file_size = mapping_size;
+
+    auto readPacket = [&](const uchar *packet) {
+        quint64 timestamp = framing::PacketView{ packet, 0, framing::PacketFormat::Timestamped }.timestamp();
+        if (timestamp >= from && timestamp <= to)
+        {
+            waveforms.append(device::WaveformPacket());
+            framing::decodeTimestampedPacket(packet, waveforms.last());
+        }
+    };
+
+    // Blocks without recorded offsets, or of a file that was not walked up
+    // front, are framed here and only as far as the query needs them.
+    auto readBlock = [&](const TimeIndexEntry &entry, quint64 packets) {
+        if (body_validated && index.isAddressable())
+        {
+            if (entry.first_packet + packets > static_cast<quint64>(index.packet_count))
+            {
+                return false;
+            }
+
+            for (qint64 packet = entry.first_packet; packet < static_cast<qint64>(entry.first_packet + packets); ++packet)
+            {
+                readPacket(data + index.offset(packet));
+            }
+            return true;
+        }
+
+        qint64 position = entry.offset;
+        if (position < framing::bodyOffset(validator->settingsNumber()))
+        {
+            return false;
+        }
+
+        for (quint64 packet = 0; packet < packets; ++packet)
+        {
+            qint64 packet_size = (position < file_size)
+                                     ? framing::frameAt(data + position, file_size - position, framing::PacketFormat::Timestamped)
+                                     : 0;
+            if (packet_size == 0)
+            {
+                return false;
+            }
+
+            readPacket(data + position);
+            position += packet_size;
+        }
+        return true;
+    };
+
+    bool result = true;
+    if (indexed)
+    {
+        const auto &blocks = time_index.entries();
+        for (qsizetype block = first_block; block < last_block && result; ++block)
+        {
+            const auto &entry = blocks.at(block);
+            if (entry.max_timestamp < from || entry.min_timestamp > to)
+            {
+                continue;
+            }
+
+            result = readBlock(entry, time_index.blockPackets(block));
+            if (!result)
+            {
+                qWarning() << "Malformed waveform packet in time index block" << block << "of" << file->fileName();
+            }
+        }
+    }
+    else
+    {
+        result = readBlock(TimeIndexEntry{ 0, index.body_offset, 0, 0 }, index.packet_count);
+        if (!result)
+        {
+            qWarning() << "Malformed waveform packet in" << file->fileName();
+        }
+    }
+
+    return result;
+}
+
+bool FileReader::loadTimeIndex()
+{
+    // The index describes packet numbers, so it must cover exactly the packets
+    // the validator found.
+    time_index_loaded = time_index.load(file->fileName(), framing::bodyOffset(validator->settingsNumber())) &&
+                        time_index.packetCount() == validator->validPacketNumber();
+
+    if (!time_index_loaded)
+    {
+        qWarning() << "No usable time index for" << file->fileName() << "- scanning all packets.";
+    }
+
+    return time_index_loaded;
+}
+
+bool FileReader::atEnd() const
+{
+    return !validator || next_packet >= validPacketNumber();
+}
+
+bool FileReader::readSalvagedWaveforms(std::span<device::WaveformPacket> waveforms, uint32_t &read_count)
+{
+    TRACE_SCOPE("FileReader::readSalvagedWaveforms");
+
+    const auto &offsets = validator->packetOffsets();
+
+    QDataStream in(file);
+    for (auto &waveform : waveforms)
+    {
+        qint64 offset = offsets.at(next_packet);
+        if (!file->seek(offset + framing::magic_size))
+        {
+            qWarning() << "Failed to seek to salvaged waveform at" << offset;
+            return false;
+        }
+
+        in >> waveform;
+
+        if (in.status() != QDataStream::Ok)
+        {
+            qWarning() << "Failed to read salvaged waveform at" << offset;
+            return false;
+        }
+
+        ++read_count;
+        ++next_packet;
+    }
+
+    return true;
+}
+
+bool FileReader::readIndexedWaveforms(std::span<device::WaveformPacket> waveforms, uint32_t &read_count)
+{
+    TRACE_SCOPE("FileReader::readIndexedWaveforms");
+
+    const auto &index = validator->packetIndex();
+    if (!index.isAddressable())
+    {
+        qWarning() << "Packet offsets were not recorded during validation.";
+        return false;
+    }
+
+    uint32_t count = waveforms.size();
+    if (count == 0)
+    {
+        return true;
+    }
+
+    const uchar *data = mappedData();
+    if (!data)
+    {
+        return false;
+    }
+
+    // Workers decode straight into their own slots of the output, so the
+    // result is ordered exactly like the serial path.
+    device::WaveformPacket *slots = waveforms.data();
+    uint32_t first_packet = next_packet;
+    framing::PacketDecoder decoder = framing::decoderFor(index);
+
+    auto decodeRange = [data, slots, first_packet, decoder, &index](uint32_t begin, uint32_t end) {
+        TRACE_SCOPE("FileReader::decode");
+
+        for (uint32_t packet = begin; packet < end; ++packet)
+        {
+            decoder(data + index.offset(first_packet + packet), slots[packet]);
+        }
+    };
+
+    uint32_t threads = std::min(decode_threads, count);
+    if (threads == 1)
+    {
+        decodeRange(0, count);
+    }
+    else
+    {
+        if (!decode_pool)
+        {
+            decode_pool = std::make_unique<DecodePool>(decode_threads);
+        }
+
+        uint32_t packets_per_thread = (count + threads - 1) / threads;
+        auto decodeShare = [&decodeRange, count, packets_per_thread](uint32_t share) {
+            uint32_t begin = share * packets_per_thread;
+            decodeRange(begin, std::min(count, begin + packets_per_thread));
+        };
+        decode_pool->run((count + packets_per_thread - 1) / packets_per_thread, decodeShare);
+    }
+
+    next_packet += count;
+    read_count = count;
+
     return true;
 }
 
@@ -149,11 +593,67 @@ FileValidator::ValidationError FileReader::checkErrors()
         return validator->errors();
     }
 
-    return FileValidator::ValidationError::None;
+    // A file that failed to open or validate leaves no validator behind.
+    return FileValidator::ValidationError::UnableToOpen;
+}
+
+uint32_t FileReader::validPacketNumber() const
+{
+    if (validator != nullptr)
+    {
+        return body_validated ? validator->validPacketNumber() : static_cast<uint32_t>(time_index.packetCount());
+    }
+
+    return 0;
+}
+
+framing::PacketFormat FileReader::packetFormat() const
+{
+    if (validator != nullptr)
+    {
+        return validator->packetFormat();
+    }
+
+    return framing::PacketFormat::Plain;
+}
+
+QVector<framing::ByteRange> FileReader::corruptedRanges() const
+{
+    if (validator != nullptr)
+    {
+        return validator->corruptedRanges();
+    }
+
+    return {};
+}
+
+const uchar *FileReader::mappedData()
+{
+    if (!mapping)
+    {
+        mapping_size = file->size();
+        mapping = file->map(0, mapping_size);
+        if (!mapping)
+        {
+            qWarning() << "Failed to map file for decoding:" << file->errorString();
+            mapping_size = 0;
+        }
+    }
+
+    return mapping;
 }
 
 void FileReader::close()
 {
+    decode_pool.reset();
+
+    if (file && mapping)
+    {
+        file->unmap(mapping);
+    }
+    mapping = nullptr;
+    mapping_size = 0;
+
     if (file && file->isOpen())
     {
         file->close();
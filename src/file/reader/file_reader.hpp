@@ -4,6 +4,8 @@
 #include "header_structure.hpp"
 #include "packet_structure.hpp"
 #include "file_validator.hpp"
+#include "time_index.hpp"
+#include "decode_pool.hpp"
 
 #include <QString>
 #include <QByteArray>
@@ -11,27 +13,75 @@
 #include <QFile>
 #include <QDateTime>
 
+#include <memory>
+#include <span>
+
 class FileReader : QObject
 {
     Q_OBJECT
 public:
+    enum class ReadMode
+    {
+        Strict,
+        Salvage,
+        // Checks the header up front and, for time range reads, only the
+        // packets of the index blocks they touch. Sequential reads validate
+        // the whole file first. Needs a matching .dgst, otherwise Strict.
+        TimeIndexed
+    };
+
     explicit FileReader(QObject *parent = nullptr);
     explicit FileReader(const QString &filename, QObject *parent = nullptr);
+    explicit FileReader(const QString &filename, ReadMode mode, uint32_t decode_threads = 1, QObject *parent = nullptr);
     ~FileReader();
 
     bool readSettings(QVector<device::DevicePSDSettings> &settings);
     bool readWaveforms(QVector<device::WaveformPacket> &waveform);
+    bool readWaveforms(QVector<device::WaveformPacket> &waveform, uint32_t max_count);
+    // Decodes the next packets into the caller's packets, reusing their sample
+    // buffers; read_count tells how many of them were filled.
+    bool readWaveforms(std::span<device::WaveformPacket> waveforms, uint32_t &read_count);
+    // Appends the packets stamped within [from, to] of a timestamped file,
+    // independently of the sequential read position.
+    bool readWaveforms(QVector<device::WaveformPacket> &waveforms, quint64 from, quint64 to);
+    bool atEnd() const;
 
     FileValidator::ValidationError checkErrors();
+    uint32_t validPacketNumber() const;
+    framing::PacketFormat packetFormat() const;
+    QVector<framing::ByteRange> corruptedRanges() const;
 
     void close();
 
 private:
     bool initialize(const QString &filename);
+    bool createValidator(const QString &filename);
+    bool validateBody();
+    FileValidator::ValidationError validate(const QString &filename);
+    bool readSerialWaveforms(std::span<device::WaveformPacket> waveforms, uint32_t &read_count);
+    bool readSalvagedWaveforms(std::span<device::WaveformPacket> waveforms, uint32_t &read_count);
+    bool readIndexedWaveforms(std::span<device::WaveformPacket> waveforms, uint32_t &read_count);
+    bool loadTimeIndex();
+    const uchar *mappedData();
 
 private:
     QFile *file;
     FileValidator *validator;
+    ReadMode read_mode;
+    uint32_t decode_threads;
+
+    uint32_t next_packet;
+    qint64 next_offset;
+
+    // Mapped on the first mapped read and kept until close(), together with
+    // the decode threads, so batches pay for neither again.
+    uchar *mapping;
+    qint64 mapping_size;
+    std::unique_ptr<DecodePool> decode_pool;
+
+    TimeIndex time_index;
+    bool time_index_loaded;
+    bool body_validated;
 };
 
 #endif // FILE_READER_HPP
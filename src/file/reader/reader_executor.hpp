@@ -0,0 +1,43 @@
+#ifndef READER_EXECUTOR_HPP
+#define READER_EXECUTOR_HPP
+
+#include <QtGlobal>
+
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <queue>
+#include <thread>
+
+
+// Runs coroutine continuations of AsyncFileReader consumers. Implement post()
+// on top of an event loop to resume consumers on the loop thread instead.
+class ReaderExecutor
+{
+public:
+    virtual ~ReaderExecutor() = default;
+
+    virtual void post(std::function<void()> task) = 0;
+};
+
+class ThreadReaderExecutor : public ReaderExecutor
+{
+public:
+    ThreadReaderExecutor();
+    ~ThreadReaderExecutor() override;
+
+    void post(std::function<void()> task) override;
+
+private:
+    void run();
+
+private:
+    std::mutex mutex;
+    std::condition_variable condition;
+    std::queue<std::function<void()>> tasks;
+    bool stopping;
+
+    std::thread worker;
+};
+
+#endif // READER_EXECUTOR_HPP
@@ -0,0 +1,168 @@
+#include "segmented_file_reader.hpp"
+#include "validation_defines.hpp"
+
+#include <QFile>
+#include <QFileInfo>
+#include <QDir>
+#include <QDebug>
+
+
+SegmentedFileReader::SegmentedFileReader(const QString &manifest_filename, QObject *parent)
+    : QObject(parent), segment_index(-1)
+{
+    initialize(manifest_filename);
+}
+
+SegmentedFileReader::~SegmentedFileReader()
+{
+    close();
+}
+
+bool SegmentedFileReader::readSettings(QVector<device::DevicePSDSettings> &settings)
+{
+    if (!current)
+    {
+        qWarning() << "No segment is open for reading.";
+        return false;
+    }
+
+    settings.append(settings_array);
+    return true;
+}
+
+bool SegmentedFileReader::readWaveforms(QVector<device::WaveformPacket> &waveforms)
+{
+    while (!atEnd())
+    {
+        if (!readWaveforms(waveforms, std::numeric_limits<uint32_t>::max()))
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+bool SegmentedFileReader::readWaveforms(QVector<device::WaveformPacket> &waveforms, uint32_t max_count)
+{
+    qsizetype initial_size = waveforms.size();
+
+    while (current && static_cast<uint32_t>(waveforms.size() - initial_size) < max_count)
+    {
+        if (current->atEnd())
+        {
+            if (segment_index + 1 >= segments.size())
+            {
+                break;
+            }
+
+            if (!openSegment(segment_index + 1))
+            {
+                return false;
+            }
+            continue;
+        }
+
+        if (!current->readWaveforms(waveforms, max_count - (waveforms.size() - initial_size)))
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+bool SegmentedFileReader::atEnd() const
+{
+    return !current || (current->atEnd() && segment_index + 1 >= segments.size());
+}
+
+FileValidator::ValidationError SegmentedFileReader::checkErrors()
+{
+    if (current)
+    {
+        return current->checkErrors();
+    }
+
+    return FileValidator::ValidationError::UnableToOpen;
+}
+
+QStringList SegmentedFileReader::segmentFilenames() const
+{
+    return segments;
+}
+
+void SegmentedFileReader::close()
+{
+    if (current)
+    {
+        current->close();
+        current.reset();
+    }
+}
+
+bool SegmentedFileReader::initialize(const QString &manifest_filename)
+{
+    QFile manifest(manifest_filename);
+    if (!manifest.open(QIODevice::ReadOnly))
+    {
+        qWarning() << "Failed to open manifest for reading:" << manifest.errorString();
+        return false;
+    }
+
+    if (manifest.readLine().trimmed() != default_manifest_header.toUtf8())
+    {
+        qWarning() << "Wrong manifest header in" << manifest_filename;
+        return false;
+    }
+
+    QDir directory = QFileInfo(manifest_filename).dir();
+    while (!manifest.atEnd())
+    {
+        auto line = manifest.readLine().trimmed();
+        if (line.isEmpty())
+        {
+            continue;
+        }
+
+        auto name = QString::fromUtf8(line.left(line.indexOf('\t')));
+        segments.append(directory.filePath(name));
+    }
+
+    if (segments.isEmpty())
+    {
+        qWarning() << "Manifest lists no segments:" << manifest_filename;
+        return false;
+    }
+
+    return openSegment(0);
+}
+
+bool SegmentedFileReader::openSegment(qsizetype index)
+{
+    close();
+
+    current = std::make_unique<FileReader>(segments.at(index));
+    segment_index = index;
+
+    QVector<device::DevicePSDSettings> segment_settings;
+    if (!current->readSettings(segment_settings))
+    {
+        qWarning() << "Failed to open segment" << segments.at(index);
+        current.reset();
+        return false;
+    }
+
+    if (index == 0)
+    {
+        settings_array = segment_settings;
+    }
+    else if (segment_settings != settings_array)
+    {
+        qWarning() << "Segment" << segments.at(index) << "has different settings than the stream.";
+        current.reset();
+        return false;
+    }
+
+    return true;
+}
@@ -0,0 +1,44 @@
+#ifndef SEGMENTED_FILE_READER_HPP
+#define SEGMENTED_FILE_READER_HPP
+
+#include "file_reader.hpp"
+
+#include <QString>
+#include <QStringList>
+#include <QObject>
+
+#include <memory>
+
+
+// Reads the segments listed in a SegmentedFileWriter manifest as a single
+// stream. Segments are opened (and validated) one at a time, in order.
+class SegmentedFileReader : QObject
+{
+    Q_OBJECT
+public:
+    explicit SegmentedFileReader(const QString &manifest_filename, QObject *parent = nullptr);
+    ~SegmentedFileReader();
+
+    bool readSettings(QVector<device::DevicePSDSettings> &settings);
+    bool readWaveforms(QVector<device::WaveformPacket> &waveforms);
+    bool readWaveforms(QVector<device::WaveformPacket> &waveforms, uint32_t max_count);
+    bool atEnd() const;
+
+    FileValidator::ValidationError checkErrors();
+    QStringList segmentFilenames() const;
+
+    void close();
+
+private:
+    bool initialize(const QString &manifest_filename);
+    bool openSegment(qsizetype index);
+
+private:
+    QStringList segments;
+    qsizetype segment_index;
+
+    std::unique_ptr<FileReader> current;
+    QVector<device::DevicePSDSettings> settings_array;
+};
+
+#endif // SEGMENTED_FILE_READER_HPP
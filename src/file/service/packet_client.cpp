@@ -0,0 +1,344 @@
+#include "packet_client.hpp"
+
+#include <QFile>
+#include <QFileInfo>
+#include <QDebug>
+
+#include <cerrno>
+#include <cstring>
+
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+
+PacketSlice::PacketSlice()
+    : query_status(service::QueryStatus::Ok), format(framing::PacketFormat::Plain), settings_number(0), file_packets(0),
+      packet_count(0), mapping(nullptr), mapping_size(0)
+{
+}
+
+PacketSlice::~PacketSlice()
+{
+    release();
+}
+
+service::QueryStatus PacketSlice::status() const
+{
+    return query_status;
+}
+
+framing::PacketFormat PacketSlice::packetFormat() const
+{
+    return format;
+}
+
+uint16_t PacketSlice::settingsNumber() const
+{
+    return settings_number;
+}
+
+quint64 PacketSlice::filePackets() const
+{
+    return file_packets;
+}
+
+quint64 PacketSlice::packets() const
+{
+    return packet_count;
+}
+
+const uchar *PacketSlice::data() const
+{
+    return mapping;
+}
+
+const QVector<framing::ByteRange> &PacketSlice::ranges() const
+{
+    return packet_ranges;
+}
+
+bool PacketSlice::readWaveforms(QVector<device::WaveformPacket> &waveforms) const
+{
+    if (!mapping && !packet_ranges.isEmpty())
+    {
+        qWarning() << "Slice is not mapped.";
+        return false;
+    }
+
+    waveforms.reserve(waveforms.size() + packet_count);
+
+    for (const auto &range : packet_ranges)
+    {
+        const uchar *position = mapping + range.offset;
+        const uchar *end = position + range.length;
+
+        while (position < end)
+        {
+            qint64 packet_size = framing::frameAt(position, end - position, format);
+            if (packet_size == 0)
+            {
+                qWarning() << "Malformed packet in served range at offset" << (position - mapping);
+                return false;
+            }
+
+            if (format == framing::PacketFormat::Timestamped)
+            {
+                framing::decodeTimestampedPacket(position, waveforms.emplace_back());
+            }
+            else
+            {
+                framing::decodePacket(position, waveforms.emplace_back());
+            }
+
+            position += packet_size;
+        }
+    }
+
+    return true;
+}
+
+void PacketSlice::release()
+{
+    if (mapping)
+    {
+        ::munmap(mapping, mapping_size);
+    }
+
+    mapping = nullptr;
+    mapping_size = 0;
+    packet_count = 0;
+    packet_ranges.clear();
+}
+
+PacketClient::PacketClient(QObject *parent) : QObject(parent), connection(-1)
+{
+}
+
+PacketClient::~PacketClient()
+{
+    close();
+}
+
+bool PacketClient::connectToServer(const QString &socket_path)
+{
+    close();
+
+    QByteArray path = QFile::encodeName(socket_path);
+
+    sockaddr_un address{};
+    if (path.isEmpty() || path.size() >= static_cast<qsizetype>(sizeof(address.sun_path)))
+    {
+        qWarning() << "Invalid socket path:" << socket_path;
+        return false;
+    }
+
+    address.sun_family = AF_UNIX;
+    std::memcpy(address.sun_path, path.constData(), path.size());
+
+    connection = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (connection < 0 || ::connect(connection, reinterpret_cast<sockaddr *>(&address), sizeof(address)) != 0)
+    {
+        qWarning() << "Failed to connect to" << socket_path << ":" << std::strerror(errno);
+        close();
+        return false;
+    }
+
+    return true;
+}
+
+bool PacketClient::info(const QString &filename, PacketSlice &slice)
+{
+    return query(filename, service::QueryKind::Info, 0, 0, 0, slice);
+}
+
+bool PacketClient::packet(const QString &filename, quint64 packet, PacketSlice &slice)
+{
+    return query(filename, service::QueryKind::Packet, 0, packet, 1, slice);
+}
+
+bool PacketClient::range(const QString &filename, quint64 first, quint64 count, PacketSlice &slice)
+{
+    return query(filename, service::QueryKind::Range, 0, first, count, slice);
+}
+
+bool PacketClient::channel(const QString &filename, uint16_t channel, PacketSlice &slice, quint64 first, quint64 count)
+{
+    return query(filename, service::QueryKind::Channel, channel, first, count, slice);
+}
+
+void PacketClient::close()
+{
+    if (connection >= 0)
+    {
+        ::close(connection);
+        connection = -1;
+    }
+}
+
+bool PacketClient::query(const QString &filename, service::QueryKind kind, uint16_t channel, quint64 first, quint64 count, PacketSlice &slice)
+{
+    slice.release();
+
+    if (connection < 0)
+    {
+        qWarning() << "Not connected to a packet server.";
+        return false;
+    }
+
+    // The server resolves paths against its own working directory.
+    QByteArray path = QFileInfo(filename).absoluteFilePath().toUtf8();
+    service::QueryRequest request{ service::request_magic, static_cast<quint16>(kind), channel, first, count,
+                                   static_cast<quint32>(path.size()), 0 };
+
+    if (::send(connection, &request, sizeof(request), MSG_NOSIGNAL | MSG_MORE) != static_cast<ssize_t>(sizeof(request)) ||
+        ::send(connection, path.constData(), path.size(), MSG_NOSIGNAL) != path.size())
+    {
+        qWarning() << "Failed to send query:" << std::strerror(errno);
+        close();
+        return false;
+    }
+
+    service::QueryResponse response;
+    int descriptor = -1;
+    if (!receiveResponse(response, descriptor))
+    {
+        close();
+        return false;
+    }
+
+    slice.query_status = static_cast<service::QueryStatus>(response.status);
+    if (slice.query_status != service::QueryStatus::Ok)
+    {
+        return false;
+    }
+
+    slice.format = static_cast<framing::PacketFormat>(response.format);
+    slice.settings_number = response.settings_number;
+    slice.file_packets = response.file_packets;
+    slice.packet_count = response.packets;
+
+    slice.packet_ranges.resize(response.range_count);
+    char *ranges = reinterpret_cast<char *>(slice.packet_ranges.data());
+    qint64 remaining = response.range_count * static_cast<qint64>(sizeof(framing::ByteRange));
+
+    while (remaining > 0)
+    {
+        ssize_t received = ::recv(connection, ranges, remaining, 0);
+        if (received < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if (received <= 0)
+        {
+            qWarning() << "Failed to receive packet ranges.";
+            ::close(descriptor);
+            slice.release();
+            close();
+            return false;
+        }
+
+        ranges += received;
+        remaining -= received;
+    }
+
+    // The mapping keeps the file referenced once the descriptor is closed.
+    struct stat status;
+    if (::fstat(descriptor, &status) == 0 && status.st_size > 0)
+    {
+        void *mapping = ::mmap(nullptr, status.st_size, PROT_READ, MAP_SHARED, descriptor, 0);
+        if (mapping != MAP_FAILED)
+        {
+            slice.mapping = static_cast<uchar *>(mapping);
+            slice.mapping_size = status.st_size;
+        }
+    }
+    ::close(descriptor);
+
+    if (!slice.mapping && !slice.packet_ranges.isEmpty())
+    {
+        qWarning() << "Failed to map served file:" << filename;
+        slice.release();
+        return false;
+    }
+
+    // Ranges are only ever read through the mapping, so none may leave it.
+    for (const auto &range : slice.packet_ranges)
+    {
+        if (range.offset < 0 || range.length < 0 || range.offset > slice.mapping_size ||
+            range.length > slice.mapping_size - range.offset)
+        {
+            qWarning() << "Packet server answered with a range outside of" << filename;
+            slice.release();
+            return false;
+        }
+    }
+
+    return true;
+}
+
+bool PacketClient::receiveResponse(service::QueryResponse &response, int &descriptor)
+{
+    char *bytes = reinterpret_cast<char *>(&response);
+    qint64 remaining = sizeof(response);
+
+    while (remaining > 0)
+    {
+        iovec vector{ bytes, static_cast<size_t>(remaining) };
+
+        alignas(cmsghdr) char control[CMSG_SPACE(sizeof(int))] = {};
+        msghdr message{};
+        message.msg_iov = &vector;
+        message.msg_iovlen = 1;
+        message.msg_control = control;
+        message.msg_controllen = sizeof(control);
+
+        ssize_t received = ::recvmsg(connection, &message, MSG_CMSG_CLOEXEC);
+        if (received < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if (received <= 0)
+        {
+            qWarning() << "Failed to receive query response.";
+            if (descriptor >= 0)
+            {
+                ::close(descriptor);
+                descriptor = -1;
+            }
+            return false;
+        }
+
+        for (cmsghdr *header = CMSG_FIRSTHDR(&message); header; header = CMSG_NXTHDR(&message, header))
+        {
+            if (header->cmsg_level == SOL_SOCKET && header->cmsg_type == SCM_RIGHTS)
+            {
+                std::memcpy(&descriptor, CMSG_DATA(header), sizeof(int));
+            }
+        }
+
+        bytes += received;
+        remaining -= received;
+    }
+
+    if (response.magic != service::response_magic)
+    {
+        qWarning() << "Unexpected response from packet server.";
+        if (descriptor >= 0)
+        {
+            ::close(descriptor);
+            descriptor = -1;
+        }
+        return false;
+    }
+
+    if (response.status == static_cast<qint32>(service::QueryStatus::Ok) && descriptor < 0)
+    {
+        qWarning() << "Packet server answered without a file descriptor.";
+        return false;
+    }
+
+    return true;
+}
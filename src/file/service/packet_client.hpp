@@ -0,0 +1,77 @@
+#ifndef PACKET_CLIENT_HPP
+#define PACKET_CLIENT_HPP
+
+#include "packet_protocol.hpp"
+#include "packet_structure.hpp"
+#include "packet_framing.hpp"
+
+#include <QString>
+#include <QObject>
+#include <QVector>
+
+
+// Answer of a PacketServer query: the byte ranges of the requested packets in
+// a read-only mapping of the served file. The mapping shares the page cache
+// with the server and every other client; nothing is copied until decoded.
+class PacketSlice
+{
+public:
+    PacketSlice();
+    ~PacketSlice();
+
+    PacketSlice(const PacketSlice &) = delete;
+    PacketSlice &operator=(const PacketSlice &) = delete;
+
+    service::QueryStatus status() const;
+    framing::PacketFormat packetFormat() const;
+    uint16_t settingsNumber() const;
+    quint64 filePackets() const;
+    quint64 packets() const;
+
+    const uchar *data() const;
+    const QVector<framing::ByteRange> &ranges() const;
+
+    // Appends the packets of all ranges, in file order.
+    bool readWaveforms(QVector<device::WaveformPacket> &waveforms) const;
+
+    void release();
+
+private:
+    friend class PacketClient;
+
+    service::QueryStatus query_status;
+    framing::PacketFormat format;
+    uint16_t settings_number;
+    quint64 file_packets;
+    quint64 packet_count;
+
+    uchar *mapping;
+    qint64 mapping_size;
+    QVector<framing::ByteRange> packet_ranges;
+};
+
+class PacketClient : public QObject
+{
+    Q_OBJECT
+public:
+    explicit PacketClient(QObject *parent = nullptr);
+    ~PacketClient();
+
+    bool connectToServer(const QString &socket_path);
+
+    bool info(const QString &filename, PacketSlice &slice);
+    bool packet(const QString &filename, quint64 packet, PacketSlice &slice);
+    bool range(const QString &filename, quint64 first, quint64 count, PacketSlice &slice);
+    bool channel(const QString &filename, uint16_t channel, PacketSlice &slice, quint64 first = 0, quint64 count = 0);
+
+    void close();
+
+private:
+    bool query(const QString &filename, service::QueryKind kind, uint16_t channel, quint64 first, quint64 count, PacketSlice &slice);
+    bool receiveResponse(service::QueryResponse &response, int &descriptor);
+
+private:
+    int connection;
+};
+
+#endif // PACKET_CLIENT_HPP
@@ -0,0 +1,61 @@
+#ifndef PACKET_PROTOCOL_HPP
+#define PACKET_PROTOCOL_HPP
+
+#include <QtGlobal>
+
+
+// Wire format between PacketServer and PacketClient. Both ends run on the same
+// host, so the structs travel in native byte order.
+//
+// A request is a QueryRequest followed by path_size bytes of the UTF-8 file
+// path. The answer is a QueryResponse followed by range_count ByteRange
+// records of packet bytes. Successful answers carry a read-only descriptor of
+// the .dgs file as SCM_RIGHTS ancillary data, so clients map the very pages
+// the server and every other client share instead of receiving a copy.
+namespace service
+{
+constexpr quint32 request_magic  = 0x51534744; // "DGSQ"
+constexpr quint32 response_magic = 0x41534744; // "DGSA"
+constexpr quint32 max_path_size  = 4096;
+
+enum class QueryKind : quint16
+{
+    Info,    // header facts only
+    Packet,  // packet number first
+    Range,   // count packets from packet number first, 0 - to the end
+    Channel  // count packets of channel from its packet number first, 0 - all
+};
+
+enum class QueryStatus : qint32
+{
+    Ok,
+    BadRequest,
+    InvalidFile,
+    OutOfRange,
+    UnknownChannel
+};
+
+struct QueryRequest
+{
+    quint32 magic;
+    quint16 kind;
+    quint16 channel;
+    quint64 first;
+    quint64 count;
+    quint32 path_size;
+    quint32 reserved;
+};
+
+struct QueryResponse
+{
+    quint32 magic;
+    qint32 status;
+    quint32 format;
+    quint32 settings_number;
+    quint64 file_packets;
+    quint64 packets;
+    quint64 range_count;
+};
+} // namespace service
+
+#endif // PACKET_PROTOCOL_HPP
@@ -0,0 +1,505 @@
+#include "packet_server.hpp"
+#include "file_validator.hpp"
+#include "trace_events.hpp"
+
+#include <QFile>
+#include <QFileInfo>
+#include <QVector>
+#include <QDebug>
+
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <thread>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+
+namespace
+{
+constexpr int listen_backlog = 64;
+
+qint64 modifiedNs(const struct stat &status)
+{
+    return static_cast<qint64>(status.st_mtim.tv_sec) * 1000000000 + status.st_mtim.tv_nsec;
+}
+
+bool sendAll(int socket, const void *data, qint64 size)
+{
+    const char *bytes = static_cast<const char *>(data);
+    while (size > 0)
+    {
+        ssize_t sent = ::send(socket, bytes, size, MSG_NOSIGNAL);
+        if (sent < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if (sent <= 0)
+        {
+            return false;
+        }
+
+        bytes += sent;
+        size -= sent;
+    }
+
+    return true;
+}
+
+bool receiveAll(int socket, void *data, qint64 size)
+{
+    char *bytes = static_cast<char *>(data);
+    while (size > 0)
+    {
+        ssize_t received = ::recv(socket, bytes, size, 0);
+        if (received < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if (received <= 0)
+        {
+            return false;
+        }
+
+        bytes += received;
+        size -= received;
+    }
+
+    return true;
+}
+
+// Sends data with descriptor attached to its first byte.
+bool sendWithDescriptor(int socket, const void *data, qint64 size, int descriptor)
+{
+    iovec vector{ const_cast<void *>(data), static_cast<size_t>(size) };
+
+    alignas(cmsghdr) char control[CMSG_SPACE(sizeof(int))] = {};
+    msghdr message{};
+    message.msg_iov = &vector;
+    message.msg_iovlen = 1;
+    message.msg_control = control;
+    message.msg_controllen = sizeof(control);
+
+    cmsghdr *header = CMSG_FIRSTHDR(&message);
+    header->cmsg_level = SOL_SOCKET;
+    header->cmsg_type = SCM_RIGHTS;
+    header->cmsg_len = CMSG_LEN(sizeof(int));
+    std::memcpy(CMSG_DATA(header), &descriptor, sizeof(int));
+
+    ssize_t sent;
+    do
+    {
+        sent = ::sendmsg(socket, &message, MSG_NOSIGNAL);
+    } while (sent < 0 && errno == EINTR);
+
+    if (sent <= 0)
+    {
+        return false;
+    }
+
+    return sendAll(socket, static_cast<const char *>(data) + sent, size - sent);
+}
+}
+
+struct PacketServer::ServedFile
+{
+    int descriptor = -1;
+    quint64 device = 0;
+    quint64 inode = 0;
+    qint64 size = 0;
+    qint64 modified_ns = 0;
+
+    uint16_t settings_number = 0;
+    framing::PacketIndex index;
+    QHash<uint16_t, QVector<quint32>> channel_packets;
+
+    ~ServedFile()
+    {
+        if (descriptor >= 0)
+        {
+            ::close(descriptor);
+        }
+    }
+
+    bool matches(const struct stat &status) const
+    {
+        return device == static_cast<quint64>(status.st_dev) && inode == static_cast<quint64>(status.st_ino) &&
+               size == status.st_size && modified_ns == modifiedNs(status);
+    }
+
+    // Packets are contiguous up to the end of a validated file.
+    qint64 packetEnd(qint64 packet) const
+    {
+        return packet + 1 < index.packet_count ? index.offset(packet + 1) : size;
+    }
+};
+
+PacketServer::PacketServer(const QString &socket_path, QObject *parent)
+    : QObject(parent), socket_path(socket_path), listener(-1), stopping(false)
+{
+}
+
+PacketServer::~PacketServer()
+{
+    stop();
+    closeListener();
+}
+
+bool PacketServer::listen()
+{
+    QByteArray path = QFile::encodeName(socket_path);
+
+    sockaddr_un address{};
+    if (path.isEmpty() || path.size() >= static_cast<qsizetype>(sizeof(address.sun_path)))
+    {
+        qWarning() << "Invalid socket path:" << socket_path;
+        return false;
+    }
+
+    address.sun_family = AF_UNIX;
+    std::memcpy(address.sun_path, path.constData(), path.size());
+
+    closeListener();
+
+    int descriptor = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (descriptor < 0)
+    {
+        qWarning() << "Failed to create socket:" << std::strerror(errno);
+        return false;
+    }
+
+    ::unlink(path.constData());
+
+    // Clients get descriptors of whatever the server may read, so only its
+    // own user may connect; nobody can before listen().
+    if (::bind(descriptor, reinterpret_cast<sockaddr *>(&address), sizeof(address)) != 0 ||
+        ::chmod(path.constData(), S_IRUSR | S_IWUSR) != 0 || ::listen(descriptor, listen_backlog) != 0)
+    {
+        qWarning() << "Failed to listen on" << socket_path << ":" << std::strerror(errno);
+        ::close(descriptor);
+        return false;
+    }
+
+    stopping = false;
+    listener = descriptor;
+    return true;
+}
+
+void PacketServer::serve()
+{
+    while (!stopping)
+    {
+        int client = ::accept4(listener, nullptr, nullptr, SOCK_CLOEXEC);
+        if (client < 0)
+        {
+            if (errno == EINTR || errno == ECONNABORTED)
+            {
+                continue;
+            }
+            if (!stopping)
+            {
+                qWarning() << "Failed to accept client:" << std::strerror(errno);
+            }
+            break;
+        }
+
+        {
+            std::lock_guard<std::mutex> guard(clients_lock);
+            if (stopping)
+            {
+                ::close(client);
+                break;
+            }
+            clients.insert(client);
+        }
+
+        std::thread(&PacketServer::handleClient, this, client).detach();
+    }
+
+    closeListener();
+}
+
+void PacketServer::stop()
+{
+    stopping = true;
+
+    // Wakes up accept() and clients blocked on their next request, then waits
+    // for the client threads to let go of the server. The listener is only
+    // shut down here; serve() closes it once it no longer uses it.
+    std::unique_lock<std::mutex> guard(clients_lock);
+
+    int descriptor = listener;
+    if (descriptor >= 0)
+    {
+        ::shutdown(descriptor, SHUT_RDWR);
+    }
+
+    for (int client : clients)
+    {
+        ::shutdown(client, SHUT_RDWR);
+    }
+    clients_done.wait(guard, [this]() { return clients.isEmpty(); });
+}
+
+void PacketServer::closeListener()
+{
+    // Under the lock stop() shuts the listener down with, so it never shuts
+    // down a descriptor number that was already reused.
+    std::lock_guard<std::mutex> guard(clients_lock);
+
+    int descriptor = listener.exchange(-1);
+    if (descriptor >= 0)
+    {
+        ::close(descriptor);
+        ::unlink(QFile::encodeName(socket_path).constData());
+    }
+}
+
+qsizetype PacketServer::servedFiles() const
+{
+    std::lock_guard<std::mutex> guard(files_lock);
+    return files.size();
+}
+
+std::shared_ptr<const PacketServer::ServedFile> PacketServer::servedFile(const QString &filename)
+{
+    QString canonical = QFileInfo(filename).canonicalFilePath();
+    struct stat status;
+    if (canonical.isEmpty() || ::stat(QFile::encodeName(canonical).constData(), &status) != 0)
+    {
+        return nullptr;
+    }
+
+    // Concurrent first queries of a file wait for a single validation; a file
+    // that failed or changed since is loaded again.
+    std::promise<std::shared_ptr<const ServedFile>> promise;
+    FileFuture future;
+    bool loader = false;
+    {
+        std::lock_guard<std::mutex> guard(files_lock);
+        future = files.value(canonical);
+
+        bool current = future.valid() &&
+                       (future.wait_for(std::chrono::seconds(0)) != std::future_status::ready ||
+                        (future.get() && future.get()->matches(status)));
+        if (!current)
+        {
+            future = promise.get_future().share();
+            files.insert(canonical, future);
+            loader = true;
+        }
+    }
+
+    if (loader)
+    {
+        promise.set_value(load(canonical));
+    }
+
+    return future.get();
+}
+
+std::shared_ptr<const PacketServer::ServedFile> PacketServer::load(const QString &filename)
+{
+    TRACE_SCOPE("PacketServer::load");
+
+    QByteArray path = QFile::encodeName(filename);
+    auto served = std::make_shared<ServedFile>();
+
+    served->descriptor = ::open(path.constData(), O_RDONLY | O_CLOEXEC);
+    struct stat status;
+    if (served->descriptor < 0 || ::fstat(served->descriptor, &status) != 0)
+    {
+        qWarning() << "Failed to open file for serving:" << filename << std::strerror(errno);
+        return nullptr;
+    }
+
+    served->device = status.st_dev;
+    served->inode = status.st_ino;
+    served->size = status.st_size;
+    served->modified_ns = modifiedNs(status);
+
+    FileValidator validator(filename);
+    validator.setRecordPacketOffsets(true);
+    if (validator.validateFile() != FileValidator::ValidationError::None)
+    {
+        qWarning() << "Refusing to serve invalid file:" << filename;
+        return nullptr;
+    }
+
+    // The descriptor handed to clients must be the file that was validated.
+    if (::stat(path.constData(), &status) != 0 || !served->matches(status))
+    {
+        qWarning() << "File changed while it was validated:" << filename;
+        return nullptr;
+    }
+
+    served->settings_number = validator.settingsNumber();
+    served->index = validator.packetIndex();
+
+    if (served->index.packet_count > 0)
+    {
+        void *mapping = ::mmap(nullptr, served->size, PROT_READ, MAP_SHARED, served->descriptor, 0);
+        if (mapping == MAP_FAILED)
+        {
+            qWarning() << "Failed to map file for serving:" << filename << std::strerror(errno);
+            return nullptr;
+        }
+
+        const uchar *data = static_cast<const uchar *>(mapping);
+        for (qint64 packet = 0; packet < served->index.packet_count; ++packet)
+        {
+            framing::PacketView view{ data + served->index.offset(packet), 0, served->index.format };
+            served->channel_packets[view.chanelId()].append(packet);
+        }
+
+        ::munmap(mapping, served->size);
+    }
+
+    return served;
+}
+
+void PacketServer::handleClient(int client)
+{
+    // The socket mode already keeps other users out; the peer credentials
+    // also cover a socket whose mode was changed behind the server's back.
+    ucred peer{};
+    socklen_t peer_size = sizeof(peer);
+    bool trusted = ::getsockopt(client, SOL_SOCKET, SO_PEERCRED, &peer, &peer_size) == 0 &&
+                   (peer.uid == ::geteuid() || peer.uid == 0);
+    if (!trusted)
+    {
+        qWarning() << "Refusing packet client of another user, uid" << peer.uid;
+    }
+
+    service::QueryRequest request;
+    while (trusted && receiveAll(client, &request, sizeof(request)))
+    {
+        if (request.magic != service::request_magic || request.path_size == 0 || request.path_size > service::max_path_size)
+        {
+            service::QueryResponse response{ service::response_magic, static_cast<qint32>(service::QueryStatus::BadRequest), 0, 0, 0, 0, 0 };
+            sendAll(client, &response, sizeof(response));
+            break;
+        }
+
+        QByteArray path(request.path_size, Qt::Uninitialized);
+        if (!receiveAll(client, path.data(), path.size()) || !answer(client, request, QString::fromUtf8(path)))
+        {
+            break;
+        }
+    }
+
+    std::lock_guard<std::mutex> guard(clients_lock);
+    clients.remove(client);
+    ::close(client);
+    clients_done.notify_all();
+}
+
+bool PacketServer::answer(int client, const service::QueryRequest &request, const QString &filename)
+{
+    TRACE_SCOPE("PacketServer::answer");
+
+    service::QueryResponse response{ service::response_magic, static_cast<qint32>(service::QueryStatus::Ok), 0, 0, 0, 0, 0 };
+    QVector<framing::ByteRange> ranges;
+
+    auto served = servedFile(filename);
+    auto status = served ? service::QueryStatus::Ok : service::QueryStatus::InvalidFile;
+
+    if (served)
+    {
+        const auto &index = served->index;
+        quint64 packet_count = index.packet_count;
+
+        response.format = static_cast<quint32>(index.format);
+        response.settings_number = served->settings_number;
+        response.file_packets = packet_count;
+
+        switch (static_cast<service::QueryKind>(request.kind))
+        {
+        case service::QueryKind::Info:
+            break;
+        case service::QueryKind::Packet:
+            if (request.first >= packet_count)
+            {
+                status = service::QueryStatus::OutOfRange;
+                break;
+            }
+            ranges.append({ index.offset(request.first), served->packetEnd(request.first) - index.offset(request.first) });
+            response.packets = 1;
+            break;
+        case service::QueryKind::Range:
+        {
+            if (request.first > packet_count)
+            {
+                status = service::QueryStatus::OutOfRange;
+                break;
+            }
+
+            quint64 available = packet_count - request.first;
+            quint64 last = request.first + (request.count == 0 ? available : std::min(request.count, available));
+            if (last > request.first)
+            {
+                ranges.append({ index.offset(request.first), served->packetEnd(last - 1) - index.offset(request.first) });
+            }
+            response.packets = last - request.first;
+            break;
+        }
+        case service::QueryKind::Channel:
+        {
+            if (!served->channel_packets.contains(request.channel))
+            {
+                status = service::QueryStatus::UnknownChannel;
+                break;
+            }
+
+            // Implicitly shared, this does not copy the packet list.
+            const auto packets = served->channel_packets.value(request.channel);
+            quint64 channel_count = packets.size();
+            if (request.first > channel_count)
+            {
+                status = service::QueryStatus::OutOfRange;
+                break;
+            }
+
+            // Neighbouring packets of the channel become a single range.
+            quint64 available = channel_count - request.first;
+            quint64 last = request.first + (request.count == 0 ? available : std::min(request.count, available));
+            for (quint64 packet = request.first; packet < last; ++packet)
+            {
+                qint64 offset = index.offset(packets.at(packet));
+                qint64 end = served->packetEnd(packets.at(packet));
+
+                if (!ranges.isEmpty() && ranges.last().offset + ranges.last().length == offset)
+                {
+                    ranges.last().length += end - offset;
+                }
+                else
+                {
+                    ranges.append({ offset, end - offset });
+                }
+            }
+            response.packets = last - request.first;
+            break;
+        }
+        default:
+            status = service::QueryStatus::BadRequest;
+            break;
+        }
+    }
+
+    if (status != service::QueryStatus::Ok)
+    {
+        response.status = static_cast<qint32>(status);
+        response.packets = 0;
+        ranges.clear();
+        return sendAll(client, &response, sizeof(response));
+    }
+
+    response.range_count = ranges.size();
+    return sendWithDescriptor(client, &response, sizeof(response), served->descriptor) &&
+           sendAll(client, ranges.constData(), ranges.size() * static_cast<qint64>(sizeof(framing::ByteRange)));
+}
@@ -0,0 +1,64 @@
+#ifndef PACKET_SERVER_HPP
+#define PACKET_SERVER_HPP
+
+#include "packet_protocol.hpp"
+#include "packet_framing.hpp"
+
+#include <QString>
+#include <QObject>
+#include <QHash>
+#include <QSet>
+
+#include <atomic>
+#include <condition_variable>
+#include <future>
+#include <memory>
+#include <mutex>
+
+
+// Local daemon answering packet queries over a Unix domain socket. Every file
+// is validated once and its packet offsets and per-channel packet lists stay
+// in memory; a file that changes on disk is validated again on its next
+// query. Answers are byte ranges plus the file descriptor, never packet data.
+class PacketServer : public QObject
+{
+    Q_OBJECT
+public:
+    explicit PacketServer(const QString &socket_path, QObject *parent = nullptr);
+    ~PacketServer();
+
+    // Binds the socket, replacing a stale one left by an earlier run.
+    bool listen();
+    // Accepts clients on the calling thread until stop(), one thread each,
+    // and closes the socket on the way out.
+    void serve();
+    // Wakes serve() and waits for every client thread. Safe from any thread.
+    void stop();
+
+    qsizetype servedFiles() const;
+
+private:
+    struct ServedFile;
+    using FileFuture = std::shared_future<std::shared_ptr<const ServedFile>>;
+
+    std::shared_ptr<const ServedFile> servedFile(const QString &filename);
+    static std::shared_ptr<const ServedFile> load(const QString &filename);
+
+    void closeListener();
+    void handleClient(int client);
+    bool answer(int client, const service::QueryRequest &request, const QString &filename);
+
+private:
+    QString socket_path;
+    std::atomic<int> listener;
+    std::atomic<bool> stopping;
+
+    mutable std::mutex files_lock;
+    QHash<QString, FileFuture> files;
+
+    std::mutex clients_lock;
+    std::condition_variable clients_done;
+    QSet<int> clients;
+};
+
+#endif // PACKET_SERVER_HPP
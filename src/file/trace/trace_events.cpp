@@ -0,0 +1,199 @@
+#include "trace_events.hpp"
+
+#include <QSaveFile>
+#include <QDebug>
+
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include <unistd.h>
+
+
+namespace trace
+{
+#if defined(FILE_VALIDATOR_ENABLE_TRACING)
+namespace
+{
+struct ThreadBuffer
+{
+    uint32_t thread_id;
+    // Only contended while an export runs, otherwise each thread owns it.
+    std::mutex lock;
+    std::vector<Event> events;
+};
+
+struct Registry
+{
+    std::mutex lock;
+    std::vector<std::shared_ptr<ThreadBuffer>> buffers;
+    std::atomic<bool> enabled { false };
+    const std::chrono::steady_clock::time_point epoch = std::chrono::steady_clock::now();
+};
+
+Registry &registry()
+{
+    static Registry instance;
+    return instance;
+}
+
+int64_t now()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - registry().epoch).count();
+}
+
+ThreadBuffer &threadBuffer()
+{
+    // The registry keeps a reference so spans of finished threads survive
+    // until the trace is written.
+    thread_local std::shared_ptr<ThreadBuffer> buffer = [] {
+        auto &instance = registry();
+        std::lock_guard<std::mutex> guard(instance.lock);
+
+        auto created = std::make_shared<ThreadBuffer>();
+        created->thread_id = instance.buffers.size() + 1;
+        created->events.reserve(4096);
+        instance.buffers.push_back(created);
+        return created;
+    }();
+
+    return *buffer;
+}
+}
+
+bool isEnabled()
+{
+    return registry().enabled.load(std::memory_order_relaxed);
+}
+
+void setEnabled(bool enabled)
+{
+    registry().enabled.store(enabled, std::memory_order_relaxed);
+}
+
+void clear()
+{
+    auto &instance = registry();
+    std::lock_guard<std::mutex> guard(instance.lock);
+
+    for (auto &buffer : instance.buffers)
+    {
+        std::lock_guard<std::mutex> buffer_guard(buffer->lock);
+        buffer->events.clear();
+    }
+}
+
+bool writeChromeTrace(const QString &filename)
+{
+    QSaveFile file(filename);
+    if (!file.open(QIODevice::WriteOnly))
+    {
+        qWarning() << "Failed to open trace for writing:" << file.errorString();
+        return false;
+    }
+
+    const QByteArray pid = QByteArray::number(static_cast<qint64>(getpid()));
+    QByteArray content = "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n";
+    bool first = true;
+
+    auto &instance = registry();
+    std::lock_guard<std::mutex> guard(instance.lock);
+
+    for (auto &buffer : instance.buffers)
+    {
+        std::lock_guard<std::mutex> buffer_guard(buffer->lock);
+        const QByteArray tid = QByteArray::number(buffer->thread_id);
+
+        for (const auto &event : buffer->events)
+        {
+            if (!first)
+            {
+                content += ",\n";
+            }
+            first = false;
+
+            // Timestamps are in microseconds; keep the nanosecond fraction.
+            content += "{\"name\":\"" + QByteArray(event.name) + "\",\"ph\":\"X\",\"pid\":" + pid + ",\"tid\":" + tid
+                     + ",\"ts\":" + QByteArray::number(event.begin_ns / 1000.0, 'f', 3)
+                     + ",\"dur\":" + QByteArray::number(event.duration_ns / 1000.0, 'f', 3) + "}";
+        }
+    }
+
+    content += "\n]}\n";
+    file.write(content);
+
+    if (!file.commit())
+    {
+        qWarning() << "Failed to commit trace:" << file.errorString();
+        return false;
+    }
+
+    return true;
+}
+
+Scope::Scope(const char *name) : name(name), begin_ns(isEnabled() ? now() : -1)
+{
+}
+
+Scope::~Scope()
+{
+    if (begin_ns < 0)
+    {
+        return;
+    }
+
+    int64_t end_ns = now();
+    auto &buffer = threadBuffer();
+
+    std::lock_guard<std::mutex> guard(buffer.lock);
+    buffer.events.push_back({ name, begin_ns, end_ns - begin_ns });
+}
+#else
+bool isEnabled()
+{
+    return false;
+}
+
+void setEnabled(bool)
+{
+}
+
+void clear()
+{
+}
+
+bool writeChromeTrace(const QString &)
+{
+    qWarning() << "Tracing is not compiled in, configure with ENABLE_TRACING=ON.";
+    return false;
+}
+
+Scope::Scope(const char *name) : name(name), begin_ns(-1)
+{
+}
+
+Scope::~Scope()
+{
+}
+#endif
+
+Session::Session(const QString &filename) : filename(filename)
+{
+    if (!filename.isEmpty())
+    {
+        clear();
+        setEnabled(true);
+    }
+}
+
+Session::~Session()
+{
+    if (!filename.isEmpty())
+    {
+        setEnabled(false);
+        writeChromeTrace(filename);
+    }
+}
+}
@@ -0,0 +1,62 @@
+#ifndef TRACE_EVENTS_HPP
+#define TRACE_EVENTS_HPP
+
+#include <QString>
+
+#include <cstdint>
+
+
+// Scoped spans recorded into per-thread buffers and exported in the Chrome
+// trace-event format, which chrome://tracing and Perfetto both load.
+// Without FILE_VALIDATOR_ENABLE_TRACING the macros expand to nothing.
+#if defined(FILE_VALIDATOR_ENABLE_TRACING)
+#define TRACE_CONCAT_INNER(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_INNER(a, b)
+#define TRACE_SCOPE(name) trace::Scope TRACE_CONCAT(trace_scope_, __LINE__)(name)
+#else
+#define TRACE_SCOPE(name) static_cast<void>(0)
+#endif
+
+namespace trace
+{
+struct Event
+{
+    const char *name;
+    int64_t begin_ns;
+    int64_t duration_ns;
+};
+
+// Spans are only recorded while a session is active, so an instrumented
+// build costs one relaxed load per scope when nobody is tracing.
+bool isEnabled();
+void setEnabled(bool enabled);
+void clear();
+
+bool writeChromeTrace(const QString &filename);
+
+class Scope
+{
+public:
+    explicit Scope(const char *name);
+    ~Scope();
+
+    Scope(const Scope &) = delete;
+    Scope &operator=(const Scope &) = delete;
+
+private:
+    const char *name;
+    int64_t begin_ns;
+};
+
+class Session
+{
+public:
+    explicit Session(const QString &filename);
+    ~Session();
+
+private:
+    QString filename;
+};
+}
+
+#endif // TRACE_EVENTS_HPP
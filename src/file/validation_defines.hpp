@@ -6,6 +6,10 @@
 
 const auto default_filename  = QString::fromLatin1("output_%1_%2.dgs");
 const auto default_datetime  = QString::fromLatin1("yyyy_MM_dd__hh_mm_ss");
+const auto default_segment   = QString::fromLatin1("%1_%2.dgs");
+const auto default_manifest  = QString::fromLatin1("%1.dgsm");
+const auto default_channel_file = QString::fromLatin1("%1_ch%2.dgs");
+const auto default_manifest_header = QString::fromLatin1("# dgs segment manifest 1");
 const auto default_signature = QString::fromLatin1("\\x25 \\x44 \\x47 \\x53 \\x%1 \\x%2 \\x%3 \\xDB");
 
 const auto default_body_prefix  = QByteArray{ "\xAB\x57\x46\x41" };
@@ -15,4 +19,21 @@ const auto version_major = "01";
 const auto version_minor = "00";
 const auto version_patch = "0A";
 
+// Minor version 01 adds a 64-bit trigger timestamp to every packet header.
+const auto timestamped_version_minor_string = "01";
+const auto timestamped_version_patch = "00";
+constexpr unsigned char timestamped_version_minor = 0x01;
+
+const auto default_time_index = QString::fromLatin1("%1.dgst");
+const auto default_pyramid = QString::fromLatin1("%1.dgsl");
+const auto default_time_index_magic = QByteArray{ "DGST" };
+constexpr uint32_t default_time_index_interval = 1024;
+
+const auto default_validation_cache = QString::fromLatin1("%1.dgsv");
+const auto default_validation_cache_magic = QByteArray{ "DGSV" };
+constexpr qint64 default_validation_cache_block = 64 * 1024;
+
+const auto default_checkpoint_log = QString::fromLatin1("%1.dgsc");
+const auto default_checkpoint_magic = QByteArray{ "DGSC" };
+
 #endif // FILE_VALIDATION_HPP
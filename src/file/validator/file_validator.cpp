@@ -1,5 +1,6 @@
 #include "file_validator.hpp"
 #include "validation_defines.hpp"
+#include "trace_events.hpp"
 
 #include <QByteArray>
 #include <QDataStream>
@@ -7,12 +8,63 @@
 #include <QDebug>
 
 
+namespace
+{
+constexpr int format_probe_packets = 16;
+
+// Number of packets, up to format_probe_packets, chained from position.
+int chainLength(const uchar *data, qint64 size, qint64 position, framing::PacketFormat format)
+{
+    int packets = 0;
+    for (qint64 packet_size = 0; packets < format_probe_packets && position < size; position += packet_size, ++packets)
+    {
+        packet_size = framing::frameAt(data + position, size - position, format);
+        if (packet_size == 0)
+        {
+            break;
+        }
+    }
+
+    return packets;
+}
+
+// The layout that frames the longer chain at the first magic that starts one;
+// the version byte of the damaged signature decides when both do equally.
+framing::PacketFormat detectPacketFormat(const uchar *data, qint64 size, qint64 body_offset)
+{
+    framing::PacketFormat hint = size > 5 ? framing::formatForVersion(data[5]) : framing::PacketFormat::Plain;
+
+    for (qint64 position = body_offset; position < size; ++position)
+    {
+        qint64 next_magic = framing::findMagic(data + position, size - position);
+        if (next_magic < 0)
+        {
+            break;
+        }
+        position += next_magic;
+
+        int plain = chainLength(data, size, position, framing::PacketFormat::Plain);
+        int timestamped = chainLength(data, size, position, framing::PacketFormat::Timestamped);
+        if (plain != timestamped)
+        {
+            return plain > timestamped ? framing::PacketFormat::Plain : framing::PacketFormat::Timestamped;
+        }
+        if (plain > 0)
+        {
+            break;
+        }
+    }
+
+    return hint;
+}
+}
+
 FileValidator::FileValidator(QObject *parent)
-    : QObject(parent), file(nullptr), error(ValidationError::None), settings_number(0), valid_packets(0)
+    : QObject(parent), file(nullptr), error(ValidationError::None), settings_number(0), valid_packets(0), packet_format(framing::PacketFormat::Plain), record_offsets(false)
 {}
 
 FileValidator::FileValidator(const QString &filename, QObject *parent)
-    : QObject(parent), file(nullptr), error(ValidationError::None), settings_number(0), valid_packets(0)
+    : QObject(parent), file(nullptr), error(ValidationError::None), settings_number(0), valid_packets(0), packet_format(framing::PacketFormat::Plain), record_offsets(false)
 {
     initialize(filename);
 }
@@ -25,6 +77,8 @@ FileValidator::~FileValidator()
 
 void FileValidator::initialize(const QString &filename)
 {
+    TRACE_SCOPE("FileValidator::open");
+
     file = new QFile(filename);
 
     if (!file->open(QIODevice::ReadOnly))
@@ -35,8 +89,15 @@ void FileValidator::initialize(const QString &filename)
     }
 }
 
+void FileValidator::setRecordPacketOffsets(bool record)
+{
+    record_offsets = record;
+}
+
 FileValidator::ValidationError FileValidator::validateFile()
 {
+    TRACE_SCOPE("FileValidator::validateFile");
+
     if (!file || !file->isOpen())
     {
         qWarning() << "File is not loaded or open:" << (file ? file->errorString() : "File is null");
@@ -66,6 +127,98 @@ FileValidator::ValidationError FileValidator::validateFile()
     return ValidationError::None;
 }
 
+FileValidator::ValidationError FileValidator::validateHeader()
+{
+    TRACE_SCOPE("FileValidator::validateHeader");
+
+    if (!file || !file->isOpen())
+    {
+        qWarning() << "File is not loaded or open:" << (file ? file->errorString() : "File is null");
+        error = ValidationError::UnableToOpen;
+        return error;
+    }
+
+    if (!validateSignature() || !validateSettings())
+    {
+        close();
+        return error;
+    }
+
+    return ValidationError::None;
+}
+
+FileValidator::ValidationError FileValidator::salvageFile()
+{
+    TRACE_SCOPE("FileValidator::salvageFile");
+
+    if (!file || !file->isOpen())
+    {
+        qWarning() << "File is not loaded or open:" << (file ? file->errorString() : "File is null");
+        error = ValidationError::UnableToOpen;
+        return error;
+    }
+
+    error = ValidationError::None;
+    packet_format = framing::PacketFormat::Plain;
+    packet_index = framing::PacketIndex();
+    corrupted_ranges.clear();
+
+    // A damaged header does not stop the salvage, the body scan simply
+    // resynchronises on the first framed packet after the signature. The
+    // header checks report a short or corrupt header as ReadError, which
+    // must not read as an I/O failure here.
+    qint64 body_offset = framing::signature_size;
+    ValidationError header_error = ValidationError::None;
+    bool detect_format = false;
+    if (!validateSignature())
+    {
+        header_error = ValidationError::InvalidSignature;
+        detect_format = true;
+    }
+    else if (!validateSettings())
+    {
+        header_error = ValidationError::WrongHeaderHash;
+    }
+    else
+    {
+        body_offset = file->pos();
+    }
+    error = ValidationError::None;
+
+    if (!salvageWaveformPackets(body_offset, detect_format))
+    {
+        close();
+        return error;
+    }
+
+    if (error == ValidationError::None)
+    {
+        if (header_error != ValidationError::None)
+        {
+            error = header_error;
+        }
+        else if (!corrupted_ranges.isEmpty())
+        {
+            error = ValidationError::MalformedWaveformPacket;
+        }
+    }
+
+    close();
+    return error;
+}
+
+void FileValidator::restore(ValidationError result, uint16_t settings, uint32_t packets, const framing::PacketIndex &index)
+{
+    error = result;
+    settings_number = settings;
+    valid_packets = packets;
+    packet_format = index.format;
+    packet_index = index;
+    corrupted_ranges.clear();
+
+    close();
+}
+
 FileValidator::ValidationError FileValidator::errors() const
 {
     return error;
@@ -81,6 +234,26 @@ uint32_t FileValidator::validPacketNumber() const
     return valid_packets;
 }
 
+const QVector<qint64> &FileValidator::packetOffsets() const
+{
+    return packet_index.offsets;
+}
+
+framing::PacketFormat FileValidator::packetFormat() const
+{
+    return packet_format;
+}
+
+const framing::PacketIndex &FileValidator::packetIndex() const
+{
+    return packet_index;
+}
+
+const QVector<framing::ByteRange> &FileValidator::corruptedRanges() const
+{
+    return corrupted_ranges;
+}
+
 void FileValidator::close()
 {
     if (file && file->isOpen())
@@ -91,6 +264,8 @@ void FileValidator::close()
 
 bool FileValidator::validateSignature()
 {
+    TRACE_SCOPE("FileValidator::signature");
+
     if (file->bytesAvailable() < 8)
     {
         qWarning() << "File is too small to contain a valid signature";
@@ -121,11 +296,14 @@ bool FileValidator::validateSignature()
         return false;
     }
 
+    packet_format = framing::formatForVersion(static_cast<uchar>(signature[5]));
     return true;
 }
 
 bool FileValidator::validateSettings()
 {
+    TRACE_SCOPE("FileValidator::settingsHash");
+
     if (file->bytesAvailable() < 2)
     {
         qWarning() << "File is too small to contain settings bytes";
@@ -181,10 +359,27 @@ bool FileValidator::validateSettings()
 
 bool FileValidator::validateWaveformPackets()
 {
+    TRACE_SCOPE("FileValidator::packetWalk");
+
+    packet_index = framing::PacketIndex();
+    packet_index.body_offset = file->pos();
+    packet_index.format = packet_format;
+
+    // Timestamped bodies are framed on the fly by serial and range reads, so
+    // offsets are only kept for callers that asked for them.
+    bool record = record_offsets;
+
+    if (validateUniformWaveformPackets())
+    {
+        return true;
+    }
+
     uint32_t number_of_waveform_packets = 0;
 
     while (!file->atEnd())
     {
+        qint64 packet_offset = file->pos();
+
         if (file->bytesAvailable() < 8)
         {
             qWarning() << "File is too small to contain a valid waveform packet";
@@ -226,7 +421,7 @@ bool FileValidator::validateWaveformPackets()
             return false;
         }
 
-        file->seek(file->pos() + waveform_data_size + 4);
+        file->seek(file->pos() + waveform_data_size + framing::headerSize(packet_format) - 4);
 
         auto waveform_postfix = file->read(4);
         if (waveform_postfix.size() != 4)
@@ -243,9 +438,131 @@ bool FileValidator::validateWaveformPackets()
             error = ValidationError::MalformedWaveformPacket;
             return false;
         }
+
+        if (record)
+        {
+            packet_index.offsets.append(packet_offset);
+        }
         number_of_waveform_packets++;
     }
 
     valid_packets = number_of_waveform_packets;
+    packet_index.packet_count = valid_packets;
+    return true;
+}
+
+bool FileValidator::validateUniformWaveformPackets()
+{
+    TRACE_SCOPE("FileValidator::uniformPacketWalk");
+
+    qint64 file_size = file->size();
+    qint64 body_size = file_size - packet_index.body_offset;
+    if (body_size < framing::packetSize(0, packet_format))
+    {
+        return false;
+    }
+
+    uchar *data = file->map(0, file_size);
+    if (!data)
+    {
+        return false;
+    }
+
+    // When the first packet's size divides the body, every packet is likely
+    // to have the same length: then offsets are arithmetic and validation is
+    // a strided check of prefix, length and trailer.
+    const uchar *body = data + packet_index.body_offset;
+    qint64 packet_size = framing::frameAt(body, body_size, packet_format);
+    bool uniform = packet_size > 0 && body_size % packet_size == 0;
+
+    for (qint64 position = packet_size; uniform && position < body_size; position += packet_size)
+    {
+        uniform = framing::isMagic(body + position) &&
+                  std::memcmp(body + position + framing::magic_size, body + framing::magic_size, 4) == 0 &&
+                  framing::isMagic(body + position + packet_size - framing::magic_size);
+    }
+
+    file->unmap(data);
+
+    if (!uniform)
+    {
+        return false;
+    }
+
+    valid_packets = body_size / packet_size;
+    packet_index.uniform_size = packet_size;
+    packet_index.packet_count = valid_packets;
+    return true;
+}
+
+bool FileValidator::salvageWaveformPackets(qint64 body_offset, bool detect_format)
+{
+    TRACE_SCOPE("FileValidator::salvagePacketWalk");
+
+    qint64 file_size = file->size();
+    if (body_offset >= file_size)
+    {
+        valid_packets = 0;
+        return true;
+    }
+
+    uchar *data = file->map(0, file_size);
+    if (!data)
+    {
+        qWarning() << "Failed to map file for salvage:" << file->errorString();
+        error = ValidationError::ReadError;
+        return false;
+    }
+
+    // Without a signature the packet layout has to be recognised from the data.
+    if (detect_format)
+    {
+        packet_format = detectPacketFormat(data, file_size, body_offset);
+    }
+
+    qint64 position = body_offset;
+    qint64 damage_start = -1;
+
+    while (position < file_size)
+    {
+        qint64 packet_size = framing::frameAt(data + position, file_size - position, packet_format);
+        if (packet_size > 0)
+        {
+            if (damage_start >= 0)
+            {
+                corrupted_ranges.append({ damage_start, position - damage_start });
+                damage_start = -1;
+            }
+
+            packet_index.offsets.append(position);
+            position += packet_size;
+            continue;
+        }
+
+        if (damage_start < 0)
+        {
+            damage_start = position;
+        }
+
+        qint64 next_magic = framing::findMagic(data + position + 1, file_size - position - 1);
+        position = (next_magic < 0) ? file_size : position + 1 + next_magic;
+    }
+
+    if (damage_start >= 0)
+    {
+        corrupted_ranges.append({ damage_start, file_size - damage_start });
+    }
+
+    file->unmap(data);
+
+    if (!corrupted_ranges.isEmpty())
+    {
+        qWarning() << "Salvaged" << packet_index.offsets.size() << "packets around" << corrupted_ranges.size() << "corrupted ranges.";
+    }
+
+    valid_packets = packet_index.offsets.size();
+    packet_index.body_offset = body_offset;
+    packet_index.packet_count = valid_packets;
+    packet_index.format = packet_format;
     return true;
 }
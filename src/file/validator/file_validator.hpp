@@ -1,6 +1,8 @@
 #ifndef FILE_VALIDATOR_HPP
 #define FILE_VALIDATOR_HPP
 
+#include "packet_framing.hpp"
+
 #include <QString>
 #include <QByteArray>
 #include <QObject>
@@ -30,19 +32,38 @@ public:
     ~FileValidator();
 
     void initialize(const QString &filename);
+    // Records per-packet offsets for bodies whose packets differ in size.
+    // Uniform bodies never need them, see packetOffsets().
+    void setRecordPacketOffsets(bool record);
 
     ValidationError validateFile();
+    // Checks signature and settings hash only and leaves the file positioned
+    // at the first packet, for callers that walk the body themselves.
+    ValidationError validateHeader();
+    ValidationError salvageFile();
+    // Adopts the outcome of an earlier full validation of the same file
+    // instead of scanning it again.
+    void restore(ValidationError result, uint16_t settings, uint32_t packets, const framing::PacketIndex &index);
 
     ValidationError errors() const;
     uint32_t settingsNumber() const;
     uint32_t validPacketNumber() const;
 
+    framing::PacketFormat packetFormat() const;
+    // Empty for uniform bodies even when recording was requested, since their
+    // offsets are computed; use packetIndex().offset() to address any file.
+    const QVector<qint64> &packetOffsets() const;
+    const framing::PacketIndex &packetIndex() const;
+    const QVector<framing::ByteRange> &corruptedRanges() const;
+
     void close();
 
 private:
     bool validateSignature();
     bool validateSettings();
     bool validateWaveformPackets();
+    bool validateUniformWaveformPackets();
+    bool salvageWaveformPackets(qint64 body_offset, bool detect_format);
 
 public:
     friend std::ostream& operator<<(std::ostream& os, const FileValidator::ValidationError& error)
@@ -85,6 +106,11 @@ private:
 
     uint16_t settings_number;
     uint32_t valid_packets;
+    framing::PacketFormat packet_format;
+
+    bool record_offsets;
+    framing::PacketIndex packet_index;
+    QVector<framing::ByteRange> corrupted_ranges;
 };
 Q_DECLARE_OPERATORS_FOR_FLAGS(FileValidator::ValidationErrors)
 
@@ -0,0 +1,165 @@
+#include "validation_cache.hpp"
+#include "validation_defines.hpp"
+
+#include <QFile>
+#include <QSaveFile>
+#include <QDataStream>
+#include <QCryptographicHash>
+#include <QDebug>
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+
+namespace validation_cache
+{
+namespace
+{
+std::atomic<bool> enabled { false };
+
+bool readBlock(int descriptor, QByteArray &block, qint64 offset)
+{
+    qint64 done = 0;
+    while (done < block.size())
+    {
+        ssize_t count = ::pread(descriptor, block.data() + done, block.size() - done, offset + done);
+        if (count < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if (count <= 0)
+        {
+            return false;
+        }
+        done += count;
+    }
+
+    return true;
+}
+}
+
+bool isEnabled()
+{
+    return enabled.load(std::memory_order_relaxed);
+}
+
+void setEnabled(bool enable)
+{
+    enabled.store(enable, std::memory_order_relaxed);
+}
+
+QString cacheFilename(const QString &filename)
+{
+    return default_validation_cache.arg(filename);
+}
+
+bool identify(const QString &filename, FileIdentity &identity)
+{
+    int descriptor = ::open(QFile::encodeName(filename).constData(), O_RDONLY | O_CLOEXEC);
+    if (descriptor < 0)
+    {
+        return false;
+    }
+
+    struct stat status;
+    if (::fstat(descriptor, &status) != 0)
+    {
+        ::close(descriptor);
+        return false;
+    }
+
+    identity.device = status.st_dev;
+    identity.inode = status.st_ino;
+    identity.size = status.st_size;
+    identity.modified_ns = static_cast<qint64>(status.st_mtim.tv_sec) * 1000000000 + status.st_mtim.tv_nsec;
+
+    // Small files are hashed whole; the two blocks overlap then.
+    QByteArray head(std::min(identity.size, default_validation_cache_block), Qt::Uninitialized);
+    QByteArray tail(head.size(), Qt::Uninitialized);
+    bool read = readBlock(descriptor, head, 0) && readBlock(descriptor, tail, identity.size - tail.size());
+    ::close(descriptor);
+
+    if (!read)
+    {
+        qWarning() << "Failed to read" << filename << "for its cache key.";
+        return false;
+    }
+
+    QCryptographicHash hash(QCryptographicHash::Md5);
+    hash.addData(head);
+    hash.addData(tail);
+    identity.edge_hash = hash.result();
+
+    return true;
+}
+
+bool lookup(const QString &filename, const FileIdentity &identity, ValidationRecord &record)
+{
+    QFile file(cacheFilename(filename));
+    if (!file.open(QIODevice::ReadOnly))
+    {
+        return false;
+    }
+
+    QDataStream in(&file);
+
+    QByteArray magic(default_validation_cache_magic.size(), Qt::Uninitialized);
+    if (in.readRawData(magic.data(), magic.size()) != magic.size() || magic != default_validation_cache_magic)
+    {
+        qWarning() << "Not a validation cache:" << file.fileName();
+        return false;
+    }
+
+    FileIdentity cached;
+    quint8 error = 0;
+    quint8 format = 0;
+
+    in >> cached.device >> cached.inode >> cached.size >> cached.modified_ns >> cached.edge_hash;
+    in >> error >> record.settings_number >> record.valid_packets >> format >> record.body_offset >> record.uniform_size;
+
+    if (in.status() != QDataStream::Ok)
+    {
+        qWarning() << "Truncated validation cache:" << file.fileName();
+        return false;
+    }
+
+    // Anything about the file that moved means it has to be validated again.
+    if (!(cached == identity))
+    {
+        return false;
+    }
+
+    record.error = static_cast<FileValidator::ValidationError>(error);
+    record.packet_format = static_cast<framing::PacketFormat>(format);
+    return true;
+}
+
+bool store(const QString &filename, const FileIdentity &identity, const ValidationRecord &record)
+{
+    QSaveFile file(cacheFilename(filename));
+    if (!file.open(QIODevice::WriteOnly))
+    {
+        qWarning() << "Failed to open validation cache for writing:" << file.errorString();
+        return false;
+    }
+
+    QDataStream out(&file);
+    out.writeRawData(default_validation_cache_magic.constData(), default_validation_cache_magic.size());
+    out << identity.device << identity.inode << identity.size << identity.modified_ns << identity.edge_hash;
+    out << static_cast<quint8>(record.error) << record.settings_number << record.valid_packets
+        << static_cast<quint8>(record.packet_format) << record.body_offset << record.uniform_size;
+
+    if (!file.commit())
+    {
+        qWarning() << "Failed to commit validation cache:" << file.errorString();
+        return false;
+    }
+
+    return true;
+}
+}
@@ -0,0 +1,52 @@
+#ifndef VALIDATION_CACHE_HPP
+#define VALIDATION_CACHE_HPP
+
+#include "file_validator.hpp"
+
+#include <QString>
+#include <QByteArray>
+
+#include <cstdint>
+
+
+// Which file a cached result belongs to. Device, inode, size and modification
+// time catch replaced or rewritten files; the hash of the first and last
+// blocks catches in-place edits that kept the timestamp.
+struct FileIdentity
+{
+    quint64 device = 0;
+    quint64 inode = 0;
+    qint64 size = 0;
+    qint64 modified_ns = 0;
+    QByteArray edge_hash;
+
+    bool operator==(const FileIdentity &other) const = default;
+};
+
+// What a full validation established about a file, enough to answer
+// settingsNumber() and validPacketNumber() and to address uniform bodies.
+struct ValidationRecord
+{
+    FileValidator::ValidationError error = FileValidator::ValidationError::None;
+    uint16_t settings_number = 0;
+    uint32_t valid_packets = 0;
+    framing::PacketFormat packet_format = framing::PacketFormat::Plain;
+    qint64 body_offset = 0;
+    qint64 uniform_size = 0;
+};
+
+// Opt-in sidecar store of validation results, so reopening an unchanged
+// archive skips the full body scan. Disabled by default.
+namespace validation_cache
+{
+bool isEnabled();
+void setEnabled(bool enabled);
+
+QString cacheFilename(const QString &filename);
+
+bool identify(const QString &filename, FileIdentity &identity);
+bool lookup(const QString &filename, const FileIdentity &identity, ValidationRecord &record);
+bool store(const QString &filename, const FileIdentity &identity, const ValidationRecord &record);
+}
+
+#endif // VALIDATION_CACHE_HPP
@@ -0,0 +1,242 @@
+#include "channel_demuxer.hpp"
+#include "file_validator.hpp"
+#include "file_writer.hpp"
+#include "validation_defines.hpp"
+#include "trace_events.hpp"
+
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QDebug>
+
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <limits>
+#include <thread>
+#include <vector>
+
+
+namespace
+{
+constexpr qint64 batch_size = 4 * 1024 * 1024;
+constexpr qint64 minimum_chunk_size = 16 * 1024 * 1024;
+}
+
+ChannelDemuxer::ChannelDemuxer(const QString &output_directory, uint32_t threads, QObject *parent)
+    : QObject(parent), directory(output_directory),
+      threads(threads > 0 ? threads : std::max(1u, std::thread::hardware_concurrency())),
+      format(framing::PacketFormat::Plain), demuxed_packets(0)
+{
+}
+
+bool ChannelDemuxer::demux(const QString &filename)
+{
+    TRACE_SCOPE("ChannelDemuxer::demux");
+
+    outputs.clear();
+    demuxed_packets = 0;
+
+    if (!QDir().mkpath(directory))
+    {
+        qWarning() << "Failed to create output directory:" << directory;
+        return false;
+    }
+
+    FileValidator validator(filename);
+    if (validator.validateHeader() != FileValidator::ValidationError::None)
+    {
+        qWarning() << "Refusing to demux file with invalid header:" << filename;
+        return false;
+    }
+    format = validator.packetFormat();
+
+    QFile file(filename);
+    if (!file.open(QIODevice::ReadOnly))
+    {
+        qWarning() << "Failed to open file for reading:" << file.errorString();
+        return false;
+    }
+
+    qint64 file_size = file.size();
+    uchar *data = file.map(0, file_size);
+    if (!data)
+    {
+        qWarning() << "Failed to map file for demux:" << file.errorString();
+        return false;
+    }
+
+    QVector<device::DevicePSDSettings> settings(validator.settingsNumber());
+    QDataStream in(QByteArray::fromRawData(reinterpret_cast<const char *>(data) + framing::signature_size + framing::settings_count_size,
+                                           validator.settingsNumber() * framing::settings_size));
+    for (auto &value : settings)
+    {
+        in >> value;
+    }
+
+    qint64 body_offset = framing::bodyOffset(validator.settingsNumber());
+    qint64 body_size = file_size - body_offset;
+    qint64 chunk_count = std::clamp<qint64>(body_size / minimum_chunk_size, 1, threads);
+    QVector<framing::BodyChunk> chunks;
+    QVector<ChunkRanges> chunk_ranges(chunk_count);
+    qint64 chain_end;
+
+    {
+        TRACE_SCOPE("ChannelDemuxer::scan");
+
+        chain_end = framing::walkChunks(
+            data, file_size, body_offset, format, chunk_count, chunks,
+            [&chunk_ranges](qint64 index) { chunk_ranges[index].clear(); },
+            [&chunk_ranges](qint64 index, qint64 offset, const framing::PacketView &view) {
+                auto &ranges = chunk_ranges[index][view.chanelId()];
+                if (!ranges.isEmpty() && ranges.last().offset + ranges.last().length == offset)
+                {
+                    ranges.last().length += view.size;
+                }
+                else
+                {
+                    ranges.append({ offset, view.size });
+                }
+            });
+    }
+
+    if (chain_end != file_size)
+    {
+        qWarning() << "Malformed waveform packet near offset" << chain_end << "in" << filename;
+        file.unmap(data);
+        return false;
+    }
+
+    for (const auto &chunk : chunks)
+    {
+        demuxed_packets += chunk.packets;
+    }
+
+    std::vector<bool> seen(std::numeric_limits<uint16_t>::max() + 1, false);
+    for (const auto &ranges : chunk_ranges)
+    {
+        for (auto channel : ranges.keys())
+        {
+            seen[channel] = true;
+        }
+    }
+
+    QVector<uint16_t> channels;
+    for (uint32_t channel = 0; channel < seen.size(); ++channel)
+    {
+        if (seen[channel])
+        {
+            channels.append(channel);
+        }
+    }
+
+    const QString base = QFileInfo(filename).completeBaseName();
+    for (auto channel : channels)
+    {
+        outputs.append(QDir(directory).filePath(default_channel_file.arg(base).arg(channel)));
+    }
+
+    // Channels are written side by side, each from its own list of ranges.
+    std::atomic<qsizetype> next_channel{0};
+    std::atomic<bool> written{true};
+    std::vector<std::thread> writers;
+
+    for (uint32_t thread = 0; thread < std::min<qsizetype>(threads, channels.size()); ++thread)
+    {
+        writers.emplace_back([&]() {
+            for (qsizetype index = next_channel++; index < channels.size(); index = next_channel++)
+            {
+                if (!writeChannel(outputs.at(index), data, chunk_ranges, channels.at(index), settings))
+                {
+                    written = false;
+                }
+            }
+        });
+    }
+
+    for (auto &writer : writers)
+    {
+        writer.join();
+    }
+
+    file.unmap(data);
+    return written;
+}
+
+QStringList ChannelDemuxer::outputFilenames() const
+{
+    return outputs;
+}
+
+quint64 ChannelDemuxer::demuxedPackets() const
+{
+    return demuxed_packets;
+}
+
+bool ChannelDemuxer::writeChannel(const QString &filename, const uchar *data, const QVector<ChunkRanges> &chunks, uint16_t channel,
+                                  const QVector<device::DevicePSDSettings> &settings) const
+{
+    TRACE_SCOPE("ChannelDemuxer::writeChannel");
+
+    QVector<device::DevicePSDSettings> channel_settings;
+    for (const auto &value : settings)
+    {
+        if (value.channelId == channel)
+        {
+            channel_settings.append(value);
+        }
+    }
+
+    if (channel_settings.isEmpty())
+    {
+        qWarning() << "No settings record for channel" << channel << "- writing it without settings.";
+    }
+
+    FileWriter writer(filename, format);
+    writer.write(channel_settings);
+
+    qint64 expected_size = writer.size();
+    std::vector<char> batch;
+    batch.reserve(batch_size);
+
+    auto flush = [&writer, &batch]() {
+        writer.writeFramed(batch.data(), batch.size());
+        batch.clear();
+    };
+
+    for (const auto &chunk : chunks)
+    {
+        // Implicitly shared, this does not copy the ranges.
+        const auto ranges = chunk.value(channel);
+
+        for (const auto &range : ranges)
+        {
+            const char *bytes = reinterpret_cast<const char *>(data + range.offset);
+            expected_size += range.length;
+
+            if (static_cast<qint64>(batch.size()) + range.length > batch_size)
+            {
+                flush();
+            }
+
+            if (range.length >= batch_size)
+            {
+                writer.writeFramed(bytes, range.length);
+            }
+            else
+            {
+                batch.insert(batch.end(), bytes, bytes + range.length);
+            }
+        }
+    }
+    flush();
+
+    bool result = writer.size() == expected_size;
+    if (!result)
+    {
+        qWarning() << "Failed to write channel file" << filename;
+    }
+
+    writer.close();
+    return result;
+}
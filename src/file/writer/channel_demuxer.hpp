@@ -0,0 +1,45 @@
+#ifndef CHANNEL_DEMUXER_HPP
+#define CHANNEL_DEMUXER_HPP
+
+#include "header_structure.hpp"
+#include "packet_framing.hpp"
+#include "chunk_walker.hpp"
+
+#include <QString>
+#include <QStringList>
+#include <QObject>
+#include <QHash>
+
+
+// Splits a .dgs file into one file per chanelId. Packet headers are scanned
+// in parallel byte chunks of the mapped file and only raw byte ranges are
+// grouped per channel; samples are never decoded. Each channel file carries
+// just its own DevicePSDSettings record and is written in large batches.
+class ChannelDemuxer : public QObject
+{
+    Q_OBJECT
+public:
+    explicit ChannelDemuxer(const QString &output_directory, uint32_t threads = 0, QObject *parent = nullptr);
+
+    bool demux(const QString &filename);
+
+    QStringList outputFilenames() const;
+    quint64 demuxedPackets() const;
+
+private:
+    // Neighbouring packets of one channel in a chunk become a single range.
+    using ChunkRanges = QHash<uint16_t, QVector<framing::ByteRange>>;
+
+    bool writeChannel(const QString &filename, const uchar *data, const QVector<ChunkRanges> &chunks, uint16_t channel,
+                      const QVector<device::DevicePSDSettings> &settings) const;
+
+private:
+    QString directory;
+    uint32_t threads;
+    framing::PacketFormat format;
+
+    QStringList outputs;
+    quint64 demuxed_packets;
+};
+
+#endif // CHANNEL_DEMUXER_HPP
@@ -0,0 +1,252 @@
+#include "checkpoint_log.hpp"
+#include "file_validator.hpp"
+#include "validation_defines.hpp"
+#include "trace_events.hpp"
+
+#include <QFile>
+#include <QFileInfo>
+#include <QtEndian>
+#include <QDebug>
+
+#include <cerrno>
+#include <cstring>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+
+namespace
+{
+// magic | crc16 of the rest | reserved | packets | offset, little-endian.
+void encodeRecord(const Checkpoint &checkpoint, uchar *record)
+{
+    std::memcpy(record, default_checkpoint_magic.constData(), 4);
+    qToLittleEndian<quint16>(0, record + 6);
+    qToLittleEndian<quint64>(checkpoint.packets, record + 8);
+    qToLittleEndian<qint64>(checkpoint.offset, record + 16);
+    qToLittleEndian<quint16>(qChecksum(QByteArray::fromRawData(reinterpret_cast<const char *>(record + 6), 18)), record + 4);
+}
+
+bool decodeRecord(const uchar *record, Checkpoint &checkpoint)
+{
+    if (std::memcmp(record, default_checkpoint_magic.constData(), 4) != 0 ||
+        qFromLittleEndian<quint16>(record + 4) != qChecksum(QByteArray::fromRawData(reinterpret_cast<const char *>(record + 6), 18)))
+    {
+        return false;
+    }
+
+    checkpoint.packets = qFromLittleEndian<quint64>(record + 8);
+    checkpoint.offset = qFromLittleEndian<qint64>(record + 16);
+    return true;
+}
+}
+
+CheckpointLog::CheckpointLog() : descriptor(-1)
+{
+}
+
+CheckpointLog::~CheckpointLog()
+{
+    close();
+}
+
+QString CheckpointLog::logFilename(const QString &filename)
+{
+    return default_checkpoint_log.arg(filename);
+}
+
+void CheckpointLog::discard(const QString &filename)
+{
+    QFile::remove(logFilename(filename));
+}
+
+bool CheckpointLog::syncDirectory(const QString &filename)
+{
+    QByteArray directory = QFile::encodeName(QFileInfo(filename).absolutePath());
+
+    int descriptor = ::open(directory.constData(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (descriptor < 0 || ::fsync(descriptor) != 0)
+    {
+        qWarning() << "Failed to sync directory of" << filename << ":" << std::strerror(errno);
+        if (descriptor >= 0)
+        {
+            ::close(descriptor);
+        }
+        return false;
+    }
+
+    ::close(descriptor);
+    return true;
+}
+
+bool CheckpointLog::open(const QString &filename, bool keep)
+{
+    close();
+
+    int flags = O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC | (keep ? 0 : O_TRUNC);
+    descriptor = ::open(QFile::encodeName(logFilename(filename)).constData(), flags, 0644);
+    if (descriptor < 0)
+    {
+        qWarning() << "Failed to open checkpoint log for" << filename << ":" << std::strerror(errno);
+        return false;
+    }
+
+    // Records synced into a log whose directory entry was lost are no use.
+    if (!syncDirectory(logFilename(filename)))
+    {
+        close();
+        return false;
+    }
+
+    return true;
+}
+
+bool CheckpointLog::append(const Checkpoint &checkpoint)
+{
+    if (descriptor < 0)
+    {
+        qWarning() << "Checkpoint log is not open.";
+        return false;
+    }
+
+    uchar record[record_size];
+    encodeRecord(checkpoint, record);
+
+    // Records are far below PIPE_BUF, so an appending write is never split.
+    ssize_t written;
+    do
+    {
+        written = ::write(descriptor, record, record_size);
+    } while (written < 0 && errno == EINTR);
+
+    if (written != record_size || ::fdatasync(descriptor) != 0)
+    {
+        qWarning() << "Failed to append checkpoint:" << std::strerror(errno);
+        return false;
+    }
+
+    return true;
+}
+
+void CheckpointLog::close()
+{
+    if (descriptor >= 0)
+    {
+        ::close(descriptor);
+        descriptor = -1;
+    }
+}
+
+bool CheckpointLog::lastCheckpoint(const QString &filename, Checkpoint &checkpoint, qint64 max_offset)
+{
+    int log = ::open(QFile::encodeName(logFilename(filename)).constData(), O_RDONLY | O_CLOEXEC);
+    if (log < 0)
+    {
+        return false;
+    }
+
+    struct stat status;
+    qint64 records = ::fstat(log, &status) == 0 ? status.st_size / record_size : 0;
+
+    // A torn or corrupted last record just means the one before it counts.
+    bool found = false;
+    uchar record[record_size];
+    for (qint64 index = records - 1; index >= 0 && !found; --index)
+    {
+        found = ::pread(log, record, record_size, index * record_size) == record_size &&
+                decodeRecord(record, checkpoint) && (max_offset < 0 || checkpoint.offset <= max_offset);
+    }
+
+    ::close(log);
+    return found;
+}
+
+bool CheckpointLog::recover(const QString &filename, Recovery &recovery)
+{
+    TRACE_SCOPE("CheckpointLog::recover");
+
+    recovery = Recovery();
+
+    FileValidator validator(filename);
+    if (validator.validateHeader() != FileValidator::ValidationError::None)
+    {
+        qWarning() << "Cannot recover file without a valid header:" << filename;
+        return false;
+    }
+    framing::PacketFormat format = validator.packetFormat();
+    qint64 body_offset = framing::bodyOffset(validator.settingsNumber());
+    validator.close();
+
+    QFile file(filename);
+    if (!file.open(QIODevice::ReadWrite))
+    {
+        qWarning() << "Failed to open file for recovery:" << file.errorString();
+        return false;
+    }
+
+    qint64 file_size = file.size();
+
+    uchar *data = file_size > body_offset ? file.map(0, file_size) : nullptr;
+    if (file_size > body_offset && !data)
+    {
+        qWarning() << "Failed to map file for recovery:" << file.errorString();
+        return false;
+    }
+
+    // A log that outlived its file or belongs to another one with the same
+    // name is only trusted if it points at a packet boundary of this file.
+    Checkpoint start{ 0, body_offset };
+    Checkpoint checkpoint;
+    if (lastCheckpoint(filename, checkpoint, file_size) && checkpoint.offset >= body_offset)
+    {
+        if (checkpoint.offset == file_size ||
+            framing::frameAt(data + checkpoint.offset, file_size - checkpoint.offset, format) > 0)
+        {
+            start = checkpoint;
+            recovery.from_checkpoint = true;
+        }
+        else
+        {
+            qWarning() << "Ignoring stale checkpoint log of" << filename;
+        }
+    }
+
+    // Only the bytes written after the checkpoint can hold a torn packet.
+    qint64 position = start.offset;
+    quint64 packets = start.packets;
+
+    for (qint64 packet_size = 0; position < file_size; position += packet_size, ++packets)
+    {
+        packet_size = framing::frameAt(data + position, file_size - position, format);
+        if (packet_size == 0)
+        {
+            break;
+        }
+    }
+
+    if (data)
+    {
+        file.unmap(data);
+    }
+
+    recovery.scanned_bytes = file_size - start.offset;
+    recovery.truncated_bytes = file_size - position;
+    recovery.packets = packets;
+    recovery.size = position;
+
+    if (position < file_size)
+    {
+        if (!file.resize(position) || ::fsync(file.handle()) != 0)
+        {
+            qWarning() << "Failed to truncate torn tail of" << filename << ":" << file.errorString();
+            return false;
+        }
+        qWarning() << "Cut" << recovery.truncated_bytes << "bytes of torn packet data from" << filename;
+    }
+    file.close();
+
+    // The next recovery of this file starts right here.
+    CheckpointLog log;
+    return log.open(filename, true) && log.append({ packets, position });
+}
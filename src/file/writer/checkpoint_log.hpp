@@ -0,0 +1,59 @@
+#ifndef CHECKPOINT_LOG_HPP
+#define CHECKPOINT_LOG_HPP
+
+#include <QString>
+#include <QtGlobal>
+
+
+// A durable prefix of a .dgs file: offset bytes holding packets packets.
+struct Checkpoint
+{
+    quint64 packets;
+    qint64 offset;
+};
+
+// Append-only <file>.dgsc log of fixed size checkpoint records, each guarded
+// by its own checksum. A record is only appended once the data it describes
+// has reached the disk, so the last intact record bounds what a crash can
+// have lost and recovery only has to look at the bytes after it.
+class CheckpointLog
+{
+public:
+    struct Recovery
+    {
+        quint64 packets = 0;         // complete packets kept
+        qint64 size = 0;             // file size after recovery
+        qint64 truncated_bytes = 0;  // torn tail that was cut off
+        qint64 scanned_bytes = 0;    // tail validated after the checkpoint
+        bool from_checkpoint = false;
+    };
+
+    static constexpr qint64 record_size = 24;
+
+    CheckpointLog();
+    ~CheckpointLog();
+
+    static QString logFilename(const QString &filename);
+    // Removes the log of filename, which would describe the bytes of an
+    // earlier file of that name.
+    static void discard(const QString &filename);
+    // Makes the directory entry of a newly created filename durable.
+    static bool syncDirectory(const QString &filename);
+
+    // Opens the log of filename, starting it over unless keep is set.
+    bool open(const QString &filename, bool keep = false);
+    // Appends and syncs a record.
+    bool append(const Checkpoint &checkpoint);
+    void close();
+
+    // The newest intact record, read back from the end of the log.
+    static bool lastCheckpoint(const QString &filename, Checkpoint &checkpoint, qint64 max_offset = -1);
+    // Cuts a file left by a crashed writer back to its last complete packet,
+    // scanning only what follows the last checkpoint.
+    static bool recover(const QString &filename, Recovery &recovery);
+
+private:
+    int descriptor;
+};
+
+#endif // CHECKPOINT_LOG_HPP
@@ -0,0 +1,282 @@
+#include "file_merger.hpp"
+#include "checkpoint_log.hpp"
+#include "file_validator.hpp"
+#include "packet_framing.hpp"
+#include "time_index.hpp"
+#include "trace_events.hpp"
+
+#include <QFile>
+#include <QDebug>
+
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+
+namespace
+{
+constexpr qint64 buffered_copy_size = 8 * 1024 * 1024;
+}
+
+FileMerger::FileMerger(const QString &output_filename, QObject *parent)
+    : QObject(parent), output(output_filename), merged_packets(0), spliced_bytes(0), copied_bytes(0), splice_supported(true)
+{
+}
+
+bool FileMerger::merge(const QStringList &filenames)
+{
+    TRACE_SCOPE("FileMerger::merge");
+
+    merged_packets = 0;
+    spliced_bytes = 0;
+    copied_bytes = 0;
+
+    if (filenames.isEmpty())
+    {
+        qWarning() << "No files to merge.";
+        return false;
+    }
+
+    // Bodies can only be spliced if every file was written with byte for byte
+    // the same header: same format version, same settings, same hash.
+    QVector<Input> inputs(filenames.size());
+    QByteArray header;
+
+    for (qsizetype index = 0; index < filenames.size(); ++index)
+    {
+        QByteArray input_header;
+        if (!inspect(filenames.at(index), inputs[index], input_header))
+        {
+            return false;
+        }
+
+        if (index == 0)
+        {
+            header = input_header;
+        }
+        else if (input_header != header)
+        {
+            qWarning() << "Settings header of" << filenames.at(index) << "differs from" << filenames.first();
+            return false;
+        }
+    }
+
+    // Build next to the target and rename on success, a failed merge never
+    // leaves a half written file under the output name.
+    const QString partial = output + ".part";
+    const QByteArray partial_path = QFile::encodeName(partial);
+
+    int descriptor = ::open(partial_path.constData(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (descriptor < 0)
+    {
+        qWarning() << "Failed to open" << partial << "for writing:" << std::strerror(errno);
+        return false;
+    }
+
+    bool result = ::write(descriptor, header.constData(), header.size()) == header.size();
+    if (!result)
+    {
+        qWarning() << "Failed to write merged header:" << std::strerror(errno);
+    }
+
+    for (qsizetype index = 0; result && index < inputs.size(); ++index)
+    {
+        result = appendBody(descriptor, inputs.at(index));
+        merged_packets += inputs.at(index).packets;
+    }
+
+    // The rename must not become durable before the bytes it publishes.
+    if (result && ::fsync(descriptor) != 0)
+    {
+        qWarning() << "Failed to flush" << partial << ":" << std::strerror(errno);
+        result = false;
+    }
+
+    result = (::close(descriptor) == 0) && result;
+
+    if (!result || std::rename(partial_path.constData(), QFile::encodeName(output).constData()) != 0)
+    {
+        qWarning() << "Failed to merge into" << output;
+        ::unlink(partial_path.constData());
+        merged_packets = 0;
+        return false;
+    }
+
+    CheckpointLog::syncDirectory(output);
+    CheckpointLog::discard(output);
+
+    mergeTimeIndexes(inputs, output, header.size());
+    return true;
+}
+
+quint64 FileMerger::mergedPackets() const
+{
+    return merged_packets;
+}
+
+qint64 FileMerger::splicedBytes() const
+{
+    return spliced_bytes;
+}
+
+qint64 FileMerger::copiedBytes() const
+{
+    return copied_bytes;
+}
+
+bool FileMerger::inspect(const QString &filename, Input &input, QByteArray &header)
+{
+    FileValidator validator(filename);
+    if (validator.validateFile() != FileValidator::ValidationError::None)
+    {
+        qWarning() << "Refusing to merge invalid file" << filename;
+        return false;
+    }
+
+    QFile file(filename);
+    if (!file.open(QIODevice::ReadOnly))
+    {
+        qWarning() << "Failed to open file for reading:" << file.errorString();
+        return false;
+    }
+
+    input.filename = filename;
+    input.body_offset = framing::bodyOffset(validator.settingsNumber());
+    input.size = file.size();
+    input.packets = validator.validPacketNumber();
+
+    header = file.read(input.body_offset);
+    if (header.size() != input.body_offset)
+    {
+        qWarning() << "Failed to read header of" << filename;
+        return false;
+    }
+
+    return true;
+}
+
+bool FileMerger::appendBody(int output, const Input &input)
+{
+    TRACE_SCOPE("FileMerger::appendBody");
+
+    int descriptor = ::open(QFile::encodeName(input.filename).constData(), O_RDONLY | O_CLOEXEC);
+    if (descriptor < 0)
+    {
+        qWarning() << "Failed to open" << input.filename << "for reading:" << std::strerror(errno);
+        return false;
+    }
+
+    loff_t offset = input.body_offset;
+    qint64 remaining = input.size - input.body_offset;
+
+    while (splice_supported && remaining > 0)
+    {
+        ssize_t spliced = ::copy_file_range(descriptor, &offset, output, nullptr, remaining, 0);
+        if (spliced > 0)
+        {
+            remaining -= spliced;
+            spliced_bytes += spliced;
+            continue;
+        }
+
+        if (spliced == 0)
+        {
+            qWarning() << input.filename << "ended before its validated size.";
+            ::close(descriptor);
+            return false;
+        }
+
+        if (errno == EINTR)
+        {
+            continue;
+        }
+
+        // Old kernels, cross-filesystem copies and special files: remember it
+        // and copy the rest through user space.
+        if (errno == ENOSYS || errno == EXDEV || errno == EINVAL || errno == EOPNOTSUPP)
+        {
+            splice_supported = false;
+            break;
+        }
+
+        qWarning() << "Failed to copy body of" << input.filename << ":" << std::strerror(errno);
+        ::close(descriptor);
+        return false;
+    }
+
+    bool result = remaining == 0 || copyBuffered(descriptor, offset, output, remaining);
+    ::close(descriptor);
+    return result;
+}
+
+bool FileMerger::copyBuffered(int input, qint64 offset, int output, qint64 length)
+{
+    std::vector<char> buffer(std::min(length, buffered_copy_size));
+
+    posix_fadvise(input, offset, length, POSIX_FADV_SEQUENTIAL);
+
+    while (length > 0)
+    {
+        ssize_t read_bytes = ::pread(input, buffer.data(), std::min<qint64>(length, buffer.size()), offset);
+        if (read_bytes < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if (read_bytes <= 0)
+        {
+            qWarning() << "Failed to read body:" << (read_bytes < 0 ? std::strerror(errno) : "unexpected end of file");
+            return false;
+        }
+
+        for (ssize_t written = 0; written < read_bytes;)
+        {
+            ssize_t result = ::write(output, buffer.data() + written, read_bytes - written);
+            if (result < 0 && errno == EINTR)
+            {
+                continue;
+            }
+            if (result < 0)
+            {
+                qWarning() << "Failed to write body:" << std::strerror(errno);
+                return false;
+            }
+            written += result;
+        }
+
+        offset += read_bytes;
+        length -= read_bytes;
+        copied_bytes += read_bytes;
+    }
+
+    return true;
+}
+
+void FileMerger::mergeTimeIndexes(const QVector<Input> &inputs, const QString &filename, qint64 header_size)
+{
+    // Only timestamped inputs carry a time index, and a merged index is only
+    // worth writing if every input has a current one. An index left from an
+    // earlier file of the output name must not survive either way.
+    QFile::remove(TimeIndex::indexFilename(filename));
+
+    TimeIndex merged;
+    qint64 offset_shift = header_size;
+
+    for (const auto &input : inputs)
+    {
+        TimeIndex index;
+        if (!index.load(input.filename, input.body_offset) || index.packetCount() != input.packets)
+        {
+            return;
+        }
+
+        merged.append(index, offset_shift - input.body_offset);
+        offset_shift += input.size - input.body_offset;
+    }
+
+    merged.finish();
+    merged.save(filename);
+}
@@ -0,0 +1,50 @@
+#ifndef FILE_MERGER_HPP
+#define FILE_MERGER_HPP
+
+#include <QString>
+#include <QStringList>
+#include <QObject>
+
+
+// Concatenates .dgs files that share a settings header without decoding a
+// single packet: the header is written once and every body is spliced with
+// copy_file_range, so the bytes move inside the kernel instead of through
+// user space. Bodies start right after the header, not on a block boundary,
+// so the copies are never turned into shared reflink extents. Falls back to
+// large buffered copies where copy_file_range is not supported.
+class FileMerger : public QObject
+{
+    Q_OBJECT
+public:
+    explicit FileMerger(const QString &output_filename, QObject *parent = nullptr);
+
+    bool merge(const QStringList &filenames);
+
+    quint64 mergedPackets() const;
+    qint64 splicedBytes() const;
+    qint64 copiedBytes() const;
+
+private:
+    struct Input
+    {
+        QString filename;
+        qint64 body_offset;
+        qint64 size;
+        uint32_t packets;
+    };
+
+    bool inspect(const QString &filename, Input &input, QByteArray &header);
+    bool appendBody(int output, const Input &input);
+    bool copyBuffered(int input, qint64 offset, int output, qint64 length);
+    void mergeTimeIndexes(const QVector<Input> &inputs, const QString &filename, qint64 header_size);
+
+private:
+    QString output;
+
+    quint64 merged_packets;
+    qint64 spliced_bytes;
+    qint64 copied_bytes;
+    bool splice_supported;
+};
+
+#endif // FILE_MERGER_HPP
@@ -1,4 +1,5 @@
 #include "file_writer.hpp"
+#include "trace_events.hpp"
 #include "validation_defines.hpp"
 
 #include <QDataStream>
@@ -6,17 +7,35 @@
 #include <QDebug>
 #include <limits>
 
+#include <unistd.h>
 
-FileWriter::FileWriter(QObject *parent) : QObject(parent), file(nullptr)
+
+FileWriter::FileWriter(QObject *parent) : QObject(parent), file(nullptr), packet_format(framing::PacketFormat::Plain), packet_count(0),
+      policy{ 0, 0 }, committed_size(0)
 {
     initialize();
 }
 
-FileWriter::FileWriter(const QString &filename, QObject *parent) : QObject(parent), file(nullptr)
+FileWriter::FileWriter(const QString &filename, QObject *parent) : QObject(parent), file(nullptr), packet_format(framing::PacketFormat::Plain), packet_count(0),
+      policy{ 0, 0 }, committed_size(0)
+{
+    initialize(filename);
+}
+
+FileWriter::FileWriter(const QString &filename, framing::PacketFormat format, uint32_t time_index_interval, QObject *parent)
+    : QObject(parent), file(nullptr), packet_format(format), time_index(time_index_interval), packet_count(0),
+      policy{ 0, 0 }, committed_size(0)
 {
     initialize(filename);
 }
 
+FileWriter::FileWriter(const QString &filename, int descriptor, QObject *parent)
+    : QObject(parent), file(nullptr), packet_format(framing::PacketFormat::Plain), packet_count(0),
+      policy{ 0, 0 }, committed_size(0)
+{
+    initialize(filename, descriptor);
+}
+
 FileWriter::~FileWriter()
 {
     close();
@@ -25,34 +44,45 @@ FileWriter::~FileWriter()
 
 void FileWriter::write(const QVector<device::DevicePSDSettings> &settings_array)
 {
+    TRACE_SCOPE("FileWriter::writeSettings");
+
     if (!file || !file->isOpen())
     {
         qWarning() << "File is not open for writing.";
         return;
     }
 
-    QByteArray buffer;
-    QDataStream out(&buffer, QIODevice::WriteOnly);
-
     if (settings_array.size() > std::numeric_limits<uint16_t>::max())
     {
         qWarning() << "Invalid settings array size.";
         return;
     }
-    out << static_cast<uint16_t>(settings_array.size());
 
-    for (const auto& settings : settings_array)
+    file->write(encodeSettings(settings_array));
+}
+
+void FileWriter::write(const QVector<device::WaveformPacket> &waveform_array)
+{
+    write(std::span<const device::WaveformPacket>(waveform_array.constData(), waveform_array.size()));
+}
+
+void FileWriter::write(std::span<const device::WaveformPacket> waveforms)
+{
+    TRACE_SCOPE("FileWriter::writeWaveforms");
+
+    if (!file || !file->isOpen())
     {
-        out << settings;
+        qWarning() << "File is not open for writing.";
+        return;
     }
 
-    QByteArray hash = QCryptographicHash::hash(buffer, QCryptographicHash::Md5);
-
-    file->write(buffer);
-    file->write(hash);
+    for (const auto &waveform : waveforms)
+    {
+        write(waveform);
+    }
 }
 
-void FileWriter::write(const QVector<device::WaveformPacket> &waveform_array)
+void FileWriter::write(const device::WaveformPacket &waveform)
 {
     if (!file || !file->isOpen())
     {
@@ -60,31 +90,146 @@ void FileWriter::write(const QVector<device::WaveformPacket> &waveform_array)
         return;
     }
 
-    for (const auto& waveform : waveform_array)
+    if (waveform.values.size() > std::numeric_limits<quint32>::max())
+    {
+        qWarning() << "Invalid waveform packet size.";
+        return;
+    }
+
+    // Encoded into a buffer that keeps its capacity between packets.
+    packet_buffer.resize(framing::packetSize(waveform.values.size(), packet_format));
+    qint64 size = framing::encodePacket(waveform, reinterpret_cast<uchar *>(packet_buffer.data()), packet_format);
+    qint64 offset = file->pos();
+
+    if (file->write(packet_buffer.constData(), size) != size)
+    {
+        qWarning() << "Failed to write waveform packet:" << file->errorString();
+        return;
+    }
+    ++packet_count;
+
+    if (packet_format == framing::PacketFormat::Timestamped)
+    {
+        time_index.add(offset, waveform.timestamp);
+    }
+
+    commitIfDue();
+}
+
+void FileWriter::writeFramed(const char *data, qint64 size)
+{
+    if (!file || !file->isOpen())
     {
-        QByteArray buffer;
-        QDataStream out(&buffer, QIODevice::WriteOnly);
+        qWarning() << "File is not open for writing.";
+        return;
+    }
 
-        if (waveform.values.size() > std::numeric_limits<quint32>::max())
+    // Checkpoints count packets, so durable writes walk the frames as well.
+    quint64 frames_count = 0;
+    if (packet_format == framing::PacketFormat::Timestamped || checkpoint_log)
+    {
+        const uchar *frames = reinterpret_cast<const uchar *>(data);
+        for (qint64 position = 0, packet_size = 0; position < size; position += packet_size, ++frames_count)
         {
-            qWarning() << "Invalid waveform packet size.";
-            return;
+            packet_size = framing::frameAt(frames + position, size - position, packet_format);
+            if (packet_size == 0)
+            {
+                qWarning() << "Framed waveforms do not match the packet layout.";
+                return;
+            }
+
+            if (packet_format == framing::PacketFormat::Timestamped)
+            {
+                time_index.add(file->pos() + position, framing::PacketView{ frames + position, packet_size, packet_format }.timestamp());
+            }
         }
-        out.writeRawData(default_body_prefix, 4);
+    }
+
+    if (file->write(data, size) != size)
+    {
+        qWarning() << "Failed to write framed waveforms:" << file->errorString();
+        return;
+    }
+    packet_count += frames_count;
+
+    commitIfDue();
+}
+
+bool FileWriter::setCommitPolicy(const CommitPolicy &commit_policy)
+{
+    if (!file || !file->isOpen())
+    {
+        qWarning() << "File is not open for writing.";
+        return false;
+    }
+
+    auto log = std::make_unique<CheckpointLog>();
+    if (!log->open(file->fileName()))
+    {
+        return false;
+    }
+
+    policy = commit_policy;
+    checkpoint_log = std::move(log);
+    commit_timer.start();
 
-        out << waveform;
+    return true;
+}
+
+bool FileWriter::commit()
+{
+    TRACE_SCOPE("FileWriter::commit");
+
+    if (!file || !file->isOpen() || !checkpoint_log)
+    {
+        qWarning() << "File is not open for durable writing.";
+        return false;
+    }
+
+    commit_timer.restart();
 
-        out.writeRawData(default_body_prefix, 4);
+    qint64 position = file->pos();
+    if (position == committed_size)
+    {
+        return true;
+    }
 
-        file->write(buffer);
+    // Data first: a checkpoint must never describe bytes that are not on disk.
+    if (!file->flush() || ::fdatasync(file->handle()) != 0)
+    {
+        qWarning() << "Failed to sync" << file->fileName() << ":" << file->errorString();
+        return false;
     }
+
+    if (!checkpoint_log->append({ packet_count, position }))
+    {
+        return false;
+    }
+
+    committed_size = position;
+    return true;
 }
 
 void FileWriter::close()
 {
+    TRACE_SCOPE("FileWriter::close");
+
     if (file && file->isOpen())
     {
+        if (checkpoint_log)
+        {
+            commit();
+            checkpoint_log.reset();
+        }
+
         file->close();
+
+        // The index is keyed on the finished file, so it is written last.
+        if (packet_format == framing::PacketFormat::Timestamped)
+        {
+            time_index.finish();
+            time_index.save(file->fileName());
+        }
     }
 }
 
@@ -98,8 +243,25 @@ QString FileWriter::filename()
     return "";
 }
 
-bool FileWriter::initialize(QString filename)
+qint64 FileWriter::size() const
+{
+    if (file && file->isOpen())
+    {
+        return file->pos();
+    }
+
+    return 0;
+}
+
+quint64 FileWriter::packetCount() const
+{
+    return packet_count;
+}
+
+bool FileWriter::initialize(QString filename, int descriptor)
 {
+    TRACE_SCOPE("FileWriter::open");
+
     if (filename.isEmpty())
     {
         filename = default_filename.arg(QDateTime::currentDateTime().toString(default_datetime), "test");
@@ -112,17 +274,72 @@ bool FileWriter::initialize(QString filename)
         return false;
     }
 
-    if (!file->open(QIODevice::WriteOnly))
+    bool opened = (descriptor < 0) ? file->open(QIODevice::WriteOnly)
+                                   : file->open(descriptor, QIODevice::WriteOnly, QFileDevice::AutoCloseHandle);
+    if (!opened)
     {
         qWarning() << "Failed to open file for writing:" << file->errorString();
+        if (descriptor >= 0)
+        {
+            ::close(descriptor);
+        }
         delete file;
         file = nullptr;
         return false;
     }
 
-    QString signatureString = default_signature.arg(version_major, version_minor, version_patch);
-    QByteArray signature = QByteArray::fromHex(signatureString.toUtf8());
-    file->write(signature);
+    // An adopted descriptor was created, and its directory synced, by the
+    // caller.
+    if (descriptor < 0)
+    {
+        file->write(encodeSignature(packet_format));
+        CheckpointLog::syncDirectory(filename);
+    }
+    else
+    {
+        file->seek(file->size());
+    }
+
+    CheckpointLog::discard(filename);
 
     return true;
 }
+
+void FileWriter::commitIfDue()
+{
+    if (!checkpoint_log)
+    {
+        return;
+    }
+
+    bool size_exceeded = policy.max_bytes > 0 && file->pos() - committed_size >= policy.max_bytes;
+    bool delay_exceeded = policy.max_delay_ms > 0 && commit_timer.hasExpired(policy.max_delay_ms);
+
+    if (size_exceeded || delay_exceeded)
+    {
+        commit();
+    }
+}
+
+QByteArray FileWriter::encodeSignature(framing::PacketFormat format)
+{
+    QString signatureString = (format == framing::PacketFormat::Timestamped)
+                                  ? default_signature.arg(version_major, timestamped_version_minor_string, timestamped_version_patch)
+                                  : default_signature.arg(version_major, version_minor, version_patch);
+    return QByteArray::fromHex(signatureString.toUtf8());
+}
+
+QByteArray FileWriter::encodeSettings(const QVector<device::DevicePSDSettings> &settings_array)
+{
+    QByteArray buffer;
+    QDataStream out(&buffer, QIODevice::WriteOnly);
+
+    out << static_cast<uint16_t>(settings_array.size());
+
+    for (const auto& settings : settings_array)
+    {
+        out << settings;
+    }
+
+    return buffer + QCryptographicHash::hash(buffer, QCryptographicHash::Md5);
+}
@@ -3,33 +3,80 @@
 
 #include "header_structure.hpp"
 #include "packet_structure.hpp"
+#include "packet_framing.hpp"
+#include "time_index.hpp"
+#include "checkpoint_log.hpp"
 
 #include <QString>
 #include <QByteArray>
 #include <QObject>
 #include <QFile>
 #include <QDateTime>
+#include <QElapsedTimer>
+
+#include <memory>
+#include <span>
 
 class FileWriter : QObject
 {
     Q_OBJECT
 public:
+    // Group commit: written packets are synced to disk together once either
+    // limit is reached, and a checkpoint of the synced prefix is appended to
+    // the <file>.dgsc log for CheckpointLog::recover().
+    struct CommitPolicy
+    {
+        qint64 max_bytes;    // 0 - no size limit
+        qint64 max_delay_ms; // 0 - no delay limit
+    };
+
     explicit FileWriter(QObject *parent = nullptr);
     explicit FileWriter(const QString &filename, QObject *parent = nullptr);
+    // Timestamped files also get a sparse time index written on close().
+    explicit FileWriter(const QString &filename, framing::PacketFormat format,
+                        uint32_t time_index_interval = default_time_index_interval, QObject *parent = nullptr);
+    // Takes over descriptor of filename, created ahead of time on another
+    // thread with its header already written, and appends after it.
+    explicit FileWriter(const QString &filename, int descriptor, QObject *parent = nullptr);
     ~FileWriter();
 
     void write(const QVector<device::DevicePSDSettings> &settings_array);
     void write(const QVector<device::WaveformPacket> &waveform_array);
+    void write(std::span<const device::WaveformPacket> waveforms);
+    void write(const device::WaveformPacket &waveform);
+    void writeFramed(const char *data, qint64 size);
+
+    // Enables durability mode; call before the first waveform is written.
+    bool setCommitPolicy(const CommitPolicy &commit_policy);
+    // Syncs everything written so far and checkpoints it.
+    bool commit();
 
     void close();
 
     QString filename();
+    qint64 size() const;
+    quint64 packetCount() const;
+
+    // Signature and settings/MD5 header as written by this class, for writers
+    // that lay out files themselves.
+    static QByteArray encodeSignature(framing::PacketFormat format);
+    static QByteArray encodeSettings(const QVector<device::DevicePSDSettings> &settings_array);
 
 private:
-    bool initialize(QString filename = "");
+    bool initialize(QString filename = "", int descriptor = -1);
+    void commitIfDue();
 
 private:
     QFile *file;
+    framing::PacketFormat packet_format;
+    TimeIndex time_index;
+    QByteArray packet_buffer;
+    quint64 packet_count;
+
+    CommitPolicy policy;
+    std::unique_ptr<CheckpointLog> checkpoint_log;
+    qint64 committed_size;
+    QElapsedTimer commit_timer;
 };
 
 #endif // FILE_WRITER_HPP
@@ -0,0 +1,201 @@
+#include "parallel_file_writer.hpp"
+#include "file_writer.hpp"
+#include "checkpoint_log.hpp"
+#include "packet_framing.hpp"
+#include "trace_events.hpp"
+
+#include <QFile>
+#include <QDebug>
+
+#include <cerrno>
+#include <cstring>
+#include <limits>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+
+ParallelFileWriter::ParallelFileWriter(const QString &filename, uint32_t threads, Ordering ordering, QObject *parent)
+    : QObject(parent), descriptor(-1), ordering(ordering), cursor(0), failed(false), closing(false)
+{
+    descriptor = ::open(QFile::encodeName(filename).constData(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (descriptor < 0)
+    {
+        qWarning() << "Failed to open file for writing:" << std::strerror(errno);
+        failed = true;
+        return;
+    }
+
+    CheckpointLog::syncDirectory(filename);
+    CheckpointLog::discard(filename);
+
+    QByteArray signature = FileWriter::encodeSignature(framing::PacketFormat::Plain);
+    failed = !writeAt(signature.constData(), signature.size(), 0);
+    cursor = signature.size();
+
+    threads = threads > 0 ? threads : std::max(1u, std::thread::hardware_concurrency());
+    queue_limit = threads * 2;
+
+    for (uint32_t thread = 0; thread < threads; ++thread)
+    {
+        encoders.emplace_back(&ParallelFileWriter::encodeBatches, this);
+    }
+}
+
+ParallelFileWriter::~ParallelFileWriter()
+{
+    close();
+}
+
+void ParallelFileWriter::write(const QVector<device::DevicePSDSettings> &settings_array)
+{
+    if (descriptor < 0)
+    {
+        qWarning() << "File is not open for writing.";
+        return;
+    }
+
+    if (settings_array.size() > std::numeric_limits<uint16_t>::max())
+    {
+        qWarning() << "Invalid settings array size.";
+        return;
+    }
+
+    QByteArray header = FileWriter::encodeSettings(settings_array);
+    if (!writeAt(header.constData(), header.size(), cursor.fetch_add(header.size())))
+    {
+        failed = true;
+    }
+}
+
+void ParallelFileWriter::write(const QVector<device::WaveformPacket> &waveform_array)
+{
+    if (descriptor < 0)
+    {
+        qWarning() << "File is not open for writing.";
+        return;
+    }
+
+    if (waveform_array.isEmpty())
+    {
+        return;
+    }
+
+    // Packet sizes follow from the headers alone, so a batch can claim its
+    // place in the file before anyone has encoded it.
+    qint64 batch_size = 0;
+    for (const auto &waveform : waveform_array)
+    {
+        batch_size += framing::packetSize(waveform.values.size());
+    }
+
+    std::unique_lock<std::mutex> guard(queue_lock);
+    queue_space.wait(guard, [this]() { return queue.size() < queue_limit || closing; });
+
+    qint64 offset = (ordering == Ordering::Ordered) ? cursor.fetch_add(batch_size) : -1;
+    queue.push_back({ waveform_array, offset, batch_size });
+
+    guard.unlock();
+    queue_ready.notify_one();
+}
+
+void ParallelFileWriter::close()
+{
+    {
+        std::lock_guard<std::mutex> guard(queue_lock);
+        closing = true;
+    }
+    queue_ready.notify_all();
+    queue_space.notify_all();
+
+    for (auto &encoder : encoders)
+    {
+        encoder.join();
+    }
+    encoders.clear();
+
+    if (descriptor >= 0)
+    {
+        if (::close(descriptor) != 0)
+        {
+            qWarning() << "Failed to close file:" << std::strerror(errno);
+            failed = true;
+        }
+        descriptor = -1;
+    }
+}
+
+bool ParallelFileWriter::hasFailed() const
+{
+    return failed;
+}
+
+qint64 ParallelFileWriter::size() const
+{
+    return cursor;
+}
+
+void ParallelFileWriter::encodeBatches()
+{
+    QByteArray buffer;
+
+    for (;;)
+    {
+        Batch batch;
+        {
+            std::unique_lock<std::mutex> guard(queue_lock);
+            queue_ready.wait(guard, [this]() { return !queue.empty() || closing; });
+
+            if (queue.empty())
+            {
+                return;
+            }
+
+            batch = std::move(queue.front());
+            queue.pop_front();
+        }
+        queue_space.notify_one();
+
+        TRACE_SCOPE("ParallelFileWriter::encodeBatch");
+
+        buffer.resize(batch.size);
+        uchar *out = reinterpret_cast<uchar *>(buffer.data());
+        for (const auto &waveform : batch.waveforms)
+        {
+            out += framing::encodePacket(waveform, out);
+        }
+
+        if (batch.offset < 0)
+        {
+            batch.offset = cursor.fetch_add(batch.size);
+        }
+
+        if (!writeAt(buffer.constData(), batch.size, batch.offset))
+        {
+            failed = true;
+        }
+    }
+}
+
+bool ParallelFileWriter::writeAt(const char *data, qint64 size, qint64 offset)
+{
+    while (size > 0)
+    {
+        ssize_t written = ::pwrite(descriptor, data, size, offset);
+        if (written < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if (written <= 0)
+        {
+            qWarning() << "Failed to write at offset" << offset << ":" << std::strerror(errno);
+            return false;
+        }
+
+        data += written;
+        size -= written;
+        offset += written;
+    }
+
+    return true;
+}
@@ -0,0 +1,77 @@
+#ifndef PARALLEL_FILE_WRITER_HPP
+#define PARALLEL_FILE_WRITER_HPP
+
+#include "header_structure.hpp"
+#include "packet_structure.hpp"
+
+#include <QString>
+#include <QVector>
+#include <QObject>
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+
+// Writes a .dgs file with several threads encoding packet batches at once.
+// Every batch gets its file offset from an atomic cursor and is written with
+// pwrite at that offset, so encoders never wait for each other. In Ordered
+// mode the offset is reserved when the batch is submitted and the file keeps
+// submission order; in Unordered mode it is reserved once a batch is encoded
+// and batches land in completion order.
+class ParallelFileWriter : public QObject
+{
+    Q_OBJECT
+public:
+    enum class Ordering
+    {
+        Ordered,
+        Unordered
+    };
+
+    explicit ParallelFileWriter(const QString &filename, uint32_t threads = 0, Ordering ordering = Ordering::Ordered,
+                                QObject *parent = nullptr);
+    ~ParallelFileWriter();
+
+    // Settings must be written before the first batch.
+    void write(const QVector<device::DevicePSDSettings> &settings_array);
+    // Takes a shared copy of the batch; blocks while too many are in flight.
+    void write(const QVector<device::WaveformPacket> &waveform_array);
+
+    void close();
+
+    bool hasFailed() const;
+    qint64 size() const;
+
+private:
+    struct Batch
+    {
+        QVector<device::WaveformPacket> waveforms;
+        qint64 offset; // -1 until reserved
+        qint64 size;
+    };
+
+    void encodeBatches();
+    bool writeAt(const char *data, qint64 size, qint64 offset);
+
+private:
+    int descriptor;
+    Ordering ordering;
+
+    std::atomic<qint64> cursor;
+    std::atomic<bool> failed;
+
+    std::mutex queue_lock;
+    std::condition_variable queue_ready;
+    std::condition_variable queue_space;
+    std::deque<Batch> queue;
+    size_t queue_limit;
+    bool closing;
+
+    std::vector<std::thread> encoders;
+};
+
+#endif // PARALLEL_FILE_WRITER_HPP
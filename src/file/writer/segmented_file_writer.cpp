@@ -0,0 +1,275 @@
+#include "segmented_file_writer.hpp"
+#include "validation_defines.hpp"
+#include "packet_framing.hpp"
+
+#include <QDateTime>
+#include <QFileInfo>
+#include <QSaveFile>
+#include <QDebug>
+
+#include <chrono>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+
+SegmentedFileWriter::SegmentedFileWriter(const RotationPolicy &policy, QObject *parent)
+    : QObject(parent), policy(policy), segment_index(0)
+{
+    initialize("");
+}
+
+SegmentedFileWriter::SegmentedFileWriter(const QString &base_name, const RotationPolicy &policy, QObject *parent)
+    : QObject(parent), policy(policy), segment_index(0)
+{
+    initialize(base_name);
+}
+
+SegmentedFileWriter::~SegmentedFileWriter()
+{
+    close();
+}
+
+void SegmentedFileWriter::write(const QVector<device::DevicePSDSettings> &settings_array)
+{
+    if (!current)
+    {
+        qWarning() << "Segment is not open for writing.";
+        return;
+    }
+
+    settings = settings_array;
+    current->write(settings);
+
+    // The next segment was given the previous header.
+    discardNextSegment();
+    prepareNextSegment();
+}
+
+void SegmentedFileWriter::write(const QVector<device::WaveformPacket> &waveform_array)
+{
+    write(std::span<const device::WaveformPacket>(waveform_array.constData(), waveform_array.size()));
+}
+
+void SegmentedFileWriter::write(std::span<const device::WaveformPacket> waveforms)
+{
+    for (const auto &waveform : waveforms)
+    {
+        write(waveform);
+    }
+}
+
+void SegmentedFileWriter::write(const device::WaveformPacket &waveform)
+{
+    if (!current)
+    {
+        qWarning() << "Segment is not open for writing.";
+        return;
+    }
+
+    if (segment_packets.last() != 0)
+    {
+        bool size_exceeded = policy.max_bytes > 0 &&
+                             current->size() + framing::packetSize(waveform.values.size()) > policy.max_bytes;
+        bool duration_exceeded = policy.max_duration_ms > 0 && segment_timer.hasExpired(policy.max_duration_ms);
+
+        // A segment that cannot be rotated yet keeps taking packets.
+        if (size_exceeded || duration_exceeded)
+        {
+            rotate();
+        }
+    }
+
+    current->write(waveform);
+    ++segment_packets.last();
+}
+
+void SegmentedFileWriter::close()
+{
+    discardNextSegment();
+    waitForRetired();
+
+    if (current)
+    {
+        current->close();
+        current.reset();
+        writeManifest();
+    }
+}
+
+QString SegmentedFileWriter::manifestFilename() const
+{
+    return default_manifest.arg(base);
+}
+
+QStringList SegmentedFileWriter::segmentFilenames() const
+{
+    return segments;
+}
+
+bool SegmentedFileWriter::initialize(QString base_name)
+{
+    if (base_name.isEmpty())
+    {
+        base_name = QString::fromLatin1("output_%1").arg(QDateTime::currentDateTime().toString(default_datetime));
+    }
+    base = base_name;
+
+    current = std::make_unique<FileWriter>(segmentFilename(segment_index));
+    if (current->filename().isEmpty())
+    {
+        qWarning() << "Failed to open first segment.";
+        current.reset();
+        return false;
+    }
+
+    segments.append(current->filename());
+    segment_packets.append(0);
+    segment_timer.start();
+
+    writeManifest();
+    prepareNextSegment();
+
+    return true;
+}
+
+QString SegmentedFileWriter::segmentFilename(uint32_t index) const
+{
+    return default_segment.arg(base).arg(index, 6, 10, QChar('0'));
+}
+
+void SegmentedFileWriter::prepareNextSegment()
+{
+    QByteArray header = FileWriter::encodeSignature(framing::PacketFormat::Plain);
+    if (!settings.isEmpty())
+    {
+        header += FileWriter::encodeSettings(settings);
+    }
+
+    next_filename = segmentFilename(segment_index + 1);
+    next = std::async(std::launch::async, [filename = next_filename, header]() {
+        QByteArray path = QFile::encodeName(filename);
+        int descriptor = ::open(path.constData(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+        if (descriptor >= 0 && ::write(descriptor, header.constData(), header.size()) != header.size())
+        {
+            ::close(descriptor);
+            ::unlink(path.constData());
+            return -1;
+        }
+
+        // Synced here, so adopting the descriptor does not block the writer.
+        if (descriptor >= 0)
+        {
+            CheckpointLog::syncDirectory(filename);
+        }
+        return descriptor;
+    });
+}
+
+void SegmentedFileWriter::discardNextSegment()
+{
+    if (!next.valid())
+    {
+        return;
+    }
+
+    int descriptor = next.get();
+    if (descriptor >= 0)
+    {
+        ::close(descriptor);
+        QFile::remove(next_filename);
+    }
+}
+
+bool SegmentedFileWriter::rotate()
+{
+    // Packets go on into the current segment until the next one is ready.
+    if (!next.valid() || next.wait_for(std::chrono::seconds(0)) != std::future_status::ready)
+    {
+        if (!next.valid())
+        {
+            prepareNextSegment();
+        }
+        return false;
+    }
+
+    int descriptor = next.get();
+    if (descriptor < 0)
+    {
+        qWarning() << "Failed to open segment" << segment_index + 1 << "- retrying.";
+        prepareNextSegment();
+        return false;
+    }
+
+    auto writer = std::make_unique<FileWriter>(next_filename, descriptor);
+    if (writer->filename().isEmpty())
+    {
+        qWarning() << "Failed to open segment" << segment_index + 1 << "- retrying.";
+        QFile::remove(next_filename);
+        prepareNextSegment();
+        return false;
+    }
+
+    waitForRetired();
+
+    std::unique_ptr<FileWriter> finished = std::move(current);
+    current = std::move(writer);
+    ++segment_index;
+
+    segments.append(current->filename());
+    segment_packets.append(0);
+    segment_timer.restart();
+
+    // Closing may sync or save an index and the manifest commit syncs and
+    // renames; neither belongs on the writing thread.
+    retired = std::async(std::launch::async, [finished = std::move(finished), filename = manifestFilename(),
+                                              content = manifestContent()]() mutable {
+        finished->close();
+        commitManifest(filename, content);
+        return std::move(finished);
+    });
+
+    prepareNextSegment();
+
+    return true;
+}
+
+void SegmentedFileWriter::waitForRetired()
+{
+    if (retired.valid())
+    {
+        retired.get().reset();
+    }
+}
+
+QByteArray SegmentedFileWriter::manifestContent() const
+{
+    QByteArray content = default_manifest_header.toUtf8() + "\n";
+    for (qsizetype index = 0; index < segments.size(); ++index)
+    {
+        content += QFileInfo(segments.at(index)).fileName().toUtf8() + "\t" + QByteArray::number(segment_packets.at(index)) + "\n";
+    }
+
+    return content;
+}
+
+void SegmentedFileWriter::writeManifest()
+{
+    commitManifest(manifestFilename(), manifestContent());
+}
+
+void SegmentedFileWriter::commitManifest(const QString &filename, const QByteArray &content)
+{
+    QSaveFile manifest(filename);
+    if (!manifest.open(QIODevice::WriteOnly))
+    {
+        qWarning() << "Failed to open manifest for writing:" << manifest.errorString();
+        return;
+    }
+
+    manifest.write(content);
+    if (!manifest.commit())
+    {
+        qWarning() << "Failed to commit manifest:" << manifest.errorString();
+    }
+}
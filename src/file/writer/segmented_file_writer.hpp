@@ -0,0 +1,82 @@
+#ifndef SEGMENTED_FILE_WRITER_HPP
+#define SEGMENTED_FILE_WRITER_HPP
+
+#include "file_writer.hpp"
+
+#include <QString>
+#include <QStringList>
+#include <QObject>
+#include <QElapsedTimer>
+
+#include <future>
+#include <memory>
+
+
+// Writes one logical stream as a series of .dgs segments. Each segment is a
+// complete file with its own signature and settings header; the file of the
+// segment after the current one is created and given its header in the
+// background, and the finished segment is closed and the manifest committed
+// there as well, so rollover only swaps handles.
+// A manifest next to the segments lists them in order for SegmentedFileReader.
+class SegmentedFileWriter : QObject
+{
+    Q_OBJECT
+public:
+    // A segment runs past either limit for as long as its successor is not
+    // ready yet; packets are never held back or dropped for a rollover.
+    struct RotationPolicy
+    {
+        qint64 max_bytes;       // 0 - no size limit
+        qint64 max_duration_ms; // 0 - no duration limit
+    };
+
+    explicit SegmentedFileWriter(const RotationPolicy &policy, QObject *parent = nullptr);
+    explicit SegmentedFileWriter(const QString &base_name, const RotationPolicy &policy, QObject *parent = nullptr);
+    ~SegmentedFileWriter();
+
+    void write(const QVector<device::DevicePSDSettings> &settings_array);
+    void write(const QVector<device::WaveformPacket> &waveform_array);
+    void write(std::span<const device::WaveformPacket> waveforms);
+    void write(const device::WaveformPacket &waveform);
+
+    void close();
+
+    QString manifestFilename() const;
+    QStringList segmentFilenames() const;
+
+private:
+    bool initialize(QString base_name);
+
+    QString segmentFilename(uint32_t index) const;
+    void prepareNextSegment();
+    void discardNextSegment();
+    bool rotate();
+    void waitForRetired();
+
+    QByteArray manifestContent() const;
+    void writeManifest();
+    static void commitManifest(const QString &filename, const QByteArray &content);
+
+private:
+    RotationPolicy policy;
+    QString base;
+
+    QVector<device::DevicePSDSettings> settings;
+
+    std::unique_ptr<FileWriter> current;
+    // Only the descriptor is opened in the background; the FileWriter is
+    // created on the owning thread.
+    std::future<int> next;
+    QString next_filename;
+    // The finished segment comes back once closed to be destroyed on the
+    // owning thread.
+    std::future<std::unique_ptr<FileWriter>> retired;
+    uint32_t segment_index;
+
+    QStringList segments;
+    QVector<quint64> segment_packets;
+
+    QElapsedTimer segment_timer;
+};
+
+#endif // SEGMENTED_FILE_WRITER_HPP
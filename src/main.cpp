@@ -1,16 +1,34 @@
 #include "file_writer.hpp"
 #include "file_reader.hpp"
 #include "file_validator.hpp"
+#include "columnar_exporter.hpp"
+#include "histogram_builder.hpp"
+#include "file_merger.hpp"
+#include "channel_demuxer.hpp"
+#include "lod_pyramid.hpp"
+#include "file_statistics.hpp"
+#include "packet_server.hpp"
+#include "checkpoint_log.hpp"
+#include "trace_events.hpp"
+#include "validation_cache.hpp"
+#include "waveform_digest.hpp"
 
 #include <QDir>
 #include <QRandomGenerator>
 #include <QCoreApplication>
 #include <QCommandLineParser>
+#include <QElapsedTimer>
 
+#include <csignal>
 #include <iostream>
+#include <span>
+#include <thread>
+
+#include <pthread.h>
 
 #define WAVEFORM_MIN_VALUES 1
 #define WAVEFORM_MAX_VALUES 10
+#define STREAMING_BATCH_SIZE 4096
 
 device::DevicePSDSettings generate_random_settings(int i)
 {
@@ -39,21 +57,115 @@ device::DevicePSDSettings generate_random_settings(int i)
     return settings_temp;
 }
 
-device::WaveformPacket generate_random_weveforms()
+void generate_random_weveforms(device::WaveformPacket &weveform_temp)
 {
-    device::WaveformPacket weveform_temp;
-
     weveform_temp.nubmerOfValues = QRandomGenerator::global()->bounded(static_cast<quint32>(WAVEFORM_MIN_VALUES), static_cast<quint32>(WAVEFORM_MAX_VALUES));
     weveform_temp.baseline = QRandomGenerator::global()->bounded(static_cast<quint16>(0), static_cast<quint16>(std::numeric_limits<uint16_t>::max()));
     weveform_temp.chanelId = QRandomGenerator::global()->bounded(static_cast<quint16>(0), static_cast<quint16>(std::numeric_limits<uint16_t>::max()));
 
+    // Keeps the capacity when a packet is regenerated in place.
+    weveform_temp.values.clear();
     weveform_temp.values.reserve(weveform_temp.nubmerOfValues);
     for (int i = 0; i < weveform_temp.nubmerOfValues; ++i)
     {
         weveform_temp.values.append(QRandomGenerator::global()->bounded(static_cast<quint16>(0), static_cast<quint16>(std::numeric_limits<uint16_t>::max())));
     }
+}
 
-    return weveform_temp;
+void report_throughput(const char *stage, qint64 bytes, qint64 elapsed_ns)
+{
+    double seconds = std::max<qint64>(elapsed_ns, 1) / 1e9;
+    std::cout << stage << " " << bytes << " bytes in " << seconds << " s ("
+              << (bytes / seconds) / (1024 * 1024) << " MiB/s)" << std::endl;
+}
+
+// Round trip whose memory use does not grow with the file: packets are
+// generated and read back one batch at a time and only their running digests
+// are kept for the comparison.
+bool streaming_round_trip(uint32_t number_of_settings, uint32_t number_of_weveforms)
+{
+    QVector<device::DevicePSDSettings> settings;
+    QVector<device::DevicePSDSettings> settings_read;
+    QVector<device::WaveformPacket> batch(STREAMING_BATCH_SIZE);
+
+    WaveformDigest written;
+    WaveformDigest read;
+    QElapsedTimer timer;
+
+    FileWriter writer;
+
+    std::cout << "Streaming " << number_of_weveforms << " waveform packets" << std::endl;
+    timer.start();
+
+    settings.reserve(number_of_settings);
+    for (uint32_t i = 0; i < number_of_settings; ++i)
+    {
+        settings.append(generate_random_settings(i));
+    }
+    writer.write(settings);
+
+    for (uint32_t done = 0; done < number_of_weveforms;)
+    {
+        uint32_t count = std::min<uint32_t>(STREAMING_BATCH_SIZE, number_of_weveforms - done);
+        for (uint32_t i = 0; i < count; ++i)
+        {
+            generate_random_weveforms(batch[i]);
+            written.add(batch[i]);
+        }
+
+        writer.write(std::span<const device::WaveformPacket>(batch.constData(), count));
+        done += count;
+    }
+    // size() only reports an open file.
+    qint64 file_size = writer.size();
+    writer.close();
+
+    report_throughput("Written", file_size, timer.nsecsElapsed());
+
+    timer.restart();
+
+    FileReader reader(writer.filename());
+    std::cout << reader.checkErrors();
+    reader.readSettings(settings_read);
+
+    while (!reader.atEnd())
+    {
+        uint32_t read_count = 0;
+        if (!reader.readWaveforms(std::span<device::WaveformPacket>(batch.data(), batch.size()), read_count) || read_count == 0)
+        {
+            break;
+        }
+
+        for (uint32_t i = 0; i < read_count; ++i)
+        {
+            read.add(batch[i]);
+        }
+    }
+    reader.close();
+
+    report_throughput("Read", file_size, timer.nsecsElapsed());
+
+    bool settings_match = settings_read == settings;
+    std::cout << (settings_match ? "Header match" : "Header differ") << std::endl;
+
+    std::cout << "Digest written " << std::hex << written.value() << ", read " << read.value() << std::dec
+              << " over " << read.packets() << "/" << written.packets() << " packets" << std::endl;
+
+    if (written == read)
+    {
+        std::cout << "Waveform match" << std::endl;
+        return settings_match;
+    }
+
+    auto channels = written.differingChannels(read);
+    std::cout << "Waveform differ in " << channels.size() << " channel(s)";
+    for (qsizetype i = 0; i < std::min<qsizetype>(channels.size(), 8); ++i)
+    {
+        std::cout << " " << channels.at(i);
+    }
+    std::cout << std::endl;
+
+    return false;
 }
 
 void clear_directory()
@@ -93,20 +205,264 @@ int main(int argc, char *argv[])
                                             QCoreApplication::translate("main", "number"));
     QCommandLineOption deleteOption(QStringList() << "d" << "delete",
                                     QCoreApplication::translate("main", "Delete all output files."));
+    QCommandLineOption export_columns_option(QStringList() << "export-columns",
+                                             QCoreApplication::translate("main", "Export <file> as .npy columns into directory."),
+                                             QCoreApplication::translate("main", "directory"));
+    QCommandLineOption histograms_option(QStringList() << "histograms",
+                                         QCoreApplication::translate("main", "Fill per-channel histograms from <file...> into directory."),
+                                         QCoreApplication::translate("main", "directory"));
+    QCommandLineOption trace_option(QStringList() << "trace",
+                                    QCoreApplication::translate("main", "Write a Chrome trace of the run to file (needs ENABLE_TRACING)."),
+                                    QCoreApplication::translate("main", "file"));
+    QCommandLineOption merge_option(QStringList() << "merge",
+                                    QCoreApplication::translate("main", "Concatenate <file...> with matching settings into output."),
+                                    QCoreApplication::translate("main", "output"));
+    QCommandLineOption demux_option(QStringList() << "demux",
+                                    QCoreApplication::translate("main", "Split <file> into one file per channel in directory."),
+                                    QCoreApplication::translate("main", "directory"));
+    QCommandLineOption pyramid_option(QStringList() << "pyramid",
+                                      QCoreApplication::translate("main", "Build the min/max overview sidecar of <file...>."));
+    QCommandLineOption validation_cache_option(QStringList() << "validation-cache",
+                                               QCoreApplication::translate("main", "Reuse validation results stored next to unchanged input files."));
+    QCommandLineOption streaming_option(QStringList() << "streaming",
+                                        QCoreApplication::translate("main", "Check the round trip with running digests instead of in-memory copies."));
+    QCommandLineOption stats_option(QStringList() << "stats",
+                                    QCoreApplication::translate("main", "Print per-channel packet statistics of <file...>."));
+    QCommandLineOption json_option(QStringList() << "json",
+                                   QCoreApplication::translate("main", "Print statistics as JSON instead of a table."));
+    QCommandLineOption sample_every_option(QStringList() << "sample-every",
+                                           QCoreApplication::translate("main", "Also reduce the samples of every n-th packet for statistics."),
+                                           QCoreApplication::translate("main", "n"));
+    QCommandLineOption serve_option(QStringList() << "serve",
+                                    QCoreApplication::translate("main", "Serve validated packets of .dgs files on a Unix socket."),
+                                    QCoreApplication::translate("main", "socket"));
+    QCommandLineOption recover_option(QStringList() << "recover",
+                                      QCoreApplication::translate("main", "Cut <file...> left by a crashed writer back to the last complete packet."));
 
     parser.addOption(header_number_option);
     parser.addOption(body_number_option);
     parser.addOption(deleteOption);
+    parser.addOption(export_columns_option);
+    parser.addOption(histograms_option);
+    parser.addOption(trace_option);
+    parser.addOption(merge_option);
+    parser.addOption(demux_option);
+    parser.addOption(pyramid_option);
+    parser.addOption(validation_cache_option);
+    parser.addOption(streaming_option);
+    parser.addOption(stats_option);
+    parser.addOption(json_option);
+    parser.addOption(sample_every_option);
+    parser.addOption(serve_option);
+    parser.addOption(recover_option);
+
+    parser.addPositionalArgument("file", QCoreApplication::translate("main", "Existing .dgs file(s) to process."), "[file...]");
 
     parser.process(app);
 
+    // Written when main returns, whichever mode ran.
+    trace::Session trace_session(parser.value(trace_option));
+    validation_cache::setEnabled(parser.isSet(validation_cache_option));
+
     uint32_t number_of_settings = parser.value(header_number_option).toUInt();
     uint32_t number_of_weveforms = parser.value(body_number_option).toUInt() ;
 
-    std::cout << "Application received: " << argc << " arguments:" << std::endl;
-    for (int i = 0; i < argc; ++i)
+    // JSON statistics are meant to be piped, so nothing else goes to stdout.
+    if (!parser.isSet(json_option))
+    {
+        std::cout << "Application received: " << argc << " arguments:" << std::endl;
+        for (int i = 0; i < argc; ++i)
+        {
+            std::cout << argv[i] << std::endl;
+        }
+    }
+
+    if (parser.isSet(export_columns_option))
+    {
+        if (parser.positionalArguments().isEmpty())
+        {
+            std::cout << "No input file given for export" << std::endl;
+            return 1;
+        }
+
+        ColumnarExporter exporter(parser.value(export_columns_option));
+        bool exported = exporter.exportFile(parser.positionalArguments().first());
+
+        std::cout << "Exported " << exporter.exportedPackets() << " waveform packets" << std::endl;
+        return exported ? 0 : 1;
+    }
+
+    if (parser.isSet(histograms_option))
+    {
+        if (parser.positionalArguments().isEmpty())
+        {
+            std::cout << "No input files given for histograms" << std::endl;
+            return 1;
+        }
+
+        HistogramBuilder::Configuration configuration;
+        configuration.height = { 4096, 0., 65536. };
+        configuration.integral = { 4096, 0., 4194304. };
+        configuration.psd = { 256, 0., 1. };
+        configuration.integral_2d = { 256, 0., 4194304. };
+        configuration.psd_2d = { 128, 0., 1. };
+        configuration.threads = 0;
+
+        HistogramBuilder builder(configuration);
+        bool built = builder.build(parser.positionalArguments());
+        bool saved = builder.save(parser.value(histograms_option));
+
+        std::cout << "Histogrammed " << builder.processedPackets() << " waveform packets from "
+                  << builder.channels().size() << " channels" << std::endl;
+        return (built && saved) ? 0 : 1;
+    }
+
+    if (parser.isSet(merge_option))
+    {
+        if (parser.positionalArguments().isEmpty())
+        {
+            std::cout << "No input files given for merge" << std::endl;
+            return 1;
+        }
+
+        FileMerger merger(parser.value(merge_option));
+        bool merged = merger.merge(parser.positionalArguments());
+
+        std::cout << "Merged " << merger.mergedPackets() << " waveform packets, " << merger.splicedBytes()
+                  << " bytes spliced, " << merger.copiedBytes() << " bytes copied" << std::endl;
+        return merged ? 0 : 1;
+    }
+
+    if (parser.isSet(demux_option))
+    {
+        if (parser.positionalArguments().isEmpty())
+        {
+            std::cout << "No input file given for demux" << std::endl;
+            return 1;
+        }
+
+        ChannelDemuxer demuxer(parser.value(demux_option));
+        bool demuxed = demuxer.demux(parser.positionalArguments().first());
+
+        std::cout << "Demuxed " << demuxer.demuxedPackets() << " waveform packets into "
+                  << demuxer.outputFilenames().size() << " channel files" << std::endl;
+        return demuxed ? 0 : 1;
+    }
+
+    if (parser.isSet(pyramid_option))
     {
-        std::cout << argv[i] << std::endl;
+        if (parser.positionalArguments().isEmpty())
+        {
+            std::cout << "No input files given for pyramid" << std::endl;
+            return 1;
+        }
+
+        bool built = true;
+        for (const auto &filename : parser.positionalArguments())
+        {
+            built &= LodPyramid::build(filename);
+        }
+
+        std::cout << "Built " << parser.positionalArguments().size() << " pyramid sidecars" << std::endl;
+        return built ? 0 : 1;
+    }
+
+    if (parser.isSet(recover_option))
+    {
+        if (parser.positionalArguments().isEmpty())
+        {
+            std::cout << "No input files given for recovery" << std::endl;
+            return 1;
+        }
+
+        bool recovered = true;
+        for (const auto &filename : parser.positionalArguments())
+        {
+            CheckpointLog::Recovery recovery;
+            if (!CheckpointLog::recover(filename, recovery))
+            {
+                recovered = false;
+                continue;
+            }
+
+            std::cout << filename.toStdString() << ": kept " << recovery.packets << " waveform packets, "
+                      << recovery.size << " bytes; scanned " << recovery.scanned_bytes << " bytes "
+                      << (recovery.from_checkpoint ? "after checkpoint" : "without checkpoint") << ", cut "
+                      << recovery.truncated_bytes << " bytes" << std::endl;
+        }
+
+        return recovered ? 0 : 1;
+    }
+
+    if (parser.isSet(serve_option))
+    {
+        // SIGINT and SIGTERM are taken by a thread of their own, which stops
+        // the server so that its socket is unlinked and clients are let go.
+        sigset_t signals;
+        sigemptyset(&signals);
+        sigaddset(&signals, SIGINT);
+        sigaddset(&signals, SIGTERM);
+        pthread_sigmask(SIG_BLOCK, &signals, nullptr);
+
+        PacketServer server(parser.value(serve_option));
+        if (!server.listen())
+        {
+            return 1;
+        }
+
+        std::thread stopper([&server, &signals]() {
+            int signal;
+            sigwait(&signals, &signal);
+            server.stop();
+        });
+
+        std::cout << "Serving packets on " << parser.value(serve_option).toStdString() << std::endl;
+        server.serve();
+
+        // serve() may also end on its own; the stopper is woken either way.
+        pthread_kill(stopper.native_handle(), SIGTERM);
+        stopper.join();
+        return 0;
+    }
+
+    if (parser.isSet(stats_option))
+    {
+        if (parser.positionalArguments().isEmpty())
+        {
+            std::cerr << "No input files given for stats" << std::endl;
+            return 1;
+        }
+
+        bool json = parser.isSet(json_option);
+        bool scanned = true;
+
+        if (json)
+        {
+            std::cout << "[";
+        }
+
+        for (qsizetype index = 0; index < parser.positionalArguments().size(); ++index)
+        {
+            FileStatistics statistics(0, parser.value(sample_every_option).toUInt());
+            scanned &= statistics.scan(parser.positionalArguments().at(index));
+
+            if (json)
+            {
+                std::cout << (index > 0 ? "," : "");
+                statistics.writeJson(std::cout);
+            }
+            else
+            {
+                statistics.writeTable(std::cout);
+            }
+        }
+
+        if (json)
+        {
+            std::cout << "]" << std::endl;
+        }
+
+        return scanned ? 0 : 1;
     }
 
     if (parser.isSet(deleteOption))
@@ -127,6 +483,14 @@ int main(int argc, char *argv[])
         }
     }
 
+    if (parser.isSet(streaming_option))
+    {
+        bool matched = streaming_round_trip(number_of_settings, number_of_weveforms);
+
+        app.quit();
+        return matched ? 0 : 1;
+    }
+
     FileWriter writer;
     QVector<device::DevicePSDSettings> settings;
     QVector<device::WaveformPacket> waveforms;
@@ -155,9 +519,9 @@ int main(int argc, char *argv[])
 
         waveforms.reserve(number_of_weveforms);
 
-        for (int i = 0; i < number_of_settings; ++i)
+        for (int i = 0; i < number_of_weveforms; ++i)
         {
-            waveforms.append(generate_random_weveforms());
+            generate_random_weveforms(waveforms.emplace_back());
         }
 
         std::cout << "Writing waveform packets" << std::endl;
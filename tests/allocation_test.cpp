@@ -0,0 +1,157 @@
+#include "benchmark_common.hpp"
+#include "file_reader.hpp"
+
+#include <QCoreApplication>
+
+#include <atomic>
+#include <cerrno>
+#include <vector>
+
+
+// Every allocation of the process goes through these, operator new and its
+// aligned forms included, so the steady-state loops below can be checked.
+extern "C" void *__libc_malloc(size_t size);
+extern "C" void *__libc_calloc(size_t count, size_t size);
+extern "C" void *__libc_realloc(void *pointer, size_t size);
+extern "C" void *__libc_memalign(size_t alignment, size_t size);
+
+namespace
+{
+std::atomic<quint64> allocations{0};
+
+const uint32_t batch_packets = 1024;
+const uint32_t batches = 64;
+// Batches run before counting, so buffers reach their steady size.
+const uint32_t warm_up_batches = 2;
+}
+
+extern "C" void *malloc(size_t size)
+{
+    allocations.fetch_add(1, std::memory_order_relaxed);
+    return __libc_malloc(size);
+}
+
+extern "C" void *calloc(size_t count, size_t size)
+{
+    allocations.fetch_add(1, std::memory_order_relaxed);
+    return __libc_calloc(count, size);
+}
+
+extern "C" void *realloc(void *pointer, size_t size)
+{
+    allocations.fetch_add(1, std::memory_order_relaxed);
+    return __libc_realloc(pointer, size);
+}
+
+extern "C" void *memalign(size_t alignment, size_t size)
+{
+    allocations.fetch_add(1, std::memory_order_relaxed);
+    return __libc_memalign(alignment, size);
+}
+
+extern "C" void *aligned_alloc(size_t alignment, size_t size)
+{
+    allocations.fetch_add(1, std::memory_order_relaxed);
+    return __libc_memalign(alignment, size);
+}
+
+extern "C" int posix_memalign(void **pointer, size_t alignment, size_t size)
+{
+    allocations.fetch_add(1, std::memory_order_relaxed);
+
+    if (alignment < sizeof(void *) || (alignment & (alignment - 1)) != 0)
+    {
+        return EINVAL;
+    }
+
+    void *memory = __libc_memalign(alignment, size);
+    if (!memory)
+    {
+        return ENOMEM;
+    }
+
+    *pointer = memory;
+    return 0;
+}
+
+// Once warmed up, writing and decoding into reused packets must not allocate
+// at all, neither per packet nor per batch.
+bool check(const char *name, quint64 counted, quint64 packets)
+{
+    std::cout << name << ": " << counted << " allocations for " << packets << " packets" << std::endl;
+
+    if (packets == 0)
+    {
+        std::cout << name << " read no packets" << std::endl;
+        return false;
+    }
+
+    if (counted != 0)
+    {
+        std::cout << name << " allocates in its steady state" << std::endl;
+        return false;
+    }
+    return true;
+}
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+
+    QString uniform_name = benchmark::generateFile("allocation_test.dgs", batch_packets * batches);
+    QString variable_name = "allocation_test_variable.dgs";
+
+    // Lengths repeat with the batch, so every reused slot sees the same length
+    // and keeps its sample buffer.
+    std::vector<device::WaveformPacket> packets(batch_packets);
+    for (uint32_t index = 0; index < batch_packets; ++index)
+    {
+        packets[index].nubmerOfValues = 200 + index % 64;
+        packets[index].baseline = 1000;
+        packets[index].chanelId = index % 8;
+        packets[index].values.fill(1000 + index, packets[index].nubmerOfValues);
+    }
+
+    bool result = true;
+
+    {
+        FileWriter writer(variable_name);
+        writer.write(benchmark::generateSettings(8, 256));
+        for (uint32_t batch = 0; batch < warm_up_batches; ++batch)
+        {
+            writer.write(std::span<const device::WaveformPacket>(packets));
+        }
+
+        quint64 before = allocations.load();
+        for (uint32_t batch = warm_up_batches; batch < batches; ++batch)
+        {
+            writer.write(std::span<const device::WaveformPacket>(packets));
+        }
+        result &= check("write", allocations.load() - before, quint64(batches - warm_up_batches) * batch_packets);
+    }
+
+    for (const auto &filename : { variable_name, uniform_name })
+    {
+        FileReader reader(filename);
+        QVector<device::DevicePSDSettings> settings;
+        reader.readSettings(settings);
+
+        uint32_t read_count = 0;
+        for (uint32_t batch = 0; batch < warm_up_batches; ++batch)
+        {
+            reader.readWaveforms(std::span<device::WaveformPacket>(packets), read_count);
+        }
+
+        quint64 read_packets = 0;
+        quint64 before = allocations.load();
+        while (reader.readWaveforms(std::span<device::WaveformPacket>(packets), read_count) && read_count > 0)
+        {
+            read_packets += read_count;
+        }
+        result &= check(filename == variable_name ? "serial read" : "indexed read", allocations.load() - before, read_packets);
+    }
+
+    QFile::remove(uniform_name);
+    QFile::remove(variable_name);
+    return result ? 0 : 1;
+}
@@ -0,0 +1,91 @@
+#include "waveform_digest.hpp"
+
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <vector>
+
+
+namespace
+{
+constexpr quint64 prime32 = 2654435761ULL;
+
+struct Vector
+{
+    const char *name;
+    std::vector<uchar> input;
+    quint64 seed;
+    quint64 expected;
+};
+
+// The sanity buffer of the reference xxhsum: each byte is the top byte of a
+// generator that squares itself, starting from the first 32-bit prime.
+std::vector<uchar> sanityBuffer(size_t size)
+{
+    std::vector<uchar> buffer(size);
+    quint32 generator = prime32;
+
+    for (auto &byte : buffer)
+    {
+        byte = static_cast<uchar>(generator >> 24);
+        generator *= generator;
+    }
+
+    return buffer;
+}
+
+std::vector<uchar> text(const char *value)
+{
+    return std::vector<uchar>(value, value + std::strlen(value));
+}
+
+bool check(const char *name, const char *how, quint64 actual, quint64 expected)
+{
+    if (actual == expected)
+    {
+        return true;
+    }
+
+    std::cout << name << " (" << how << "): got " << std::hex << std::setw(16) << std::setfill('0') << actual
+              << ", expected " << std::setw(16) << expected << std::dec << std::setfill(' ') << std::endl;
+    return false;
+}
+}
+
+int main()
+{
+    const std::vector<Vector> vectors = {
+        { "empty", {}, 0, 0xEF46DB3751D8E999ULL },
+        { "empty, seeded", {}, prime32, 0xAC75FDA2929B17EFULL },
+        { "sanity buffer", sanityBuffer(101), 0, 0x0EAB543384F878ADULL },
+        { "sanity buffer, seeded", sanityBuffer(101), prime32, 0xCAA65939306F1E21ULL },
+        { "a", text("a"), 0, 0xD24EC4F1A98C6E5BULL },
+        { "abc", text("abc"), 0, 0x44BC2CF5AD770999ULL },
+        { "fox", text("The quick brown fox jumps over the lazy dog"), 0, 0x0B242D361FDA71BCULL },
+    };
+
+    bool result = true;
+
+    for (const auto &vector : vectors)
+    {
+        Xxh64 whole(vector.seed);
+        whole.update(vector.input.data(), vector.input.size());
+        result &= check(vector.name, "whole", whole.digest(), vector.expected);
+
+        // Piece sizes around the 32-byte stripe exercise every carry-over path.
+        for (qint64 piece : { 1, 3, 7, 31, 32, 33 })
+        {
+            Xxh64 streamed(vector.seed);
+            for (qint64 offset = 0; offset < static_cast<qint64>(vector.input.size()); offset += piece)
+            {
+                streamed.update(vector.input.data() + offset, std::min<qint64>(piece, vector.input.size() - offset));
+            }
+
+            std::string how = "pieces of " + std::to_string(piece);
+            result &= check(vector.name, how.c_str(), streamed.digest(), vector.expected);
+        }
+    }
+
+    std::cout << (result ? "All XXH64 reference vectors match" : "XXH64 reference vectors differ") << std::endl;
+    return result ? 0 : 1;
+}